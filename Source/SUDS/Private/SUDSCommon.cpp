@@ -1,4 +1,10 @@
 ﻿#include "SUDSCommon.h"
 
+#include "SUDSLibrary.h"
+
 const FName FSUDSConstants::RandomItemSelectIndexVarName(SUDS_RANDOMITEM_VAR);
 
+FSUDSScopedVariableName::FSUDSScopedVariableName(const FName& InName) : Name(InName)
+{
+	bIsGlobal = USUDSLibrary::IsDialogueVariableGlobal(InName, ScopedName);
+}
@@ -12,15 +12,26 @@
 #include "SUDSScriptNodeSet.h"
 #include "SUDSScriptNodeText.h"
 #include "SUDSSubsystem.h"
+#include "Algo/Compare.h"
+#include "Engine/StreamableManager.h"
+#include "Internationalization/TextLocalizationManager.h"
 #include "Kismet/GameplayStatics.h"
 #include "Sound/DialogueSoundWaveProxy.h"
 #include "Sound/DialogueWave.h"
+#include "Sound/SoundWave.h"
 
 DEFINE_LOG_CATEGORY(LogSUDSDialogue);
 
 const FText USUDSDialogue::DummyText = FText::FromString("INVALID");
 const FString USUDSDialogue::DummyString = "INVALID";
 
+/// Streams DialogueWaves for all dialogues
+static FStreamableManager& GetSUDSStreamableManager()
+{
+	static FStreamableManager Manager;
+	return Manager;
+}
+
 
 
 FArchive& operator<<(FArchive& Ar, FSUDSDialogueState& Value)
@@ -56,6 +67,13 @@ void USUDSDialogue::Initialise(const USUDSScript* Script)
 {
 	BaseScript = Script;
 	CurrentSpeakerNode = nullptr;
+	// Caches are keyed on the script's expressions & nodes
+	ConditionCache.Empty();
+	LineSoundCache.Empty();
+	ScriptImportGeneration = Script ? Script->GetImportGeneration() : 0;
+	ScriptVoiceGeneration = Script ? Script->GetVoiceGeneration() : 0;
+	WavesInRangeCache.Empty();
+	ReleaseStreamedWaves();
 
 	InitVariables();
 
@@ -63,9 +81,38 @@ void USUDSDialogue::Initialise(const USUDSScript* Script)
 
 }
 
+void USUDSDialogue::BeginDestroy()
+{
+	ReleaseStreamedWaves();
+	Super::BeginDestroy();
+}
+
+/// Marks a single run step of the dialogue, during which each variable is only requested once unless it changes.
+/// Steps can nest, e.g. a listener getting text while a choice is being made, in which case they're all one step
+struct FSUDSDialogueStepScope
+{
+	USUDSDialogue* Dialogue;
+
+	explicit FSUDSDialogueStepScope(USUDSDialogue* InDialogue) : Dialogue(InDialogue)
+	{
+		++Dialogue->StepDepth;
+	}
+
+	~FSUDSDialogueStepScope()
+	{
+		if (--Dialogue->StepDepth == 0)
+		{
+			Dialogue->VariablesRequestedThisStep.Reset();
+			Dialogue->ProvidedVariablesThisStep.Reset();
+		}
+	}
+};
+
 void USUDSDialogue::InitVariables()
 {
 	VariableState.Empty();
+	VariableVersions.Reset();
+	VariablesRequestedThisStep.Reset();
 	// Run header nodes immediately (only set nodes)
 	RunUntilNextSpeakerNodeOrEnd(BaseScript->GetHeaderNode(), false);
 }
@@ -108,23 +155,105 @@ void USUDSDialogue::AddParticipant(UObject* Participant)
 	}
 }
 
-void USUDSDialogue::SortParticipants()
+FSUDSParticipantDispatch::FSUDSParticipantDispatch(UObject* InObject) : Object(InObject)
+{
+	if (!IsValid(InObject) || !InObject->GetClass()->ImplementsInterface(USUDSParticipant::StaticClass()))
+	{
+		// Not a participant, never called
+		return;
+	}
+
+	NativeInterface = Cast<ISUDSParticipant>(InObject);
+
+	static const TPair<FName, EHandler> Handlers[] =
+	{
+		{ GET_FUNCTION_NAME_CHECKED(ISUDSParticipant, OnDialogueStarting), Starting },
+		{ GET_FUNCTION_NAME_CHECKED(ISUDSParticipant, OnDialogueFinished), Finished },
+		{ GET_FUNCTION_NAME_CHECKED(ISUDSParticipant, OnDialogueSpeakerLine), SpeakerLine },
+		{ GET_FUNCTION_NAME_CHECKED(ISUDSParticipant, OnDialogueChoiceMade), ChoiceMade },
+		{ GET_FUNCTION_NAME_CHECKED(ISUDSParticipant, OnDialogueProceeding), Proceeding },
+		{ GET_FUNCTION_NAME_CHECKED(ISUDSParticipant, OnDialogueEvent), Event },
+		{ GET_FUNCTION_NAME_CHECKED(ISUDSParticipant, OnDialogueVariableChanged), VariableChanged },
+		{ GET_FUNCTION_NAME_CHECKED(ISUDSParticipant, OnDialogueVariableRequested), VariableRequested },
+		{ GET_FUNCTION_NAME_CHECKED(ISUDSParticipant, GetDialogueParticipantPriority), Priority },
+	};
+
+	const UClass* Class = InObject->GetClass();
+	for (const auto& Handler : Handlers)
+	{
+		// This mirrors what the generated Execute_ thunks do, just once instead of per call:
+		// a script function means a Blueprint implementation or override, which needs ProcessEvent. Otherwise the
+		// native _Implementation is called, which we can do directly through the interface.
+		const UFunction* Func = Class->FindFunctionByName(Handler.Key);
+		if (Func && !Func->HasAnyFunctionFlags(FUNC_Native))
+		{
+			HandledMask |= Handler.Value;
+			ScriptMask |= Handler.Value;
+		}
+		else if (NativeInterface)
+		{
+			HandledMask |= Handler.Value;
+		}
+		// Otherwise it's a Blueprint participant which doesn't implement this handler
+	}
+
+	if (Handles(Priority))
+	{
+		CachedPriority = IsNative(Priority)
+			                 ? NativeInterface->GetDialogueParticipantPriority_Implementation()
+			                 : ISUDSParticipant::Execute_GetDialogueParticipantPriority(InObject);
+	}
+}
+
+/// Call a handler on every participant which implements it, directly for native implementations and through
+/// reflection for script ones
+template <typename NativeCall, typename ScriptCall>
+FORCEINLINE void DispatchToParticipants(const TArray<FSUDSParticipantDispatch>& Dispatch,
+                                        FSUDSParticipantDispatch::EHandler Handler,
+                                        NativeCall&& Native,
+                                        ScriptCall&& Script)
 {
-	if (!Participants.IsEmpty())
+	for (const FSUDSParticipantDispatch& P : Dispatch)
 	{
-		// We order by ascending priority so that higher priority values are later in the list
-		// Which means they're called last and get to override values set by earlier ones
-		// We'll do a stable sort so that otherwise order is maintained
-		Participants.StableSort([](const UObject& A, const UObject& B)
+		if (P.Handles(Handler))
 		{
-			if (A.Implements<USUDSParticipant>() && B.Implements<USUDSParticipant>())
+			// Participants can be destroyed while still in the list, in which case the interface is dangling too
+			UObject* Obj = P.Object.Get();
+			if (!Obj)
+				continue;
+
+			if (P.IsNative(Handler))
 			{
-				return ISUDSParticipant::Execute_GetDialogueParticipantPriority(&A) <
-					ISUDSParticipant::Execute_GetDialogueParticipantPriority(&B);
+				Native(P.NativeInterface);
 			}
-			// Be deterministic
-			return &A < &B;
-		});
+			else
+			{
+				Script(Obj);
+			}
+		}
+	}
+}
+
+void USUDSDialogue::SortParticipants()
+{
+	// Work out how to call each participant once, including its priority, so that neither sorting nor raising
+	// events needs to go through reflection
+	ParticipantDispatch.Reset(Participants.Num());
+	for (const auto& P : Participants)
+	{
+		ParticipantDispatch.Emplace(P);
+	}
+	
+	// We order by ascending priority so that higher priority values are later in the list
+	// Which means they're called last and get to override values set by earlier ones
+	// We'll do a stable sort so that otherwise order is maintained
+	ParticipantDispatch.StableSort([](const FSUDSParticipantDispatch& A, const FSUDSParticipantDispatch& B)
+	{
+		return A.CachedPriority < B.CachedPriority;
+	});
+	for (int i = 0; i < ParticipantDispatch.Num(); ++i)
+	{
+		Participants[i] = ParticipantDispatch[i].Object.Get();
 	}
 }
 
@@ -193,42 +322,46 @@ USUDSScriptNode* USUDSDialogue::RunNode(USUDSScriptNode* Node)
 
 USUDSScriptNode* USUDSDialogue::RunSelectNode(USUDSScriptNode* Node)
 {
+	const FSUDSScriptGraph& Graph = BaseScript->GetGraph();
+	const int32 NodeIdx = Node->GetGraphIndex();
+	const TArrayView<const FSUDSScriptGraphEdge> Edges = Graph.GetEdges(NodeIdx);
+	
 	// Define internal random selection variable (used in random selects)
-	if (Node->IsRandomSelect())
+	if (Graph.IsRandomSelect(NodeIdx))
 	{
 		// Random picker
 		// Could try to NOT pick the same ones we already picked, but this would require some additional state, similar
 		// to "ChoicesTaken" state but for random text nodes already chosen. For now, keep it simple
 
-		const int OptCount = Node->GetEdgeCount();
+		const int OptCount = Edges.Num();
 		// Use SRand() so can be seeded if required
 		const int RandChoice = FMath::Min(OptCount-1, FMath::TruncToInt(FMath::SRand() * (float)OptCount));
 
 		SetVariableInt(FSUDSConstants::RandomItemSelectIndexVarName, RandChoice);
 	}
 	
-	for (auto& Edge : Node->GetEdges())
+	for (const FSUDSScriptGraphEdge& Edge : Edges)
 	{
-		if (Edge.GetCondition().IsValid())
+		const FSUDSExpression& Condition = BaseScript->GetExpression(Edge.ConditionIndex);
+		if (Condition.IsValid())
 		{
 			// use the first satisfied edge
-			RaiseExpressionVariablesRequested(Edge.GetCondition(), Edge.GetSourceLineNo());
-			const bool bSuccess = Edge.GetCondition().EvaluateBoolean(VariableState, GetGlobalVariables(), BaseScript->GetName());
+			const bool bSuccess = EvaluateCondition(Edge.ConditionIndex, Edge.SourceLineNo);
 #if WITH_EDITOR
 			{
-				FString ExprStr = Edge.GetCondition().GetSourceString();
+				FString ExprStr = Condition.GetSourceString();
 				if (ExprStr.IsEmpty())
 				{
 					// Lack of condition is an else / final random option
 					ExprStr = "else";
 				}
-				InternalOnSelectEval.ExecuteIfBound(this, ExprStr, bSuccess, Edge.GetSourceLineNo());
+				InternalOnSelectEval.ExecuteIfBound(this, ExprStr, bSuccess, Edge.SourceLineNo);
 			}
 #endif
 			
 			if (bSuccess)
 			{
-				return Edge.GetTargetNode().Get();
+				return Graph.GetNodeObject(Edge.TargetNode);
 			}
 		}
 	}
@@ -243,21 +376,19 @@ USUDSScriptNode* USUDSDialogue::RunEventNode(USUDSScriptNode* Node)
 	{
 		// Build a resolved args list, because we need to evaluate  expressions
 		TArray<FSUDSValue> ArgsResolved;
+		ArgsResolved.Reserve(EvtNode->GetArgs().Num());
 		
-		for (auto& Expr : EvtNode->GetArgs())
+		for (const FSUDSExpression* Expr : EvtNode->GetArgs())
 		{
-			RaiseExpressionVariablesRequested(Expr, EvtNode->GetSourceLineNo());
-			ArgsResolved.Add(Expr.Evaluate(VariableState, GetGlobalVariables()));
+			ArgsResolved.Add(EvaluateExpression(*Expr, EvtNode->GetSourceLineNo()));
 		}
 		
-		for (const auto& P : Participants)
-		{
-			if (P->GetClass()->ImplementsInterface(USUDSParticipant::StaticClass()))
-			{
-				ISUDSParticipant::Execute_OnDialogueEvent(P, this, EvtNode->GetEventName(), ArgsResolved);
-			}
-		}
-		OnEvent.Broadcast(this, EvtNode->GetEventName(), ArgsResolved);
+		DispatchToParticipants(ParticipantDispatch, FSUDSParticipantDispatch::Event,
+			[&](ISUDSParticipant* P) { P->OnDialogueEvent_Implementation(this, EvtNode->GetEventName(), ArgsResolved); },
+			[&](UObject* P) { ISUDSParticipant::Execute_OnDialogueEvent(P, this, EvtNode->GetEventName(), ArgsResolved); });
+		OnEventNative.Broadcast(this, EvtNode->GetEventName(), ArgsResolved);
+		if (OnEvent.IsBound())
+			OnEvent.Broadcast(this, EvtNode->GetEventName(), ArgsResolved);
 #if WITH_EDITOR
 		InternalOnEvent.ExecuteIfBound(this, EvtNode->GetEventName(), ArgsResolved, EvtNode->GetSourceLineNo());
 #endif
@@ -269,7 +400,7 @@ USUDSScriptNode* USUDSDialogue::RunGosubNode(USUDSScriptNode* Node)
 {
 	if (USUDSScriptNodeGosub* GosubNode = Cast<USUDSScriptNodeGosub>(Node))
 	{
-		if (auto TargetNode = BaseScript->GetNodeByLabel(GosubNode->GetLabelName()))
+		if (auto TargetNode = BaseScript->GetGraph().GetGosubTarget(GosubNode->GetGraphIndex()))
 		{
 			// Push this gosub node to the return stack, then jump
 			GosubReturnStack.Push(GosubNode);
@@ -314,12 +445,11 @@ USUDSScriptNode* USUDSDialogue::RunSetVariableNode(USUDSScriptNode* Node)
 	{
 		if (SetNode->GetExpression().IsValid())
 		{
-			RaiseExpressionVariablesRequested(SetNode->GetExpression(), SetNode->GetSourceLineNo());
-			FSUDSValue Value = SetNode->GetExpression().Evaluate(VariableState, GetGlobalVariables());
-			FName Identifier;
-			if (USUDSLibrary::IsDialogueVariableGlobal(SetNode->GetIdentifier(), Identifier))
+			FSUDSValue Value = EvaluateExpression(SetNode->GetExpression(), SetNode->GetSourceLineNo());
+			const FSUDSScopedVariableName& Identifier = SetNode->GetScopedIdentifier();
+			if (Identifier.bIsGlobal)
 			{
-				InternalSetGlobalVariable(this->GetWorld(), Identifier, Value, true, BaseScript->GetName(), SetNode->GetSourceLineNo());
+				InternalSetGlobalVariable(this->GetWorld(), Identifier.ScopedName, Value, true, BaseScript->GetName(), SetNode->GetSourceLineNo());
 			}
 			else
 			{
@@ -345,14 +475,12 @@ USUDSScriptNode* USUDSDialogue::RunSetVariableNode(USUDSScriptNode* Node)
 
 void USUDSDialogue::RaiseVariableChange(const FName& VarName, const FSUDSValue& Value, bool bFromScript, int LineNo)
 {
-	for (const auto& P : Participants)
-	{
-		if (P->GetClass()->ImplementsInterface(USUDSParticipant::StaticClass()))
-		{
-			ISUDSParticipant::Execute_OnDialogueVariableChanged(P, this, VarName, Value, bFromScript);
-		}
-	}
-	OnVariableChanged.Broadcast(this, VarName, Value, bFromScript);
+	DispatchToParticipants(ParticipantDispatch, FSUDSParticipantDispatch::VariableChanged,
+		[&](ISUDSParticipant* P) { P->OnDialogueVariableChanged_Implementation(this, VarName, Value, bFromScript); },
+		[&](UObject* P) { ISUDSParticipant::Execute_OnDialogueVariableChanged(P, this, VarName, Value, bFromScript); });
+	OnVariableChangedNative.Broadcast(this, VarName, Value, bFromScript);
+	if (OnVariableChanged.IsBound())
+		OnVariableChanged.Broadcast(this, VarName, Value, bFromScript);
 #if WITH_EDITOR
 	if (!bFromScript)
 	{
@@ -363,27 +491,262 @@ void USUDSDialogue::RaiseVariableChange(const FName& VarName, const FSUDSValue&
 
 }
 
-void USUDSDialogue::RaiseVariableRequested(const FName& VarName, int LineNo)
+void USUDSDialogue::RaiseVariableRequested(const FSUDSScopedVariableName& Variable, int LineNo)
 {
+	const FName& VarName = Variable.Name;
+	const FSUDSVariableVersions* GlobalVersions = nullptr;
+	bool bCoalesce = StepDepth > 0;
+	if (bCoalesce && Variable.bIsGlobal)
+	{
+		// Without versions we can't tell whether a global has changed since it was requested
+		GlobalVersions = InternalGetGlobalVariableVersions(this->GetWorld());
+		bCoalesce = GlobalVersions != nullptr;
+	}
+	if (bCoalesce)
+	{
+		const uint32* RequestedVersion = VariablesRequestedThisStep.Find(VarName);
+		if (RequestedVersion && *RequestedVersion == (GlobalVersions ? GlobalVersions->Get(Variable.ScopedName) : 0))
+		{
+			// Already asked for this step, and it hasn't changed since
+			++VariableRequestsSkipped;
+			return;
+		}
+	}
+	
 	// Because variables set by participants should "win", raise event first
-	OnVariableRequested.Broadcast(this, VarName);
-	for (const auto& P : Participants)
+	OnVariableRequestedNative.Broadcast(this, VarName);
+	if (OnVariableRequested.IsBound())
+		OnVariableRequested.Broadcast(this, VarName);
+	DispatchToParticipants(ParticipantDispatch, FSUDSParticipantDispatch::VariableRequested,
+		[&](ISUDSParticipant* P) { P->OnDialogueVariableRequested_Implementation(this, VarName); },
+		[&](UObject* P) { ISUDSParticipant::Execute_OnDialogueVariableRequested(P, this, VarName); });
+
+	// Mark after raising, so that setting the variable in response doesn't clear it again
+	if (bCoalesce)
+	{
+		VariablesRequestedThisStep.Add(VarName, GlobalVersions ? GlobalVersions->Get(Variable.ScopedName) : 0);
+	}
+}
+
+bool USUDSDialogue::ProvideVariable(const FSUDSScopedVariableName& Variable, FSUDSValue& OutValue)
+{
+	const FSUDSVariableProviderRegistry& Registry = Variable.bIsGlobal
+		                                                ? USUDSSubsystem::GetGlobalVariableProviders()
+		                                                : VariableProviders;
+	if (Registry.IsEmpty())
+	{
+		return false;
+	}
+
+	if (StepDepth > 0)
+	{
+		if (const TOptional<FSUDSValue>* Cached = ProvidedVariablesThisStep.Find(Variable.Name))
+		{
+			if (Cached->IsSet())
+			{
+				OutValue = Cached->GetValue();
+				return true;
+			}
+			return false;
+		}
+	}
+
+	const bool bProvided = Registry.Provide(this, Variable.ScopedName, OutValue);
+	if (StepDepth > 0)
+	{
+		ProvidedVariablesThisStep.Add(Variable.Name, bProvided ? TOptional<FSUDSValue>(OutValue) : TOptional<FSUDSValue>());
+	}
+	return bProvided;
+}
+
+void USUDSDialogue::OnVariableProvidersChanged()
+{
+	// Cached conditions may read variables which are provided differently now
+	ConditionCache.Empty();
+	ProvidedVariablesThisStep.Reset();
+}
+
+void USUDSDialogue::RegisterVariableProvider(FName Name, FSUDSVariableProvider Provider)
+{
+	VariableProviders.Register(Name, MoveTemp(Provider));
+	OnVariableProvidersChanged();
+}
+
+void USUDSDialogue::RegisterVariableProviderPrefix(const FString& Prefix, FSUDSVariableProvider Provider)
+{
+	VariableProviders.RegisterPrefix(Prefix, MoveTemp(Provider));
+	OnVariableProvidersChanged();
+}
+
+void USUDSDialogue::UnregisterVariableProvider(FName Name)
+{
+	VariableProviders.Unregister(Name);
+	OnVariableProvidersChanged();
+}
+
+void USUDSDialogue::UnregisterVariableProviderPrefix(const FString& Prefix)
+{
+	VariableProviders.UnregisterPrefix(Prefix);
+	OnVariableProvidersChanged();
+}
+
+/// Gives functions called by expressions the dialogue, where variables aren't requested, e.g. user metadata
+struct FSUDSDialogueExpressionContext : public ISUDSExpressionVariableHandler
+{
+	USUDSDialogue* Dialogue;
+
+	// Metadata getters are const, but the dialogue is only passed to functions as context
+	explicit FSUDSDialogueExpressionContext(const USUDSDialogue* InDialogue) : Dialogue(const_cast<USUDSDialogue*>(InDialogue)) {}
+
+	virtual void OnExpressionVariableRequested(const FSUDSScopedVariableName& Variable) override {}
+	virtual USUDSDialogue* GetExpressionDialogue() const override { return Dialogue; }
+};
+
+/// Raises variable requests on the dialogue as an expression reads them
+struct FSUDSDialogueVariableRequester : public ISUDSExpressionVariableHandler
+{
+	USUDSDialogue* Dialogue;
+	int LineNo;
+	/// If set, the versions of variables read are recorded here
+	FSUDSConditionCacheEntry* CacheEntry = nullptr;
+	const FSUDSVariableVersions* GlobalVersions = nullptr;
+	/// Whether the result can be cached, false if it read globals we can't track
+	bool bCacheable = true;
+	/// Number of requests to skip because they were already raised
+	int NumAlreadyRequested = 0;
+
+	FSUDSDialogueVariableRequester(USUDSDialogue* InDialogue, int InLineNo) : Dialogue(InDialogue), LineNo(InLineNo) {}
+
+	virtual USUDSDialogue* GetExpressionDialogue() const override { return Dialogue; }
+
+	virtual bool ProvideExpressionVariable(const FSUDSScopedVariableName& Variable, FSUDSValue& OutValue) override
+	{
+		if (Dialogue->ProvideVariable(Variable, OutValue))
+		{
+			// Provided values have no versions to check, so anything which reads them can't be cached
+			bCacheable = false;
+			return true;
+		}
+		return false;
+	}
+
+	virtual void OnExpressionVariableRequested(const FSUDSScopedVariableName& Variable) override
 	{
-		if (P->GetClass()->ImplementsInterface(USUDSParticipant::StaticClass()))
+		if (NumAlreadyRequested > 0)
+		{
+			--NumAlreadyRequested;
+		}
+		else
+		{
+			Dialogue->RaiseVariableRequested(Variable, LineNo);
+		}
+
+		if (CacheEntry)
 		{
-			ISUDSParticipant::Execute_OnDialogueVariableRequested(P, this, VarName);
+			// Record the versions after the request, since that's what's about to be read
+			uint32 GlobalVersion = 0;
+			if (Variable.bIsGlobal)
+			{
+				if (GlobalVersions)
+				{
+					GlobalVersion = GlobalVersions->Get(Variable.ScopedName);
+				}
+				else
+				{
+					bCacheable = false;
+				}
+			}
+			CacheEntry->Reads.Add({ Variable, Dialogue->VariableVersions.Get(Variable.Name), GlobalVersion });
 		}
 	}
+};
+
+FSUDSValue USUDSDialogue::EvaluateExpression(const FSUDSExpression& Expression, int LineNo)
+{
+	FSUDSDialogueVariableRequester Requester(this, LineNo);
+	return Expression.Evaluate(VariableState, GetGlobalVariables(), &Requester);
 }
 
-void USUDSDialogue::RaiseExpressionVariablesRequested(const FSUDSExpression& Expression, int LineNo)
+void USUDSDialogue::CheckScriptReimported()
 {
-	for (auto& Var : Expression.GetVariableNames())
+	if (BaseScript && BaseScript->GetImportGeneration() != ScriptImportGeneration)
 	{
-		RaiseVariableRequested(Var, LineNo);
+		// Cache keys are indexes into the old expression pool & graph, which have been replaced
+		ConditionCache.Empty();
+		LineSoundCache.Empty();
+		WavesInRangeCache.Empty();
+		ScriptImportGeneration = BaseScript->GetImportGeneration();
 	}
 }
 
+bool USUDSDialogue::EvaluateCondition(int32 ConditionIndex, int LineNo)
+{
+	CheckScriptReimported();
+	const FSUDSExpression& Expression = BaseScript->GetExpression(ConditionIndex);
+	if (Expression.HasFunctionCalls())
+	{
+		// Functions can return different results without any variables changing, so can't be cached
+		FSUDSDialogueVariableRequester Requester(this, LineNo);
+		return Expression.EvaluateBoolean(VariableState, GetGlobalVariables(), BaseScript->GetName(), &Requester);
+	}
+
+	const FSUDSVariableVersions* GlobalVersions = InternalGetGlobalVariableVersions(this->GetWorld());
+
+	const uint32 CurrentGlobalProviderGeneration = USUDSSubsystem::GetGlobalVariableProviders().GetGeneration();
+	if (CurrentGlobalProviderGeneration != GlobalProviderGeneration)
+	{
+		// Cached conditions may read globals which are provided differently now
+		ConditionCache.Empty();
+		GlobalProviderGeneration = CurrentGlobalProviderGeneration;
+	}
+
+	// If none of the variables read last time have changed, the result can't have either
+	// Variables are still requested in the same order as they would be when evaluating, since participants may
+	// change them in response
+	int NumRequested = 0;
+	if (const FSUDSConditionCacheEntry* Cached = ConditionCache.Find(ConditionIndex))
+	{
+		// Copy because requests could re-enter and change the cache
+		const FSUDSConditionCacheEntry Entry = *Cached;
+		bool bUpToDate = true;
+		for (const auto& Read : Entry.Reads)
+		{
+			RaiseVariableRequested(Read.Variable, LineNo);
+			++NumRequested;
+			if (Read.Version != VariableVersions.Get(Read.Variable.Name) ||
+				(Read.Variable.bIsGlobal && (!GlobalVersions || Read.GlobalVersion != GlobalVersions->Get(Read.Variable.ScopedName))))
+			{
+				bUpToDate = false;
+				break;
+			}
+		}
+		if (bUpToDate)
+		{
+			++ConditionCacheHits;
+			return Entry.bResult;
+		}
+	}
+
+	++ConditionCacheMisses;
+	FSUDSConditionCacheEntry NewEntry;
+	FSUDSDialogueVariableRequester Requester(this, LineNo);
+	Requester.CacheEntry = &NewEntry;
+	Requester.GlobalVersions = GlobalVersions;
+	// Evaluation will read the same variables in the same order up to the one which changed, those were requested above
+	Requester.NumAlreadyRequested = NumRequested;
+	const bool bResult = Expression.EvaluateBoolean(VariableState, GetGlobalVariables(), BaseScript->GetName(), &Requester);
+	if (Requester.bCacheable)
+	{
+		NewEntry.bResult = bResult;
+		ConditionCache.Add(ConditionIndex, MoveTemp(NewEntry));
+	}
+	else
+	{
+		ConditionCache.Remove(ConditionIndex);
+	}
+	return bResult;
+}
+
 const TMap<FName, FSUDSValue>& USUDSDialogue::GetGlobalVariables() const
 {
 	return InternalGetGlobalVariables(this->GetWorld());
@@ -394,6 +757,7 @@ void USUDSDialogue::SetCurrentSpeakerNode(USUDSScriptNodeText* Node, bool bQuiet
 	CurrentSpeakerNode = Node;
 
 	CurrentSpeakerDisplayName = FText::GetEmpty();
+	SpeakerTextCache.bValid = false;
 	bParamNamesExtracted = false;
 	if (Node)
 	{
@@ -404,6 +768,8 @@ void USUDSDialogue::SetCurrentSpeakerNode(USUDSScriptNodeText* Node, bool bQuiet
 		CurrentSourceLineNo = 0;
 	}
 	UpdateChoices();
+	// Before raising events, so the current line's wave is on its way if it's not already loaded
+	UpdateVoiceStreaming();
 
 	if (!bQuietly)
 	{
@@ -415,38 +781,100 @@ void USUDSDialogue::SetCurrentSpeakerNode(USUDSScriptNodeText* Node, bool bQuiet
 
 }
 
-FText USUDSDialogue::ResolveParameterisedText(const TArray<FName> Params, const FTextFormat& TextFormat, int LineNo)
+FText USUDSDialogue::ResolveParameterisedText(const TArray<FSUDSScopedVariableName>& Params, const FTextFormat& TextFormat, int LineNo, FSUDSTextCacheEntry& Cache)
 {
+	// Variables are still requested every time, since participants may change them in response
+	TArray<TPair<FString, FSUDSValue>, TInlineAllocator<4>> ProvidedArgs;
 	for (const auto& P : Params)
 	{
-		RaiseVariableRequested(P, LineNo);
+		FSUDSValue Provided;
+		if (ProvideVariable(P, Provided))
+		{
+			ProvidedArgs.Emplace(P.Name.ToString(), MoveTemp(Provided));
+		}
+		else
+		{
+			RaiseVariableRequested(P, LineNo);
+		}
 	}
+
+	// Provided values aren't versioned, and neither are globals without a subsystem, so can't be cached
+	const FSUDSVariableVersions* GlobalVersions = InternalGetGlobalVariableVersions(this->GetWorld());
+	bool bCacheable = ProvidedArgs.IsEmpty();
+	TArray<uint32, TInlineAllocator<4>> Versions;
+	if (bCacheable)
+	{
+		Versions.Reserve(Params.Num());
+		for (const auto& P : Params)
+		{
+			if (P.bIsGlobal)
+			{
+				if (!GlobalVersions)
+				{
+					bCacheable = false;
+					break;
+				}
+				Versions.Add(GlobalVersions->Get(P.ScopedName));
+			}
+			else
+			{
+				Versions.Add(VariableVersions.Get(P.Name));
+			}
+		}
+	}
+	
+	const FCultureRef Locale = FInternationalization::Get().GetCurrentLocale();
+	const uint16 TextRevision = FTextLocalizationManager::Get().GetTextRevision();
+	if (bCacheable &&
+		Cache.bValid &&
+		Cache.Locale.Get() == &Locale.Get() &&
+		Cache.TextRevision == TextRevision &&
+		Cache.Versions == Versions)
+	{
+		++TextCacheHits;
+		return Cache.Text;
+	}
+	
 	// Need to make a temp arg list for compatibility
 	// Also lets us just set the ones we need to
 	FFormatNamedArguments Args;
 	GetTextFormatArgs(Params, Args);
-	return FText::Format(TextFormat, Args);
+	// Provided values take precedence over anything in variable state
+	for (const auto& Pair : ProvidedArgs)
+	{
+		Args.Add(Pair.Key, Pair.Value.ToFormatArg());
+	}
+	FText Result = FText::Format(TextFormat, Args);
+	
+	Cache.bValid = bCacheable;
+	if (bCacheable)
+	{
+		Cache.Text = Result;
+		Cache.Versions = MoveTemp(Versions);
+		Cache.Locale = Locale;
+		Cache.TextRevision = TextRevision;
+	}
+	return Result;
 	
 }
 
-void USUDSDialogue::GetTextFormatArgs(const TArray<FName>& ArgNames, FFormatNamedArguments& OutArgs) const
+void USUDSDialogue::GetTextFormatArgs(const TArray<FSUDSScopedVariableName>& ArgNames, FFormatNamedArguments& OutArgs) const
 {
-	for (auto& Name : ArgNames)
+	for (auto& Arg : ArgNames)
 	{
-		FName GlobalName;
-		if (USUDSLibrary::IsDialogueVariableGlobal(Name, GlobalName))
+		if (Arg.bIsGlobal)
 		{
 			auto& Globals = InternalGetGlobalVariables(this->GetWorld());
-			if (const FSUDSValue* Value = Globals.Find(GlobalName))
+			if (const FSUDSValue* Value = Globals.Find(Arg.ScopedName))
 			{
 				// Add to format args using name with prefix
-				OutArgs.Add(Name.ToString(), Value->ToFormatArg());
+				OutArgs.Add(Arg.Name.ToString(), Value->ToFormatArg());
 			}
 		}
-		else if (const FSUDSValue* Value = VariableState.Find(Name))
+		else if (const FSUDSValue* Value = VariableState.Find(Arg.Name))
 		{
 			// Use the operator conversion
-			OutArgs.Add(Name.ToString(), Value->ToFormatArg());
+			OutArgs.Add(Arg.Name.ToString(), Value->ToFormatArg());
 		}
 	}
 }
@@ -457,9 +885,11 @@ FText USUDSDialogue::GetText()
 	{
 		if (CurrentSpeakerNode->HasParameters())
 		{
-			return ResolveParameterisedText(CurrentSpeakerNode->GetParameterNames(),
+			FSUDSDialogueStepScope Step(this);
+			return ResolveParameterisedText(CurrentSpeakerNode->GetParameterVariables(),
 			                                CurrentSpeakerNode->GetTextFormat(),
-			                                CurrentSpeakerNode->GetSourceLineNo());
+			                                CurrentSpeakerNode->GetSourceLineNo(),
+			                                SpeakerTextCache);
 		}
 		else
 		{
@@ -471,19 +901,46 @@ FText USUDSDialogue::GetText()
 
 UDialogueWave* USUDSDialogue::GetWave() const
 {
-	if (CurrentSpeakerNode)
+	return CurrentSpeakerNode ? CurrentSpeakerNode->GetWave() : nullptr;
+}
+
+UDialogueWave* USUDSDialogue::LoadCurrentWave()
+{
+	if (!CurrentSpeakerNode || !CurrentSpeakerNode->HasWave())
+	{
+		return nullptr;
+	}
+	if (auto Wave = CurrentSpeakerNode->GetWave())
 	{
-		return CurrentSpeakerNode->GetWave();
+		return Wave;
 	}
 
-	return nullptr;
+	// Streaming hasn't caught up, e.g. the wave is needed as soon as the line is raised
+	const TSoftObjectPtr<UDialogueWave>& SoftWave = CurrentSpeakerNode->GetSoftWave();
+	TSharedPtr<FStreamableHandle>& Handle = StreamedWaves.FindOrAdd(SoftWave.ToSoftObjectPath());
+	if (Handle.IsValid())
+	{
+		Handle->WaitUntilComplete();
+	}
+	else
+	{
+		Handle = GetSUDSStreamableManager().RequestSyncLoad(SoftWave.ToSoftObjectPath());
+	}
+	++VoiceSyncLoads;
+	UDialogueWave* Wave = SoftWave.Get();
+	if (!Wave)
+	{
+		UE_LOG(LogSUDSDialogue, Error, TEXT("%s: failed to load wave %s for line %d"),
+		       *BaseScript->GetName(), *SoftWave.ToString(), CurrentSourceLineNo);
+	}
+	return Wave;
 }
 
 bool USUDSDialogue::IsCurrentLineVoiced() const
 {
 	if (CurrentSpeakerNode)
 	{
-		return IsValid(CurrentSpeakerNode->GetWave());
+		return CurrentSpeakerNode->HasWave();
 	}
 
 	return false;
@@ -504,9 +961,8 @@ FText USUDSDialogue::GetSpeakerDisplayName() const
 		// Derive speaker display name
 		// Is just a special variable "SpeakerName.SpeakerID"
 		// or just the SpeakerID if none specified
-		static const FString SpeakerIDPrefix = "SpeakerName.";
-		FName Key(SpeakerIDPrefix + GetSpeakerID());
-		if (auto Arg = VariableState.Find(Key))
+		const FSUDSSpeakerInfo* Info = GetCurrentSpeakerInfo();
+		if (auto Arg = Info ? VariableState.Find(Info->DisplayNameKey) : nullptr)
 		{
 			if (Arg->GetType() == ESUDSValueType::Text)
 			{
@@ -518,7 +974,7 @@ FText USUDSDialogue::GetSpeakerDisplayName() const
 				       Error,
 				       TEXT("Error in %s: %s was set to a value that was not text, cannot use"),
 				       *BaseScript->GetName(),
-				       *Key.ToString());
+				       *Info->DisplayNameKey.ToString());
 			}
 		}
 		if (CurrentSpeakerDisplayName.IsEmpty())
@@ -530,15 +986,21 @@ FText USUDSDialogue::GetSpeakerDisplayName() const
 	return CurrentSpeakerDisplayName;
 }
 
-UDialogueVoice* USUDSDialogue::GetSpeakerVoice() const
+const FSUDSSpeakerInfo* USUDSDialogue::GetCurrentSpeakerInfo() const
 {
 	if (CurrentSpeakerNode)
 	{
-		return GetVoice(CurrentSpeakerNode->GetSpeakerID());
+		return BaseScript->GetSpeakerInfo(CurrentSpeakerNode->GetSpeakerIndex());
 	}
 	return nullptr;
 }
 
+UDialogueVoice* USUDSDialogue::GetSpeakerVoice() const
+{
+	const FSUDSSpeakerInfo* Info = GetCurrentSpeakerInfo();
+	return Info ? Info->Voice : nullptr;
+}
+
 UDialogueVoice* USUDSDialogue::GetVoice(FString Name) const
 {
 	return BaseScript->GetSpeakerVoice(Name);
@@ -546,58 +1008,204 @@ UDialogueVoice* USUDSDialogue::GetVoice(FString Name) const
 
 UDialogueVoice* USUDSDialogue::GetTargetVoice() const
 {
-	if (CurrentSpeakerNode)
+	// Assume that target is the first party that's NOT speaking
+	if (const FSUDSSpeakerInfo* Info = GetCurrentSpeakerInfo())
 	{
-		// Assume that target is the first party that's NOT speaking
-		for (auto& Name : BaseScript->GetSpeakers())
+		if (const FSUDSSpeakerInfo* Target = BaseScript->GetSpeakerInfo(Info->DefaultTargetIndex))
 		{
-			if (Name != CurrentSpeakerNode->GetSpeakerID())
-			{
-				return BaseScript->GetSpeakerVoice(Name);
-			}
+			return Target->Voice;
 		}
 	}
 	return nullptr;
 	
 }
 
-USoundBase* USUDSDialogue::GetSoundForCurrentLine(bool bAllowAnyTarget) const
+USoundBase* USUDSDialogue::GetSoundForCurrentLine(bool bAllowAnyTarget)
 {
 	// UDialogueWave's contexts have both speakers and targets, but the GetWaveFromContext method is too restrictive
 	// Instead we'll search the contexts ourselves and be more fuzzy
-	if (auto Wave = GetWave())
+	auto Wave = GetWave();
+	if (!Wave && IsCurrentLineVoiced())
 	{
+		// Streaming hasn't caught up, load it now if that's allowed
+		if (bLoadCurrentWaveIfNotStreamed)
+		{
+			Wave = LoadCurrentWave();
+		}
+		else
+		{
+			UE_LOG(LogSUDSDialogue, Verbose, TEXT("%s: wave for line %d is not loaded yet"),
+			       *BaseScript->GetName(), CurrentSourceLineNo);
+		}
+	}
+	if (!Wave)
+	{
+		return nullptr;
+	}
+
+	if (BaseScript->GetVoiceGeneration() != ScriptVoiceGeneration)
+	{
+		// Matches depend on the speaker & target voices, which have changed
+		LineSoundCache.Empty();
+		ScriptVoiceGeneration = BaseScript->GetVoiceGeneration();
+	}
+
+	// Speaker & target are fixed per line, so this only has to be done once per line
+	const int32 LineKey = CurrentSpeakerNode->GetGraphIndex();
+	const FSUDSLineSound* LineSound = LineSoundCache.Find(LineKey);
+	if (!LineSound || LineSound->TargetMatch.IsStale() || LineSound->SpeakerMatch.IsStale())
+	{
+		FSUDSLineSound NewLineSound;
 		auto SpeakerVoice = GetSpeakerVoice();
 		auto TargetVoice = GetTargetVoice();
 		for (auto& Ctx : Wave->ContextMappings)
 		{
-			// Match specific target voice first, and unspecified targets
 			if (Ctx.Context.Speaker == SpeakerVoice)
 			{
+				// Need to use the proxy according to DialogueWave
+				if (!NewLineSound.SpeakerMatch.IsValid())
+				{
+					NewLineSound.SpeakerMatch = Ctx.Proxy;
+				}
+				// Match specific target voice first
 				if (Ctx.Context.Targets.Contains(TargetVoice))
 				{
-					// Need to use the proxy according to DialogueWave
-					return Ctx.Proxy;
+					NewLineSound.TargetMatch = Ctx.Proxy;
+					break;
 				}
 			}
 		}
-		// If we got here, match more leniently
-		if (bAllowAnyTarget)
+		if (!NewLineSound.SpeakerMatch.IsValid())
 		{
-			for (auto& Ctx : Wave->ContextMappings)
+			// Nothing to cache, don't remember the miss in case the wave or voices are fixed up later
+			LineSoundCache.Remove(LineKey);
+			return nullptr;
+		}
+		LineSound = &LineSoundCache.Add(LineKey, NewLineSound);
+	}
+
+	if (USoundBase* Sound = LineSound->TargetMatch.Get())
+	{
+		return Sound;
+	}
+	// If we got here, match more leniently
+	return bAllowAnyTarget ? LineSound->SpeakerMatch.Get() : nullptr;
+}
+
+void USUDSDialogue::SetVoiceStreaming(int LookAheadLines, bool bInLoadCurrentWaveIfNotStreamed)
+{
+	if (VoiceLookAheadLines != FMath::Max(0, LookAheadLines))
+	{
+		VoiceLookAheadLines = FMath::Max(0, LookAheadLines);
+		WavesInRangeCache.Empty();
+	}
+	bLoadCurrentWaveIfNotStreamed = bInLoadCurrentWaveIfNotStreamed;
+	UpdateVoiceStreaming();
+}
+
+void USUDSDialogue::UpdateVoiceStreaming()
+{
+	if (!CurrentSpeakerNode || !BaseScript || !BaseScript->HasVoicedLines())
+	{
+		ReleaseStreamedWaves();
+		return;
+	}
+
+	CheckScriptReimported();
+	const TArray<FSoftObjectPath>& InRange = GetWavesInRange();
+
+	// Release anything out of range, then request anything new
+	for (auto It = StreamedWaves.CreateIterator(); It; ++It)
+	{
+		if (!InRange.Contains(It.Key()))
+		{
+			if (It.Value().IsValid())
 			{
-				// Match specific target voice first, and unspecified targets
-				if (Ctx.Context.Speaker == SpeakerVoice)
+				It.Value()->ReleaseHandle();
+			}
+			It.RemoveCurrent();
+		}
+	}
+	for (const auto& Path : InRange)
+	{
+		TSharedPtr<FStreamableHandle>& Handle = StreamedWaves.FindOrAdd(Path);
+		if (!Handle.IsValid())
+		{
+			Handle = GetSUDSStreamableManager().RequestAsyncLoad(Path);
+		}
+	}
+}
+
+const TArray<FSoftObjectPath>& USUDSDialogue::GetWavesInRange()
+{
+	// Lines reachable from here only differ by where returns lead, which is decided by the gosub stack
+	TArray<int32, TInlineAllocator<8>> GosubStack;
+	for (const auto Gosub : GosubReturnStack)
+	{
+		GosubStack.Add(Gosub ? Gosub->GetGraphIndex() : INDEX_NONE);
+	}
+	TArray<FSUDSWavesInRange>& Entries = WavesInRangeCache.FindOrAdd(CurrentSpeakerNode->GetGraphIndex());
+	for (const auto& Entry : Entries)
+	{
+		if (Algo::Compare(Entry.GosubStack, GosubStack))
+		{
+			return Entry.Waves;
+		}
+	}
+
+	// Find the waves of all lines within range of the current one, across all paths
+	FSUDSWavesInRange& Entry = Entries.AddDefaulted_GetRef();
+	Entry.GosubStack.Append(GosubStack);
+	WalkReachableSpeakerLines(VoiceLookAheadLines, [&Entry](USUDSScriptNodeText* Line, int32 Lines)
+	{
+		if (Line->HasWave())
+		{
+			Entry.Waves.AddUnique(Line->GetSoftWave().ToSoftObjectPath());
+		}
+	});
+	return Entry.Waves;
+}
+
+void USUDSDialogue::ReleaseStreamedWaves()
+{
+	for (auto& Pair : StreamedWaves)
+	{
+		if (Pair.Value.IsValid())
+		{
+			Pair.Value->ReleaseHandle();
+		}
+	}
+	StreamedWaves.Empty();
+}
+
+void USUDSDialogue::GetVoiceStreamingStats(int& OutResidentWaves,
+                                           int& OutPendingWaves,
+                                           int64& OutResidentBytes,
+                                           int& OutSyncLoads) const
+{
+	OutResidentWaves = OutPendingWaves = 0;
+	OutResidentBytes = 0;
+	OutSyncLoads = VoiceSyncLoads;
+	for (const auto& Pair : StreamedWaves)
+	{
+		if (!Pair.Value.IsValid() || !Pair.Value->HasLoadCompleted())
+		{
+			++OutPendingWaves;
+			continue;
+		}
+		if (auto Wave = Cast<UDialogueWave>(Pair.Value->GetLoadedAsset()))
+		{
+			++OutResidentWaves;
+			OutResidentBytes += Wave->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+			for (const auto& Ctx : Wave->ContextMappings)
+			{
+				if (Ctx.SoundWave)
 				{
-					// Need to use the proxy according to DialogueWave
-					return Ctx.Proxy;
+					OutResidentBytes += Ctx.SoundWave->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
 				}
 			}
-			
 		}
 	}
-
-	return nullptr;
 }
 
 USoundConcurrency* USUDSDialogue::GetVoiceSoundConcurrency() const
@@ -694,85 +1302,237 @@ bool USUDSDialogue::IsChoiceOrTextNode(ESUDSScriptNodeType Type)
 	return Type == ESUDSScriptNodeType::Text || Type == ESUDSScriptNodeType::Choice;
 }
 
-const USUDSScriptNode* USUDSDialogue::WalkToNextChoiceNode(USUDSScriptNode* FromNode, bool bExecute)
+const USUDSScriptNode* USUDSDialogue::RunUntilNextChoiceNode(USUDSScriptNode* FromNode)
 {
-	if (FromNode && FromNode->GetEdgeCount() == 1)
+	if (!FromNode || FromNode->GetEdgeCount() != 1)
+		return nullptr;
+
+	// Walk to the next choice or text node without running anything yet, since if we don't find a choice, the nodes
+	// in between will be run when the dialogue proceeds instead. Nodes with side effects are recorded to run once we
+	// know there's a choice. Selects are only evaluated here, once.
+	// Returns pop from our own pushes first, then read back through the real gosub stack, so it never has to be copied
+	TArray<USUDSScriptNode*, TInlineAllocator<8>> NodesToRun;
+	TArray<USUDSScriptNodeGosub*, TInlineAllocator<4>> PushedGosubs;
+	int32 NumPoppedGosubs = 0;
+	const FSUDSScriptGraph& Graph = BaseScript->GetGraph();
+
+	USUDSScriptNode* NextNode = GetNextNode(FromNode);
+	while (NextNode && !IsChoiceOrTextNode(NextNode->GetNodeType()))
 	{
-		const auto NextNode = GetNextNode(FromNode);
-		TArray<TObjectPtr<USUDSScriptNodeGosub>> TempGosubStack;
-		if (!bExecute)
-		{
-			// Make a copy of the gosub stack so we can safely explore gosubs
-			TempGosubStack.Append(GosubReturnStack);
-		}
-		
-		const auto ResultNode = RecurseWalkToNextChoiceOrTextNode(NextNode, bExecute, bExecute ? GosubReturnStack : TempGosubStack);
-		if (ResultNode && ResultNode->GetNodeType() == ESUDSScriptNodeType::Choice)
+		switch (NextNode->GetNodeType())
 		{
-			return ResultNode;
+		case ESUDSScriptNodeType::Gosub:
+			// We need to go into gosubs, since to find the choice we may have to go into them and potentially out again
+			if (USUDSScriptNode* SubNode = Graph.GetGosubTarget(NextNode->GetGraphIndex()))
+			{
+				PushedGosubs.Add(CastChecked<USUDSScriptNodeGosub>(NextNode));
+				NodesToRun.Add(NextNode);
+				NextNode = SubNode;
+				continue;
+			}
+			break;
+		case ESUDSScriptNodeType::Return:
+			{
+				// We try to find the next choice node after the gosub, which temporarily redirected
+				USUDSScriptNodeGosub* GosubNode = nullptr;
+				if (PushedGosubs.Num() > 0)
+				{
+					GosubNode = PushedGosubs.Pop();
+				}
+				else if (NumPoppedGosubs < GosubReturnStack.Num())
+				{
+					GosubNode = GosubReturnStack[GosubReturnStack.Num() - 1 - NumPoppedGosubs];
+					++NumPoppedGosubs;
+				}
+				if (!GosubNode)
+				{
+					return nullptr;
+				}
+				NodesToRun.Add(NextNode);
+				NextNode = GetNextNode(GosubNode);
+				continue;
+			}
+		case ESUDSScriptNodeType::SetVariable:
+		case ESUDSScriptNodeType::Event:
+			NodesToRun.Add(NextNode);
+			break;
+		default:
+			break;
 		}
+		NextNode = GetNextNode(NextNode);
 	}
-	return nullptr;
+
+	if (!NextNode || NextNode->GetNodeType() != ESUDSScriptNodeType::Choice)
+	{
+		return nullptr;
+	}
+
+	// Found a choice, so now run the nodes between the text and the choice, in order. These can be set nodes directly
+	// under the text and before the first choice, which get run for all choices, and gosubs / returns which update
+	// the real stack the same way we tracked it above
+	for (USUDSScriptNode* Node : NodesToRun)
+	{
+		RunNode(Node);
+	}
+	return NextNode;
 }
 
-USUDSScriptNode* USUDSDialogue::RecurseWalkToNextChoiceOrTextNode(USUDSScriptNode* Node, bool bExecute, TArray<TObjectPtr<USUDSScriptNodeGosub>>& LocalGosubStack)
+void USUDSDialogue::WalkReachableSpeakerLines(int32 MaxLines,
+                                             TFunctionRef<void(USUDSScriptNodeText*, int32)> OnLine) const
 {
-	auto NextNode = Node;
-	while (NextNode && !IsChoiceOrTextNode(NextNode->GetNodeType()))
+	if (!CurrentSpeakerNode || !BaseScript)
+		return;
+
+	const FSUDSScriptGraph& Graph = BaseScript->GetGraph();
+	const int32 StartIndex = CurrentSpeakerNode->GetGraphIndex();
+	if (!Graph.IsValidNode(StartIndex))
+		return;
+
+	// Like RunUntilNextChoiceNode, but following every edge of selects & choices rather than evaluating them, and
+	// without running anything. Each path tracks the gosubs it has entered, and how far it has returned back through
+	// the real gosub stack, so that returns lead where they would when running. A line can be reached along paths of
+	// different lengths, so a node is only visited again in the same gosub context if it's reached in fewer lines
+	struct FWalkState
+	{
+		int32 NodeIndex;
+		int32 Lines;
+		int32 NumPoppedGosubs;
+		TArray<int32, TInlineAllocator<4>> PushedGosubs;
+	};
+	// Gosubs which recurse without any lines in between would never stop
+	constexpr int32 MaxPushedGosubs = 32;
+	// The gosub contexts each node has been visited in, and the fewest lines it was reached in for each
+	struct FVisit
+	{
+		int32 Lines;
+		int32 NumPoppedGosubs;
+		TArray<int32, TInlineAllocator<4>> PushedGosubs;
+	};
+	TMap<int32, TArray<FVisit, TInlineAllocator<2>>> Visited;
+	TArray<FWalkState> Pending;
+
+	auto Visit = [&](FWalkState&& State)
+	{
+		if (!Graph.IsValidNode(State.NodeIndex))
+			return;
+
+		if (Graph.GetNode(State.NodeIndex).Type == ESUDSScriptNodeType::Text)
+		{
+			++State.Lines;
+		}
+		if (State.Lines > MaxLines)
+			return;
+
+		auto& NodeVisits = Visited.FindOrAdd(State.NodeIndex);
+		FVisit* PrevVisit = NodeVisits.FindByPredicate([&State](const FVisit& Visit)
+		{
+			return Visit.NumPoppedGosubs == State.NumPoppedGosubs && Visit.PushedGosubs == State.PushedGosubs;
+		});
+		if (!PrevVisit)
+		{
+			NodeVisits.Add(FVisit { State.Lines, State.NumPoppedGosubs, State.PushedGosubs });
+		}
+		else if (State.Lines < PrevVisit->Lines)
+		{
+			PrevVisit->Lines = State.Lines;
+		}
+		else
+		{
+			return;
+		}
+		Pending.Add(MoveTemp(State));
+	};
+	auto VisitEdges = [&](const FWalkState& From, int32 NodeIndex)
+	{
+		for (const auto& Edge : Graph.GetEdges(NodeIndex))
+		{
+			Visit(FWalkState { Edge.TargetNode, From.Lines, From.NumPoppedGosubs, From.PushedGosubs });
+		}
+	};
+
+	Pending.Add(FWalkState { StartIndex, 0, 0 });
+	while (Pending.Num() > 0)
 	{
-		// Special case gosub/return in non-execute mode, since only RunNode will explore them
-		if (!bExecute)
+		const FWalkState State = Pending.Pop();
+		switch (Graph.GetNode(State.NodeIndex).Type)
 		{
-			if (NextNode->GetNodeType() == ESUDSScriptNodeType::Gosub)
+		case ESUDSScriptNodeType::Text:
+			if (auto Line = Cast<USUDSScriptNodeText>(Graph.GetNodeObject(State.NodeIndex)))
 			{
-				// We need to special case Gosubs, since to find the choice we have to go into them and potentially out again
-				if (USUDSScriptNodeGosub* GosubNode = Cast<USUDSScriptNodeGosub>(NextNode))
+				OnLine(Line, State.Lines);
+			}
+			VisitEdges(State, State.NodeIndex);
+			break;
+		case ESUDSScriptNodeType::Gosub:
+			{
+				const int32 SubIndex = Graph.GetNode(State.NodeIndex).Payload;
+				if (Graph.IsValidNode(SubIndex))
 				{
-					if (auto SubNode = BaseScript->GetNodeByLabel(GosubNode->GetLabelName()))
+					if (State.PushedGosubs.Num() < MaxPushedGosubs)
 					{
-						LocalGosubStack.Add(GosubNode);
-						NextNode = RecurseWalkToNextChoiceOrTextNode(SubNode, bExecute, LocalGosubStack);
-						continue;
+						FWalkState Sub { SubIndex, State.Lines, State.NumPoppedGosubs, State.PushedGosubs };
+						Sub.PushedGosubs.Add(State.NodeIndex);
+						Visit(MoveTemp(Sub));
 					}
 				}
-						
+				else
+				{
+					VisitEdges(State, State.NodeIndex);
+				}
+				break;
 			}
-			else if (NextNode->GetNodeType() == ESUDSScriptNodeType::Return)
+		case ESUDSScriptNodeType::Return:
 			{
-				if (LocalGosubStack.Num() > 0)
+				FWalkState Returned = State;
+				int32 GosubIndex = INDEX_NONE;
+				if (Returned.PushedGosubs.Num() > 0)
 				{
-					// We try to find the next choice node after the gosub, which temporarily redirected
-					const auto GoSubNode = LocalGosubStack.Pop();
-					NextNode = RecurseWalkToNextChoiceOrTextNode(GetNextNode(GoSubNode), bExecute, LocalGosubStack);
-					continue;
+					GosubIndex = Returned.PushedGosubs.Pop();
 				}
-				else
+				else if (Returned.NumPoppedGosubs < GosubReturnStack.Num())
 				{
-					return nullptr;
+					const USUDSScriptNodeGosub* Gosub = GosubReturnStack[GosubReturnStack.Num() - 1 - Returned.NumPoppedGosubs];
+					GosubIndex = Gosub ? Gosub->GetGraphIndex() : INDEX_NONE;
+					++Returned.NumPoppedGosubs;
+				}
+				if (GosubIndex != INDEX_NONE)
+				{
+					VisitEdges(Returned, GosubIndex);
 				}
+				break;
 			}
-		}
-		
-		if (bExecute)
-		{
-			NextNode = RunNode(NextNode);
-		}
-		else
-		{
-			NextNode = GetNextNode(NextNode);
+		default:
+			VisitEdges(State, State.NodeIndex);
+			break;
 		}
 	}
-
-	return NextNode;
 }
 
-const USUDSScriptNode* USUDSDialogue::RunUntilNextChoiceNode(USUDSScriptNode* FromNode)
-{
-	return WalkToNextChoiceNode(FromNode, true);
-}
-const USUDSScriptNode* USUDSDialogue::FindNextChoiceNode(USUDSScriptNode* FromNode)
+void USUDSDialogue::GetReachableSpeakerLines(int MaxDepth,
+                                             TArray<USUDSScriptNodeText*>& OutLines,
+                                             TArray<FString>& OutSpeakerIDs) const
 {
-	return WalkToNextChoiceNode(FromNode, false);
+	OutLines.Reset();
+	OutSpeakerIDs.Reset();
+
+	TMap<USUDSScriptNodeText*, int32> LineDepths;
+	WalkReachableSpeakerLines(MaxDepth, [&](USUDSScriptNodeText* Line, int32 Lines)
+	{
+		// Not the current line, unless it can be reached again
+		if (Lines > 0)
+		{
+			int32& Depth = LineDepths.FindOrAdd(Line, Lines);
+			Depth = FMath::Min(Depth, Lines);
+		}
+	});
+
+	// Nearest lines first
+	LineDepths.ValueStableSort(TLess<int32>());
+	for (const auto& Pair : LineDepths)
+	{
+		OutLines.Add(Pair.Key);
+		OutSpeakerIDs.Add(Pair.Key->GetSpeakerID());
+	}
 }
 
 const TArray<FSUDSScriptEdge>& USUDSDialogue::GetChoices() const
@@ -792,28 +1552,35 @@ void USUDSDialogue::RecurseAppendChoices(const USUDSScriptNode* Node, TArray<FSU
 		return;
 	}
 	
-	for (auto& Edge : Node->GetEdges())
+	const FSUDSScriptGraph& Graph = BaseScript->GetGraph();
+	const TArrayView<const FSUDSScriptGraphEdge> Edges = Graph.GetEdges(Node->GetGraphIndex());
+	for (int32 i = 0; i < Edges.Num(); ++i)
 	{
-		switch (Edge.GetType())
+		const FSUDSScriptGraphEdge& Edge = Edges[i];
+		switch (Edge.Type)
 		{
 		case ESUDSEdgeType::Decision:
-			OutChoices.Add(Edge);
+			// Choices need the full edge for text etc, graph edges are in the same order as the node's
+			// The copy mustn't point into the expression pool, which a reimport can replace while it's held
+			OutChoices.Add_GetRef(Node->GetEdges()[i]).UnbindCondition();
 			break;
 		case ESUDSEdgeType::Condition:
 			// Conditional edges are under selects
-			if (Edge.GetCondition().IsValid())
 			{
-				RaiseExpressionVariablesRequested(Edge.GetCondition(), Edge.GetSourceLineNo());
-				if (Edge.GetCondition().EvaluateBoolean(VariableState, GetGlobalVariables(), BaseScript->GetName()))
+				const FSUDSExpression& Condition = BaseScript->GetExpression(Edge.ConditionIndex);
+				if (Condition.IsValid())
 				{
-					RecurseAppendChoices(Edge.GetTargetNode().Get(), OutChoices);
-					// When we choose a path on a select, we don't check the other paths, we can only go down one
-					return;
+					if (EvaluateCondition(Edge.ConditionIndex, Edge.SourceLineNo))
+					{
+						RecurseAppendChoices(Graph.GetNodeObject(Edge.TargetNode), OutChoices);
+						// When we choose a path on a select, we don't check the other paths, we can only go down one
+						return;
+					}
 				}
 			}
 			break;
 		case ESUDSEdgeType::Chained:
-			RecurseAppendChoices(Edge.GetTargetNode().Get(), OutChoices);
+			RecurseAppendChoices(Graph.GetNodeObject(Edge.TargetNode), OutChoices);
 			break;
 		default:
 		case ESUDSEdgeType::Continue:
@@ -826,7 +1593,9 @@ void USUDSDialogue::RecurseAppendChoices(const USUDSScriptNode* Node, TArray<FSU
 
 void USUDSDialogue::UpdateChoices()
 {
+	CheckScriptReimported();
 	CurrentChoices.Reset();
+	ChoiceTextCache.Reset();
 	CurrentRootChoiceNode = nullptr;
 	if (CurrentSpeakerNode)
 	{
@@ -836,14 +1605,10 @@ void USUDSDialogue::UpdateChoices()
 			GosubReturnStack.Num() > 0)
 		{
 			// We MIGHT have a choice; conditionals can result in HasChoices() being true but the current state not actually
-			// taking us to a choice path
-			CurrentRootChoiceNode = FindNextChoiceNode(CurrentSpeakerNode);
+			// taking us to a choice path. This only runs nodes on the way if there is a choice
+			CurrentRootChoiceNode = RunUntilNextChoiceNode(CurrentSpeakerNode);
 			if (CurrentRootChoiceNode)
 			{
-				// Run any e.g. set nodes between text and choice
-				// These can be set nodes directly under the text and before the first choice, which get run for all choices
-				RunUntilNextChoiceNode(CurrentSpeakerNode);
-
 				// Once we've found & run up to the root choice, there can be potentially a tree of mixed choice/select nodes
 				// for supporting conditional choices
 				RecurseAppendChoices(CurrentRootChoiceNode, CurrentChoices);
@@ -856,7 +1621,7 @@ void USUDSDialogue::UpdateChoices()
 			{
 				// Simple no-choice progression
 				// May occur if HasChoices was true but in current state no choice was found
-				CurrentChoices.Add(*Edge);
+				CurrentChoices.Add_GetRef(*Edge).UnbindCondition();
 			}			
 		}
 	}
@@ -881,7 +1646,12 @@ FText USUDSDialogue::GetChoiceText(int Index)
 		auto& Choice = CurrentChoices[Index];
 		if (Choice.HasParameters())
 		{
-			return ResolveParameterisedText(Choice.GetParameterNames(), Choice.GetTextFormat(), Choice.GetSourceLineNo());
+			FSUDSDialogueStepScope Step(this);
+			if (ChoiceTextCache.Num() != CurrentChoices.Num())
+			{
+				ChoiceTextCache.SetNum(CurrentChoices.Num());
+			}
+			return ResolveParameterisedText(Choice.GetParameterVariables(), Choice.GetTextFormat(), Choice.GetSourceLineNo(), ChoiceTextCache[Index]);
 		}
 		else
 		{
@@ -923,6 +1693,7 @@ bool USUDSDialogue::Choose(int Index)
 {
 	if (CurrentChoices.IsValidIndex(Index))
 	{
+		FSUDSDialogueStepScope Step(this);
 		// ONLY run to choice node if there is one!
 		// This method is called for Continue() too, which has no choice node
 		if (CurrentNodeHasChoices())
@@ -938,7 +1709,7 @@ bool USUDSDialogue::Choose(int Index)
 			RaiseProceeding();
 		}
 		// Then choose path
-		RunUntilNextSpeakerNodeOrEnd(CurrentChoices[Index].GetTargetNode().Get(), true);
+		RunUntilNextSpeakerNodeOrEnd(BaseScript->GetGraph().GetNodeObject(CurrentChoices[Index].GetTargetNodeIndex()), true);
 		return !IsEnded();
 	}
 	else
@@ -960,7 +1731,7 @@ bool USUDSDialogue::IsEnded() const
 
 bool USUDSDialogue::IsFinalLine() const
 {
-	return CurrentSpeakerNode && CurrentChoices.Num() == 1 && CurrentChoices[0].GetTargetNode() == nullptr;
+	return CurrentSpeakerNode && CurrentChoices.Num() == 1 && CurrentChoices[0].GetTargetNodeIndex() == INDEX_NONE;
 }
 
 void USUDSDialogue::End(bool bQuietly)
@@ -1008,6 +1779,10 @@ void USUDSDialogue::RestoreSavedState(const FSUDSDialogueState& State)
 	// Re-run init to ensure header state is initialised then merge; important for it script is altered since state saved
 	InitVariables();
 	VariableState.Append(State.GetVariables());
+	for (const auto& Pair : State.GetVariables())
+	{
+		VariableVersions.Bump(Pair.Key);
+	}
 	ChoicesTaken.Empty();
 	ChoicesTaken.Append(State.GetChoicesTaken());
 	GosubReturnStack.Empty();
@@ -1036,6 +1811,7 @@ void USUDSDialogue::RestoreSavedState(const FSUDSDialogueState& State)
 
 void USUDSDialogue::Restart(bool bResetState, FName StartLabel, bool bReRunHeader)
 {
+	FSUDSDialogueStepScope Step(this);
 	if (bResetState)
 	{
 		ResetState();
@@ -1106,14 +1882,12 @@ TSet<FName> USUDSDialogue::GetParametersInUse()
 
 void USUDSDialogue::RaiseStarting(FName StartLabel)
 {
-	for (const auto& P : Participants)
-	{
-		if (P->GetClass()->ImplementsInterface(USUDSParticipant::StaticClass()))
-		{
-			ISUDSParticipant::Execute_OnDialogueStarting(P, this, StartLabel);
-		}
-	}
-	OnStarting.Broadcast(this, StartLabel);
+	DispatchToParticipants(ParticipantDispatch, FSUDSParticipantDispatch::Starting,
+		[&](ISUDSParticipant* P) { P->OnDialogueStarting_Implementation(this, StartLabel); },
+		[&](UObject* P) { ISUDSParticipant::Execute_OnDialogueStarting(P, this, StartLabel); });
+	OnStartingNative.Broadcast(this, StartLabel);
+	if (OnStarting.IsBound())
+		OnStarting.Broadcast(this, StartLabel);
 #if WITH_EDITOR
 	InternalOnStarting.ExecuteIfBound(this, StartLabel);
 #endif
@@ -1121,14 +1895,12 @@ void USUDSDialogue::RaiseStarting(FName StartLabel)
 
 void USUDSDialogue::RaiseFinished()
 {
-	for (const auto& P : Participants)
-	{
-		if (P->GetClass()->ImplementsInterface(USUDSParticipant::StaticClass()))
-		{
-			ISUDSParticipant::Execute_OnDialogueFinished(P, this);
-		}
-	}
-	OnFinished.Broadcast(this);
+	DispatchToParticipants(ParticipantDispatch, FSUDSParticipantDispatch::Finished,
+		[&](ISUDSParticipant* P) { P->OnDialogueFinished_Implementation(this); },
+		[&](UObject* P) { ISUDSParticipant::Execute_OnDialogueFinished(P, this); });
+	OnFinishedNative.Broadcast(this);
+	if (OnFinished.IsBound())
+		OnFinished.Broadcast(this);
 #if WITH_EDITOR
 	InternalOnFinished.ExecuteIfBound(this);
 #endif
@@ -1137,16 +1909,14 @@ void USUDSDialogue::RaiseFinished()
 
 void USUDSDialogue::RaiseNewSpeakerLine()
 {
-	for (const auto& P : Participants)
-	{
-		if (P->GetClass()->ImplementsInterface(USUDSParticipant::StaticClass()))
-		{
-			ISUDSParticipant::Execute_OnDialogueSpeakerLine(P, this);
-		}
-	}
+	DispatchToParticipants(ParticipantDispatch, FSUDSParticipantDispatch::SpeakerLine,
+		[&](ISUDSParticipant* P) { P->OnDialogueSpeakerLine_Implementation(this); },
+		[&](UObject* P) { ISUDSParticipant::Execute_OnDialogueSpeakerLine(P, this); });
 	
 	// Event listeners get it after
-	OnSpeakerLine.Broadcast(this);
+	OnSpeakerLineNative.Broadcast(this);
+	if (OnSpeakerLine.IsBound())
+		OnSpeakerLine.Broadcast(this);
 #if WITH_EDITOR
 	InternalOnSpeakerLine.ExecuteIfBound(this, GetCurrentSourceLine());
 #endif
@@ -1154,15 +1924,13 @@ void USUDSDialogue::RaiseNewSpeakerLine()
 
 void USUDSDialogue::RaiseChoiceMade(int Index, int LineNo)
 {
-	for (const auto& P : Participants)
-	{
-		if (P->GetClass()->ImplementsInterface(USUDSParticipant::StaticClass()))
-		{
-			ISUDSParticipant::Execute_OnDialogueChoiceMade(P, this, Index);
-		}
-	}
+	DispatchToParticipants(ParticipantDispatch, FSUDSParticipantDispatch::ChoiceMade,
+		[&](ISUDSParticipant* P) { P->OnDialogueChoiceMade_Implementation(this, Index); },
+		[&](UObject* P) { ISUDSParticipant::Execute_OnDialogueChoiceMade(P, this, Index); });
 	// Event listeners get it after
-	OnChoice.Broadcast(this, Index);
+	OnChoiceNative.Broadcast(this, Index);
+	if (OnChoice.IsBound())
+		OnChoice.Broadcast(this, Index);
 #if WITH_EDITOR
 	InternalOnChoice.ExecuteIfBound(this, Index, LineNo);
 #endif
@@ -1170,15 +1938,13 @@ void USUDSDialogue::RaiseChoiceMade(int Index, int LineNo)
 
 void USUDSDialogue::RaiseProceeding()
 {
-	for (const auto& P : Participants)
-	{
-		if (P->GetClass()->ImplementsInterface(USUDSParticipant::StaticClass()))
-		{
-			ISUDSParticipant::Execute_OnDialogueProceeding(P, this);
-		}
-	}
+	DispatchToParticipants(ParticipantDispatch, FSUDSParticipantDispatch::Proceeding,
+		[&](ISUDSParticipant* P) { P->OnDialogueProceeding_Implementation(this); },
+		[&](UObject* P) { ISUDSParticipant::Execute_OnDialogueProceeding(P, this); });
 	// Event listeners get it after
-	OnProceeding.Broadcast(this);
+	OnProceedingNative.Broadcast(this);
+	if (OnProceeding.IsBound())
+		OnProceeding.Broadcast(this);
 #if WITH_EDITOR
 	InternalOnProceeding.ExecuteIfBound(this);
 #endif
@@ -1322,6 +2088,9 @@ FName USUDSDialogue::GetVariableName(FName Name) const
 void USUDSDialogue::UnSetVariable(FName Name)
 {
 	VariableState.Remove(Name);
+	VariableVersions.Bump(Name);
+	// Changed, so anyone providing it on request should be asked again
+	VariablesRequestedThisStep.Remove(Name);
 }
 
 FSUDSValue USUDSDialogue::GetSpeakerLineUserMetadata(FName Key) const
@@ -1330,7 +2099,8 @@ FSUDSValue USUDSDialogue::GetSpeakerLineUserMetadata(FName Key) const
 	{
 		if (auto pExpr = CurrentSpeakerNode->GetUserMetadata().Find(Key))
 		{
-			return pExpr->Evaluate(VariableState, GetGlobalVariables());
+			FSUDSDialogueExpressionContext Context(this);
+			return pExpr->Evaluate(VariableState, GetGlobalVariables(), &Context);
 		}
 	}
 	return FSUDSValue();
@@ -1342,10 +2112,11 @@ TMap<FName, FSUDSValue> USUDSDialogue::GetAllSpeakerLineUserMetadata() const
 	if (CurrentSpeakerNode)
 	{
 		const TMap<FName, FSUDSValue>& GlobalVariables = GetGlobalVariables();
+		FSUDSDialogueExpressionContext Context(this);
 		const auto& InMeta = CurrentSpeakerNode->GetUserMetadata();
 		for (const auto& Pair : InMeta)
 		{
-			Ret.Add(Pair.Key, Pair.Value.Evaluate(VariableState, GlobalVariables));
+			Ret.Add(Pair.Key, Pair.Value.Evaluate(VariableState, GlobalVariables, &Context));
 		}
 	}
 	return Ret;
@@ -1357,7 +2128,8 @@ FSUDSValue USUDSDialogue::GetChoiceUserMetadata(int Index, FName Key) const
 	{
 		if (auto pExpr = CurrentChoices[Index].GetUserMetadata().Find(Key))
 		{
-			return pExpr->Evaluate(VariableState, GetGlobalVariables());
+			FSUDSDialogueExpressionContext Context(this);
+			return pExpr->Evaluate(VariableState, GetGlobalVariables(), &Context);
 		}
 	}
 	return FSUDSValue();
@@ -1369,10 +2141,11 @@ TMap<FName, FSUDSValue> USUDSDialogue::GetAllChoiceUserMetadata(int Index) const
 	if (CurrentChoices.IsValidIndex(Index))
 	{
 		const TMap<FName, FSUDSValue>& GlobalVariables = GetGlobalVariables();
+		FSUDSDialogueExpressionContext Context(this);
 		const auto& InMeta = CurrentChoices[Index].GetUserMetadata();
 		for (const auto& Pair : InMeta)
 		{
-			Ret.Add(Pair.Key, Pair.Value.Evaluate(VariableState, GlobalVariables));
+			Ret.Add(Pair.Key, Pair.Value.Evaluate(VariableState, GlobalVariables, &Context));
 		}
 	}
 	return Ret;
@@ -3,8 +3,238 @@
 #include "SUDSExpression.h"
 
 #include "SUDSLibrary.h"
+#include "SUDSSubsystem.h"
 #include "Misc/DefaultValueHelper.h"
-#include "Internationalization/Regex.h"
+#include "Misc/StringBuilder.h"
+#include "Algo/AllOf.h"
+
+namespace
+{
+	// Character classes as used by the original regex tokenizer (\w and . respectively)
+	bool IsWordChar(TCHAR C)
+	{
+		return FChar::IsAlnum(C) || C == TEXT('_');
+	}
+
+	bool IsLineTerminator(TCHAR C)
+	{
+		return C == TEXT('\n') || C == TEXT('\v') || C == TEXT('\f') || C == TEXT('\r') ||
+			C == 0x85 || C == 0x2028 || C == 0x2029;
+	}
+
+	/// Match a fixed keyword at Pos, returning the length matched or 0. Optionally accept either case for the first char
+	int32 MatchKeyword(FStringView Str, int32 Pos, FStringView Keyword, bool bEitherCaseFirst = false)
+	{
+		if (Pos + Keyword.Len() > Str.Len())
+			return 0;
+		for (int32 i = 0; i < Keyword.Len(); ++i)
+		{
+			const TCHAR C = Str[Pos + i];
+			if (C != Keyword[i] &&
+				!(i == 0 && bEitherCaseFirst && FChar::ToUpper(C) == FChar::ToUpper(Keyword[i])))
+			{
+				return 0;
+			}
+		}
+		return Keyword.Len();
+	}
+
+	/// {Variable}, names can include '.'
+	int32 MatchVariable(FStringView Str, int32 Pos)
+	{
+		if (Str[Pos] != TEXT('{'))
+			return 0;
+		int32 i = Pos + 1;
+		while (i < Str.Len() && (IsWordChar(Str[i]) || Str[i] == TEXT('.')))
+			++i;
+		if (i == Pos + 1 || i >= Str.Len() || Str[i] != TEXT('}'))
+			return 0;
+		return i + 1 - Pos;
+	}
+
+	/// Literal numbers, with or without decimal point, with or without preceding negation
+	int32 MatchNumber(FStringView Str, int32 Pos)
+	{
+		int32 i = Pos;
+		if (Str[i] == TEXT('-'))
+			++i;
+		const int32 DigitsStart = i;
+		while (i < Str.Len() && FChar::IsDigit(Str[i]))
+			++i;
+		if (i == DigitsStart)
+			return 0;
+		if (i < Str.Len() && Str[i] == TEXT('.'))
+		{
+			++i;
+			while (i < Str.Len() && FChar::IsDigit(Str[i]))
+				++i;
+		}
+		return i - Pos;
+	}
+
+	/// "Quoted strings", including escaped double quotes
+	int32 MatchQuotedText(FStringView Str, int32 Pos)
+	{
+		if (Str[Pos] != TEXT('"'))
+			return 0;
+		int32 i = Pos + 1;
+		while (i < Str.Len())
+		{
+			const TCHAR C = Str[i];
+			if (C == TEXT('"'))
+				return i + 1 - Pos;
+			if (C == TEXT('\\'))
+			{
+				// Escape consumes the next char, whatever it is (except line breaks)
+				if (i + 1 >= Str.Len() || IsLineTerminator(Str[i + 1]))
+					return 0;
+				i += 2;
+			}
+			else
+			{
+				++i;
+			}
+		}
+		// Unterminated
+		return 0;
+	}
+
+	/// `Quoted names`
+	int32 MatchQuotedName(FStringView Str, int32 Pos)
+	{
+		if (Str[Pos] != TEXT('`'))
+			return 0;
+		for (int32 i = Pos + 1; i < Str.Len(); ++i)
+		{
+			if (Str[i] == TEXT('`'))
+				return i + 1 - Pos;
+		}
+		return 0;
+	}
+
+	bool IsReservedWord(FStringView Word)
+	{
+		for (const FStringView Reserved : { FStringView(TEXT("and")), FStringView(TEXT("or")), FStringView(TEXT("not")),
+		                                    FStringView(TEXT("masculine")), FStringView(TEXT("feminine")), FStringView(TEXT("neuter")),
+		                                    FStringView(TEXT("true")), FStringView(TEXT("false")) })
+		{
+			if (Word.Equals(Reserved, ESearchCase::IgnoreCase))
+				return true;
+		}
+		return false;
+	}
+
+	bool IsFunctionName(FStringView Token)
+	{
+		return Token.Len() > 0 &&
+			(FChar::IsAlpha(Token[0]) || Token[0] == TEXT('_')) &&
+			Algo::AllOf(Token, IsWordChar) &&
+			!IsReservedWord(Token);
+	}
+
+	/// Name of a function being called, only matched if followed by '(' so that nothing else is affected
+	int32 MatchFunctionName(FStringView Str, int32 Pos)
+	{
+		if (!FChar::IsAlpha(Str[Pos]) && Str[Pos] != TEXT('_'))
+			return 0;
+		int32 i = Pos + 1;
+		while (i < Str.Len() && IsWordChar(Str[i]))
+			++i;
+		const int32 Len = i - Pos;
+		while (i < Str.Len() && FChar::IsWhitespace(Str[i]))
+			++i;
+		if (i >= Str.Len() || Str[i] != TEXT('('))
+			return 0;
+		
+		return IsReservedWord(Str.Mid(Pos, Len)) ? 0 : Len;
+	}
+
+	/// Length of the token starting at Pos, or 0 if there isn't one. Alternatives are tried in the same order as
+	/// the regex this replaced, so the token stream is identical except for function calls, which it didn't support
+	int32 MatchTokenAt(FStringView Str, int32 Pos)
+	{
+		if (const int32 Len = MatchVariable(Str, Pos))
+			return Len;
+		if (const int32 Len = MatchNumber(Str, Pos))
+			return Len;
+
+		if (const int32 Len = MatchFunctionName(Str, Pos))
+			return Len;
+
+		const TCHAR C = Str[Pos];
+		const TCHAR Next = Pos + 1 < Str.Len() ? Str[Pos + 1] : TEXT('\0');
+		switch (C)
+		{
+		// Arithmetic operators, parentheses & function argument separators
+		case TEXT(','):
+		case TEXT('-'):
+		case TEXT('+'):
+		case TEXT('*'):
+		case TEXT('/'):
+		case TEXT('%'):
+		case TEXT('('):
+		case TEXT(')'):
+			return 1;
+		// Boolean operators & comparisons
+		case TEXT('&'):
+			return Next == TEXT('&') ? 2 : 0;
+		case TEXT('|'):
+			return Next == TEXT('|') ? 2 : 0;
+		case TEXT('!'):
+			return Next == TEXT('=') ? 2 : 1;
+		case TEXT('<'):
+			return Next == TEXT('>') || Next == TEXT('=') ? 2 : 1;
+		case TEXT('>'):
+		case TEXT('='):
+			return Next == TEXT('=') ? 2 : 1;
+		case TEXT('"'):
+			return MatchQuotedText(Str, Pos);
+		case TEXT('`'):
+			return MatchQuotedName(Str, Pos);
+		default:
+			break;
+		}
+
+		// Keywords & predefined constants
+		for (const FStringView Keyword : { FStringView(TEXT("and")), FStringView(TEXT("or")), FStringView(TEXT("not")) })
+		{
+			if (const int32 Len = MatchKeyword(Str, Pos, Keyword))
+				return Len;
+		}
+		for (const FStringView Constant : { FStringView(TEXT("masculine")), FStringView(TEXT("feminine")), FStringView(TEXT("neuter")), FStringView(TEXT("true")), FStringView(TEXT("false")) })
+		{
+			if (const int32 Len = MatchKeyword(Str, Pos, Constant, true))
+				return Len;
+		}
+		return 0;
+	}
+
+	/// Find the next token from Pos onwards, skipping anything unrecognised
+	bool NextToken(FStringView Str, int32& Pos, FStringView& OutToken)
+	{
+		while (Pos < Str.Len())
+		{
+			if (const int32 Len = MatchTokenAt(Str, Pos))
+			{
+				OutToken = Str.Mid(Pos, Len);
+				Pos += Len;
+				return true;
+			}
+			++Pos;
+		}
+		return false;
+	}
+}
+
+void FSUDSExpression::Tokenize(FStringView Expression, TArray<FStringView>& OutTokens)
+{
+	int32 Pos = 0;
+	FStringView Token;
+	while (NextToken(Expression, Pos, Token))
+	{
+		OutTokens.Add(Token);
+	}
+}
 
 bool FSUDSExpression::ParseFromString(const FString& Expression, FString* OutParseError)
 {
@@ -20,7 +250,7 @@ bool FSUDSExpression::ParseFromString(const FString& Expression, FString* OutPar
 	// expressed in Reverse Polish Notation, which can be easily executed later
 	// Variables are not resolved at this point, only at execution time.
 	
-	// Split into individual tokens; sections of the regex are:
+	// Split into individual tokens, see MatchTokenAt:
 	// - {Variable}
 	// - Literal numbers (with or without decimal point, with or without preceding negation)
 	// - Arithmetic operators & parentheses
@@ -29,15 +259,27 @@ bool FSUDSExpression::ParseFromString(const FString& Expression, FString* OutPar
 	// - Quoted strings "string"
 	//   - Including ignoring escaped double quotes
 	// - Quoted names `name`
-	const FRegexPattern Pattern(TEXT("(\\{[\\w\\.]+\\}|-?\\d+(?:\\.\\d*)?|[-+*\\/%\\(\\)]|and|&&|\\|\\||or|not|\\<\\>|!=|!|\\<=?|\\>=?|==?|[mM]asculine|[fF]eminine|[nN]euter|[tT]rue|[fF]alse|\"(?:[^\"\\\\]|\\\\.)*\"|`([^`]*)`)"));
-	FRegexMatcher Regex(Pattern, Expression);
+	// - Function names, when followed by (
+	const FStringView ExpressionView(Expression);
+	int32 Pos = 0;
+	FStringView Str;
 	// Stacks that we use to construct
 	TArray<ESUDSExpressionItemType> OperatorStack;
+	// Function calls in progress, each has a FunctionCall entry on OperatorStack, just below its parenthesis
+	struct FPendingCall
+	{
+		FName Name;
+		int32 ExpectedArgs;
+		int32 NumCommas;
+	};
+	TArray<FPendingCall> CallStack;
+	bool bLastWasLParens = false;
 	bool bParsedSomething = false;
 	bool bErrors = false;
-	while (Regex.FindNext())
+	while (NextToken(ExpressionView, Pos, Str))
 	{
-		FString Str = Regex.GetCaptureGroup(1);
+		const bool bFollowsLParens = bLastWasLParens;
+		bLastWasLParens = false;
 		ESUDSExpressionItemType OpType = ParseOperator(Str);
 		if (OpType != ESUDSExpressionItemType::Null)
 		{
@@ -46,6 +288,23 @@ bool FSUDSExpression::ParseFromString(const FString& Expression, FString* OutPar
 			if (OpType == ESUDSExpressionItemType::LParens)
 			{
 				OperatorStack.Push(OpType);
+				bLastWasLParens = true;
+			}
+			else if (OpType == ESUDSExpressionItemType::Comma)
+			{
+				// Complete the previous argument
+				while (OperatorStack.Num() > 0 && OperatorStack.Top() != ESUDSExpressionItemType::LParens)
+				{
+					Queue.Add(FSUDSExpressionItem(OperatorStack.Pop()));
+				}
+				if (OperatorStack.Num() < 2 || OperatorStack[OperatorStack.Num() - 2] != ESUDSExpressionItemType::FunctionCall)
+				{
+					if (OutParseError)
+						*OutParseError = TEXT("Unexpected ',' outside of function call");
+					bErrors = true;
+					break;
+				}
+				++CallStack.Top().NumCommas;
 			}
 			else if (OpType == ESUDSExpressionItemType::RParens)
 			{
@@ -73,7 +332,21 @@ bool FSUDSExpression::ParseFromString(const FString& Expression, FString* OutPar
 					// Discard left parens
 					OperatorStack.Pop();
 				}
-				
+
+				if (OperatorStack.Num() > 0 && OperatorStack.Top() == ESUDSExpressionItemType::FunctionCall)
+				{
+					OperatorStack.Pop();
+					const FPendingCall Call = CallStack.Pop();
+					const int32 NumArgs = bFollowsLParens ? 0 : Call.NumCommas + 1;
+					if (NumArgs != Call.ExpectedArgs)
+					{
+						if (OutParseError)
+							*OutParseError = FString::Printf(TEXT("Function '%s' takes %d arguments, not %d"), *Call.Name.ToString(), Call.ExpectedArgs, NumArgs);
+						bErrors = true;
+						break;
+					}
+					Queue.Add(FSUDSExpressionItem::MakeFunctionCall(Call.Name, NumArgs));
+				}
 			}
 			else
 			{
@@ -101,10 +374,28 @@ bool FSUDSExpression::ParseFromString(const FString& Expression, FString* OutPar
 				bParsedSomething = true;
 				Queue.Add(FSUDSExpressionItem(Operand));
 			}
+			else if (IsFunctionName(Str))
+			{
+				// Resolve now so that mistakes are found at import
+				const FName FunctionName(Str.Len(), Str.GetData());
+				if (const FSUDSExpressionFunctionInfo* Info = USUDSSubsystem::FindExpressionFunction(FunctionName))
+				{
+					// The tokenizer only returns function names followed by '(', which will come next
+					OperatorStack.Push(ESUDSExpressionItemType::FunctionCall);
+					CallStack.Add({ FunctionName, Info->NumArgs, 0 });
+				}
+				else
+				{
+					if (OutParseError)
+						*OutParseError = FString::Printf(TEXT("Unknown function '%s'"), *FunctionName.ToString());
+					bErrors = true;
+					break;
+				}
+			}
 			else
 			{
 				if (OutParseError)
-					*OutParseError = FString::Printf(TEXT("Unrecognised token %s"), *Str);
+					*OutParseError = FString::Printf(TEXT("Unrecognised token %s"), *FString(Str));
 				bErrors = true;
 			}
 		}
@@ -113,7 +404,8 @@ bool FSUDSExpression::ParseFromString(const FString& Expression, FString* OutPar
 	while (OperatorStack.Num() > 0)
 	{
 		if (OperatorStack.Top() == ESUDSExpressionItemType::LParens ||
-			OperatorStack.Top() == ESUDSExpressionItemType::RParens)
+			OperatorStack.Top() == ESUDSExpressionItemType::RParens ||
+			OperatorStack.Top() == ESUDSExpressionItemType::FunctionCall)
 		{
 			bErrors = true;
 			if (OutParseError)
@@ -127,9 +419,10 @@ bool FSUDSExpression::ParseFromString(const FString& Expression, FString* OutPar
 	if (!Validate() ||
 		(Expression.Len() > 0 && Queue.IsEmpty())) // Empty expressions validate correctly, but if there was text incoming that resolved to nothing, this is an error
 	{
-		bErrors = true;
-		if (OutParseError)
+		// Keep any more specific error
+		if (OutParseError && !bErrors)
 			*OutParseError = FString::Printf(TEXT("Bad expression '%s'"), *Expression);
+		bErrors = true;
 	}
 
 	bIsValid = bParsedSomething && !bErrors;
@@ -137,25 +430,67 @@ bool FSUDSExpression::ParseFromString(const FString& Expression, FString* OutPar
 	// Build list of variables
 	if (bIsValid)
 	{
-		for (auto& Item : Queue)
-		{
-			if (Item.IsOperand() && Item.GetOperandValue().IsVariable())
-			{
-				VariableNames.AddUnique(Item.GetOperandValue().GetVariableNameValue());
-			}
-		}
-
+		UpdateVariableNames();
 	}
 
+	Compile();
+
 	return bIsValid;
 }
 
+void FSUDSExpression::UpdateVariableNames()
+{
+	VariableNames.Empty();
+	for (auto& Item : Queue)
+	{
+		if (Item.IsOperand() && Item.GetOperandValue().IsVariable())
+		{
+			VariableNames.AddUnique(Item.GetOperandValue().GetVariableNameValue());
+		}
+	}
+}
+
 void FSUDSExpression::Reset()
 {
 	bIsValid = true;
 	Queue.Empty();
 	VariableNames.Empty();
+	VariableTypeHints.Empty();
 	SourceString = "";
+	Program.Empty();
+	Constants.Empty();
+	ProgramVariables.Empty();
+	ProgramFunctions.Empty();
+	MaxStackDepth = 0;
+}
+
+bool FSUDSExpression::IsIdenticalTo(const FSUDSExpression& Other) const
+{
+	if (bIsValid != Other.bIsValid ||
+		Queue.Num() != Other.Queue.Num() ||
+		!SourceString.Equals(Other.SourceString, ESearchCase::CaseSensitive) ||
+		!VariableTypeHints.OrderIndependentCompareEqual(Other.VariableTypeHints))
+	{
+		return false;
+	}
+
+	for (int i = 0; i < Queue.Num(); ++i)
+	{
+		if (Queue[i].GetType() != Other.Queue[i].GetType())
+			return false;
+		if ((Queue[i].IsOperand() || Queue[i].IsFunctionCall()) &&
+			!Queue[i].GetOperandValue().IsIdenticalTo(Other.Queue[i].GetOperandValue()))
+			return false;
+		if (Queue[i].GetNumArgs() != Other.Queue[i].GetNumArgs())
+			return false;
+	}
+	return true;
+}
+
+const FSUDSExpression& FSUDSExpression::GetBlank()
+{
+	static const FSUDSExpression Blank;
+	return Blank;
 }
 
 bool FSUDSExpression::IsRandomCondition() const
@@ -168,54 +503,61 @@ bool FSUDSExpression::IsRandomCondition() const
 	return false;
 }
 
-ESUDSExpressionItemType FSUDSExpression::ParseOperator(const FString& OpStr)
+ESUDSExpressionItemType FSUDSExpression::ParseOperator(FStringView OpStr)
 {
-	if (OpStr == "+")
+	auto Is = [OpStr](const TCHAR* Op)
+	{
+		return OpStr.Equals(Op, ESearchCase::IgnoreCase);
+	};
+	
+	if (Is(TEXT("+")))
 		return ESUDSExpressionItemType::Add;
-	if (OpStr == "-")
+	if (Is(TEXT("-")))
 		return ESUDSExpressionItemType::Subtract;
-	if (OpStr == "*")
+	if (Is(TEXT("*")))
 		return ESUDSExpressionItemType::Multiply;
-	if (OpStr == "/")
+	if (Is(TEXT("/")))
 		return ESUDSExpressionItemType::Divide;
-	if (OpStr == "%")
+	if (Is(TEXT("%")))
 		return ESUDSExpressionItemType::Modulo;
-	if (OpStr == "and" || OpStr == "&&")
+	if (Is(TEXT("and")) || Is(TEXT("&&")))
 		return ESUDSExpressionItemType::And;
-	if (OpStr == "or" || OpStr == "||")
+	if (Is(TEXT("or")) || Is(TEXT("||")))
 		return ESUDSExpressionItemType::Or;
-	if (OpStr == "not" || OpStr == "!")
+	if (Is(TEXT("not")) || Is(TEXT("!")))
 		return ESUDSExpressionItemType::Not;
-	if (OpStr == "==" || OpStr == "=")
+	if (Is(TEXT("==")) || Is(TEXT("=")))
 		return ESUDSExpressionItemType::Equal;
-	if (OpStr == ">=")
+	if (Is(TEXT(">=")))
 		return ESUDSExpressionItemType::GreaterEqual;
-	if (OpStr == ">")
+	if (Is(TEXT(">")))
 		return ESUDSExpressionItemType::Greater;
-	if (OpStr == "<=")
+	if (Is(TEXT("<=")))
 		return ESUDSExpressionItemType::LessEqual;
-	if (OpStr == "<")
+	if (Is(TEXT("<")))
 		return ESUDSExpressionItemType::Less;
-	if (OpStr == "<>" || OpStr == "!=")
+	if (Is(TEXT("<>")) || Is(TEXT("!=")))
 		return ESUDSExpressionItemType::NotEqual;
-	if (OpStr == "(")
+	if (Is(TEXT("(")))
 		return ESUDSExpressionItemType::LParens;
-	if (OpStr == ")")
+	if (Is(TEXT(")")))
 		return ESUDSExpressionItemType::RParens;
+	if (Is(TEXT(",")))
+		return ESUDSExpressionItemType::Comma;
 
 	return ESUDSExpressionItemType::Null;
 }
 
-bool FSUDSExpression::ParseOperand(const FString& ValueStr, FSUDSValue& OutVal)
+bool FSUDSExpression::ParseOperand(FStringView ValueStr, FSUDSValue& OutVal)
 {
 	// Try Boolean first since only 2 options
 	{
-		if (ValueStr.Compare("true", ESearchCase::IgnoreCase) == 0)
+		if (ValueStr.Equals(TEXT("true"), ESearchCase::IgnoreCase))
 		{
 			OutVal = FSUDSValue(true);
 			return true;
 		}
-		if (ValueStr.Compare("false", ESearchCase::IgnoreCase) == 0)
+		if (ValueStr.Equals(TEXT("false"), ESearchCase::IgnoreCase))
 		{
 			OutVal = FSUDSValue(false);
 			return true;
@@ -223,68 +565,93 @@ bool FSUDSExpression::ParseOperand(const FString& ValueStr, FSUDSValue& OutVal)
 	}
 	// Try gender
 	{
-		if (ValueStr.Compare("masculine", ESearchCase::IgnoreCase) == 0)
+		if (ValueStr.Equals(TEXT("masculine"), ESearchCase::IgnoreCase))
 		{
 			OutVal = FSUDSValue(ETextGender::Masculine);
 			return true;
 		}
-		if (ValueStr.Compare("feminine", ESearchCase::IgnoreCase) == 0)
+		if (ValueStr.Equals(TEXT("feminine"), ESearchCase::IgnoreCase))
 		{
 			OutVal = FSUDSValue(ETextGender::Feminine);
 			return true;
 		}
-		if (ValueStr.Compare("neuter", ESearchCase::IgnoreCase) == 0)
+		if (ValueStr.Equals(TEXT("neuter"), ESearchCase::IgnoreCase))
 		{
 			OutVal = FSUDSValue(ETextGender::Neuter);
 			return true;
 		}
 	}
 	// Try quoted text (will be localised later in asset conversion)
+	if (ValueStr.Len() >= 2 && MatchQuotedText(ValueStr, 0) == ValueStr.Len())
 	{
-		const FRegexPattern Pattern(TEXT("^\"((?:[^\"\\\\]|\\\\.)*)\"$"));
-		FRegexMatcher Regex(Pattern, ValueStr);
-		if (Regex.FindNext())
-		{
-			FString Val = Regex.GetCaptureGroup(1);
-			// Consolidate any escaped double quotes into just quotes
-			Val.ReplaceInline(TEXT("\\\""), TEXT("\""));
-			OutVal = FSUDSValue(FText::FromString(Val));
-			return true;
-		}
+		FString Val(ValueStr.Mid(1, ValueStr.Len() - 2));
+		// Consolidate any escaped double quotes into just quotes
+		Val.ReplaceInline(TEXT("\\\""), TEXT("\""));
+		OutVal = FSUDSValue(FText::FromString(MoveTemp(Val)));
+		return true;
 	}
 	// Try FName
+	if (ValueStr.Len() >= 2 && MatchQuotedName(ValueStr, 0) == ValueStr.Len())
 	{
-		const FRegexPattern Pattern(TEXT("^`([^`]*)`$"));
-		FRegexMatcher Regex(Pattern, ValueStr);
-		if (Regex.FindNext())
-		{
-			const FString Name = Regex.GetCaptureGroup(1);
-			OutVal = FSUDSValue(FName(Name), false);
-			return true;
-		}
+		const FStringView Name = ValueStr.Mid(1, ValueStr.Len() - 2);
+		OutVal = FSUDSValue(FName(Name.Len(), Name.GetData()), false);
+		return true;
 	}
 	// Try variable name
+	if (ValueStr.Len() >= 2 && ValueStr[0] == TEXT('{') && ValueStr[ValueStr.Len() - 1] == TEXT('}'))
 	{
-		const FRegexPattern Pattern(TEXT("^\\{([^\\}]*)\\}$"));
-		FRegexMatcher Regex(Pattern, ValueStr);
-		if (Regex.FindNext())
+		const FStringView Name = ValueStr.Mid(1, ValueStr.Len() - 2);
+		int32 Dummy;
+		if (!Name.FindChar(TEXT('}'), Dummy))
 		{
-			const FName VariableName(Regex.GetCaptureGroup(1));
-			OutVal = FSUDSValue(VariableName, true);
+			OutVal = FSUDSValue(FName(Name.Len(), Name.GetData()), true);
 			return true;
 		}
 	}
 	// Try Numbers
 	{
+		// Fast path for the plain numbers the tokenizer produces, which doesn't need a temporary string
+		const bool bAsciiNumber = Algo::AllOf(ValueStr, [](TCHAR C)
+		{
+			return (C >= TEXT('0') && C <= TEXT('9')) || C == TEXT('-') || C == TEXT('.');
+		});
+		if (bAsciiNumber && ValueStr.Len() > 0 && MatchNumber(ValueStr, 0) == ValueStr.Len())
+		{
+			int32 DecimalPointIdx;
+			const bool bNegative = ValueStr[0] == TEXT('-');
+			if (!ValueStr.FindChar(TEXT('.'), DecimalPointIdx))
+			{
+				// Avoid overflow handling, long numbers go the slow way
+				if (ValueStr.Len() - (bNegative ? 1 : 0) <= 9)
+				{
+					int32 IntVal = 0;
+					for (int32 i = bNegative ? 1 : 0; i < ValueStr.Len(); ++i)
+					{
+						IntVal = IntVal * 10 + (ValueStr[i] - TEXT('0'));
+					}
+					OutVal = FSUDSValue(bNegative ? -IntVal : IntVal);
+					return true;
+				}
+			}
+			else
+			{
+				TStringBuilder<64> NullTerminated;
+				NullTerminated << ValueStr;
+				OutVal = FSUDSValue(FCString::Atof(*NullTerminated));
+				return true;
+			}
+		}
+		
+		const FString NumberStr(ValueStr);
 		float FloatVal;
 		int IntVal;
 		// look for int first; anything with a decimal point will fail
-		if (FDefaultValueHelper::ParseInt(ValueStr, IntVal))
+		if (FDefaultValueHelper::ParseInt(NumberStr, IntVal))
 		{
 			OutVal = FSUDSValue(IntVal);	
 			return true;
 		}
-		if (FDefaultValueHelper::ParseFloat(ValueStr, FloatVal))
+		if (FDefaultValueHelper::ParseFloat(NumberStr, FloatVal))
 		{
 			OutVal = FSUDSValue(FloatVal);	
 			return true;
@@ -301,165 +668,952 @@ bool FSUDSExpression::Validate()
 	if (Queue.IsEmpty())
 		return true;
 
-	// Same algorithm as Execute, we just don't execute
-	TArray<FSUDSExpressionItem> EvalStack;
-	const TMap<FName, FSUDSValue> TempVariables;
+	// Same stack behaviour as Evaluate, we just track the depth rather than executing
+	int32 Depth = 0;
 	for (auto& Item : Queue)
 	{
 		if (Item.IsOperator())
 		{
-			FSUDSExpressionItem Arg1, Arg2;
-			if (Item.IsBinaryOperator())
+			const int32 NumArgs = Item.GetNumArgs();
+			if (Depth < NumArgs)
+				return false;
+			// Pop args, push result
+			Depth -= NumArgs - 1;
+		}
+		else
+		{
+			++Depth;
+		}
+	}
+
+	// Must be one item left (results of operators are always operands)
+	return Depth == 1;
+	
+}
+
+namespace
+{
+	ESUDSExpressionOpCode GetOperatorOpCode(ESUDSExpressionItemType Op)
+	{
+		switch (Op)
+		{
+		case ESUDSExpressionItemType::Not:
+			return ESUDSExpressionOpCode::Not;
+		case ESUDSExpressionItemType::Multiply:
+			return ESUDSExpressionOpCode::Multiply;
+		case ESUDSExpressionItemType::Divide:
+			return ESUDSExpressionOpCode::Divide;
+		case ESUDSExpressionItemType::Modulo:
+			return ESUDSExpressionOpCode::Modulo;
+		case ESUDSExpressionItemType::Add:
+			return ESUDSExpressionOpCode::Add;
+		case ESUDSExpressionItemType::Subtract:
+			return ESUDSExpressionOpCode::Subtract;
+		case ESUDSExpressionItemType::Less:
+			return ESUDSExpressionOpCode::Less;
+		case ESUDSExpressionItemType::LessEqual:
+			return ESUDSExpressionOpCode::LessEqual;
+		case ESUDSExpressionItemType::Greater:
+			return ESUDSExpressionOpCode::Greater;
+		case ESUDSExpressionItemType::GreaterEqual:
+			return ESUDSExpressionOpCode::GreaterEqual;
+		case ESUDSExpressionItemType::Equal:
+			return ESUDSExpressionOpCode::Equal;
+		case ESUDSExpressionItemType::NotEqual:
+			return ESUDSExpressionOpCode::NotEqual;
+		case ESUDSExpressionItemType::And:
+			return ESUDSExpressionOpCode::And;
+		case ESUDSExpressionItemType::Or:
+			return ESUDSExpressionOpCode::Or;
+		default:
+			// Parens never make it into the queue
+			checkf(false, TEXT("Unexpected operator in expression queue"));
+			return ESUDSExpressionOpCode::Not;
+		}
+	}
+	/// The type an operator will produce given the types of its operands (Variable meaning unknown)
+	ESUDSValueType GetOperatorResultType(ESUDSExpressionItemType Op, ESUDSValueType Lhs, ESUDSValueType Rhs)
+	{
+		switch (Op)
+		{
+		case ESUDSExpressionItemType::Multiply:
+		case ESUDSExpressionItemType::Divide:
+		case ESUDSExpressionItemType::Modulo:
+		case ESUDSExpressionItemType::Add:
+		case ESUDSExpressionItemType::Subtract:
+			// Only int op int is an int, anything else is widened to float
+			if (Lhs == ESUDSValueType::Int && Rhs == ESUDSValueType::Int)
+				return ESUDSValueType::Int;
+			if (Lhs == ESUDSValueType::Variable || Rhs == ESUDSValueType::Variable)
 			{
-				if (EvalStack.IsEmpty())
-					return false;
-				Arg2 = EvalStack.Pop();
+				// Unless the other side is a float, we don't know
+				return Lhs == ESUDSValueType::Float || Rhs == ESUDSValueType::Float
+					       ? ESUDSValueType::Float
+					       : ESUDSValueType::Variable;
 			}
-			if (EvalStack.IsEmpty())
-				return false;
-			Arg1 = EvalStack.Pop();
+			return ESUDSValueType::Float;
+		default:
+			// Everything else is a comparison or boolean op
+			return ESUDSValueType::Boolean;
+		}
+	}
 
-			EvalStack.Push(EvaluateOperator(Item.GetType(), Arg1, Arg2, TempVariables, TempVariables));
+	bool IsNumericType(ESUDSValueType Type)
+	{
+		return Type == ESUDSValueType::Int || Type == ESUDSValueType::Float;
+	}
+
+	/// Get a type-specialised version of a binary operator if the operand types allow it, otherwise the generic one
+	/// The specialised version must produce exactly the same result as the generic operator for those types
+	ESUDSExpressionOpCode GetSpecialisedOpCode(ESUDSExpressionItemType Op, ESUDSValueType Lhs, ESUDSValueType Rhs)
+	{
+		const ESUDSExpressionOpCode Generic = GetOperatorOpCode(Op);
+		if (!IsNumericType(Lhs) || !IsNumericType(Rhs))
+			return Generic;
+
+		const bool bBothInt = Lhs == ESUDSValueType::Int && Rhs == ESUDSValueType::Int;
+		const bool bBothFloat = Lhs == ESUDSValueType::Float && Rhs == ESUDSValueType::Float;
+		switch (Op)
+		{
+		case ESUDSExpressionItemType::Multiply:
+			return bBothInt ? ESUDSExpressionOpCode::MultiplyInt : ESUDSExpressionOpCode::MultiplyFloat;
+		case ESUDSExpressionItemType::Divide:
+			return bBothInt ? ESUDSExpressionOpCode::DivideInt : ESUDSExpressionOpCode::DivideFloat;
+		case ESUDSExpressionItemType::Modulo:
+			return bBothInt ? ESUDSExpressionOpCode::ModuloInt : ESUDSExpressionOpCode::ModuloFloat;
+		case ESUDSExpressionItemType::Add:
+			return bBothInt ? ESUDSExpressionOpCode::AddInt : ESUDSExpressionOpCode::AddFloat;
+		case ESUDSExpressionItemType::Subtract:
+			return bBothInt ? ESUDSExpressionOpCode::SubtractInt : ESUDSExpressionOpCode::SubtractFloat;
+		case ESUDSExpressionItemType::Less:
+			return bBothInt ? ESUDSExpressionOpCode::LessInt : ESUDSExpressionOpCode::LessFloat;
+		case ESUDSExpressionItemType::Greater:
+			return bBothInt ? ESUDSExpressionOpCode::GreaterInt : ESUDSExpressionOpCode::GreaterFloat;
+		// The generic versions of these involve ==, which is false for mixed int / float, so only specialise same types
+		case ESUDSExpressionItemType::LessEqual:
+			return bBothInt ? ESUDSExpressionOpCode::LessEqualInt : bBothFloat ? ESUDSExpressionOpCode::LessEqualFloat : Generic;
+		case ESUDSExpressionItemType::GreaterEqual:
+			return bBothInt ? ESUDSExpressionOpCode::GreaterEqualInt : bBothFloat ? ESUDSExpressionOpCode::GreaterEqualFloat : Generic;
+		case ESUDSExpressionItemType::Equal:
+			return bBothInt ? ESUDSExpressionOpCode::EqualInt : bBothFloat ? ESUDSExpressionOpCode::EqualFloat : Generic;
+		case ESUDSExpressionItemType::NotEqual:
+			return bBothInt ? ESUDSExpressionOpCode::NotEqualInt : bBothFloat ? ESUDSExpressionOpCode::NotEqualFloat : Generic;
+		default:
+			return Generic;
+		}
+	}
+}
+
+void FSUDSExpressionFunctionCall::Bind() const
+{
+	const FSUDSExpressionFunctionInfo* Info = USUDSSubsystem::FindExpressionFunction(Name);
+	Function = Info && Info->NumArgs == NumArgs ? Info->Function : nullptr;
+	RegistryGeneration = USUDSSubsystem::GetExpressionFunctionGeneration();
+}
+
+FSUDSExpressionFunction FSUDSExpressionFunctionCall::GetFunction() const
+{
+	if (RegistryGeneration != USUDSSubsystem::GetExpressionFunctionGeneration())
+	{
+		Bind();
+	}
+	return Function;
+}
+
+void FSUDSExpression::Compile()
+{
+	Program.Empty();
+	Constants.Empty();
+	ProgramVariables.Empty();
+	ProgramFunctions.Empty();
+	MaxStackDepth = 0;
+
+	if (!bIsValid || Queue.IsEmpty())
+		return;
+
+	// Build the program as a stack of fragments, one per sub-expression, so that when we get to 'and' / 'or' we
+	// know how many instructions to jump to skip the right hand side. We also track the result type of each fragment
+	// where we know it, to use type-specialised operators
+	TArray<TArray<FSUDSExpressionInstruction>> Fragments;
+	TArray<ESUDSValueType> FragmentTypes;
+	for (auto& Item : Queue)
+	{
+		if (Item.IsOperand())
+		{
+			const FSUDSValue& Val = Item.GetOperandValue();
+			FragmentTypes.Add(GetOperandTypeHint(Val));
+			if (Val.IsVariable())
+			{
+				checkf(ProgramVariables.Num() < MAX_uint16, TEXT("Too many variables in expression %s"), *SourceString);
+				const uint16 Idx = static_cast<uint16>(ProgramVariables.Emplace(Val));
+				Fragments.AddDefaulted_GetRef().Emplace(ESUDSExpressionOpCode::PushVariable, Idx);
+			}
+			else
+			{
+				checkf(Constants.Num() < MAX_uint16, TEXT("Too many operands in expression %s"), *SourceString);
+				const uint16 Idx = static_cast<uint16>(Constants.Add(Val));
+				Fragments.AddDefaulted_GetRef().Emplace(ESUDSExpressionOpCode::PushConstant, Idx);
+			}
+		}
+		else if (Item.IsFunctionCall())
+		{
+			const int32 NumArgs = Item.GetNumArgs();
+			checkf(Fragments.Num() >= NumArgs, TEXT("Args missing before function call, bad expression %s"), *SourceString);
+			checkf(ProgramFunctions.Num() < MAX_uint16, TEXT("Too many function calls in expression %s"), *SourceString);
+			FSUDSExpressionFunctionCall& Call = ProgramFunctions.AddDefaulted_GetRef();
+			Call.Name = Item.GetFunctionName();
+			Call.NumArgs = NumArgs;
+			Call.Bind();
+			const FSUDSExpressionFunctionInfo* Info = USUDSSubsystem::FindExpressionFunction(Call.Name);
+
+			// Args are evaluated in order, then replaced by the result
+			TArray<FSUDSExpressionInstruction> CallFragment;
+			for (int32 i = Fragments.Num() - NumArgs; i < Fragments.Num(); ++i)
+			{
+				CallFragment.Append(Fragments[i]);
+			}
+			Fragments.SetNum(Fragments.Num() - NumArgs);
+			FragmentTypes.SetNum(FragmentTypes.Num() - NumArgs);
+			CallFragment.Emplace(ESUDSExpressionOpCode::CallFunction, static_cast<uint16>(ProgramFunctions.Num() - 1));
+			Fragments.Add(MoveTemp(CallFragment));
+			FragmentTypes.Add(Info ? Info->ReturnType : ESUDSValueType::Variable);
+		}
+		else if (!Item.IsBinaryOperator())
+		{
+			checkf(Fragments.Num() > 0, TEXT("Args missing before operator, bad expression %s"), *SourceString);
+			Fragments.Top().Emplace(GetOperatorOpCode(Item.GetType()));
+			FragmentTypes.Top() = ESUDSValueType::Boolean;
 		}
 		else
 		{
-			EvalStack.Push(Item);
+			checkf(Fragments.Num() > 1, TEXT("Args missing before operator, bad expression %s"), *SourceString);
+			TArray<FSUDSExpressionInstruction> Rhs = Fragments.Pop();
+			auto& Lhs = Fragments.Top();
+			const ESUDSValueType RhsType = FragmentTypes.Pop();
+			ESUDSValueType& LhsType = FragmentTypes.Top();
+			if (Item.GetType() == ESUDSExpressionItemType::And ||
+				Item.GetType() == ESUDSExpressionItemType::Or)
+			{
+				// Skip the RHS and the operator itself if the LHS decides the result
+				checkf(Rhs.Num() < MAX_uint16, TEXT("Expression too long: %s"), *SourceString);
+				Lhs.Emplace(Item.GetType() == ESUDSExpressionItemType::And ? ESUDSExpressionOpCode::JumpIfFalse : ESUDSExpressionOpCode::JumpIfTrue,
+				            static_cast<uint16>(Rhs.Num() + 1));
+			}
+			Lhs.Append(Rhs);
+			Lhs.Emplace(GetSpecialisedOpCode(Item.GetType(), LhsType, RhsType));
+			LhsType = GetOperatorResultType(Item.GetType(), LhsType, RhsType);
 		}
 	}
 
-	// Must be one item left and must be an operand
-	return EvalStack.Num() == 1 && EvalStack[0].IsOperand();
-	
+	checkf(Fragments.Num() == 1, TEXT("Expression should compile to a single result: %s"), *SourceString);
+	Program = MoveTemp(Fragments[0]);
+
+	// Jumps only ever skip instructions, so the straight-through path is always the deepest
+	int32 Depth = 0;
+	for (const auto& Instr : Program)
+	{
+		switch (Instr.OpCode)
+		{
+		case ESUDSExpressionOpCode::PushConstant:
+		case ESUDSExpressionOpCode::PushVariable:
+			MaxStackDepth = FMath::Max(MaxStackDepth, ++Depth);
+			break;
+		case ESUDSExpressionOpCode::Not:
+		case ESUDSExpressionOpCode::JumpIfFalse:
+		case ESUDSExpressionOpCode::JumpIfTrue:
+			break;
+		case ESUDSExpressionOpCode::CallFunction:
+			Depth += 1 - ProgramFunctions[Instr.Operand].NumArgs;
+			MaxStackDepth = FMath::Max(MaxStackDepth, Depth);
+			break;
+		default:
+			--Depth;
+			break;
+		}
+	}
 }
 
-FSUDSValue FSUDSExpression::Evaluate(const TMap<FName, FSUDSValue>& Variables, const TMap<FName, FSUDSValue>& GlobalVariables) const
+namespace
 {
-	checkf(bIsValid, TEXT("Cannot execute an invalid expression tree"));
+	/// A sub-expression while optimising, with the type of its result if we know it ahead of time
+	struct FSUDSExpressionFragment
+	{
+		TArray<FSUDSExpressionItem> Items;
+		/// Variable means we don't know until runtime
+		ESUDSValueType ResultType = ESUDSValueType::Variable;
 
-	// Blanks are mostly used for conditionals, for simplicity always return true
-	if (Queue.IsEmpty())
-		return FSUDSValue(true);
+		FSUDSExpressionFragment() = default;
+		explicit FSUDSExpressionFragment(const FSUDSValue& Value)
+			: ResultType(Value.GetType())
+		{
+			Items.Add(FSUDSExpressionItem(Value));
+		}
+
+		bool IsLiteral() const
+		{
+			return Items.Num() == 1 && Items[0].IsOperand() && !Items[0].GetOperandValue().IsVariable();
+		}
+		const FSUDSValue& GetLiteral() const { return Items[0].GetOperandValue(); }
+
+		bool IsBooleanLiteral(bool bValue) const
+		{
+			return IsLiteral() && GetLiteral().GetType() == ESUDSValueType::Boolean && GetLiteral().GetBooleanValue() == bValue;
+		}
+
+		/// Whether this calls any functions, which must still be called even if the result isn't needed
+		bool HasFunctionCall() const
+		{
+			return Items.ContainsByPredicate([](const FSUDSExpressionItem& Item) { return Item.IsFunctionCall(); });
+		}
+
+		/// Whether this is a numeric literal equal to Value, that can be dropped from an arithmetic operation with
+		/// the other side without changing the result, including its type
+		bool IsArithmeticIdentity(int Value, ESUDSValueType OtherType) const
+		{
+			if (!IsLiteral())
+				return false;
+			const FSUDSValue& Lit = GetLiteral();
+			// int op int stays int, anything involving a float is a float
+			// But if the other side is e.g. an unknown variable, then dropping this might change the type
+			if (Lit.GetType() == ESUDSValueType::Int)
+				return Lit.GetIntValue() == Value && (OtherType == ESUDSValueType::Int || OtherType == ESUDSValueType::Float);
+			if (Lit.GetType() == ESUDSValueType::Float)
+				return Lit.GetFloatValue() == static_cast<float>(Value) && OtherType == ESUDSValueType::Float;
+			return false;
+		}
+	};
+
+	bool CanFoldLiterals(ESUDSExpressionItemType Op, const FSUDSValue& Lhs, const FSUDSValue& Rhs)
+	{
+		switch (Op)
+		{
+		case ESUDSExpressionItemType::And:
+		case ESUDSExpressionItemType::Or:
+			// Leave anything non-boolean to complain at runtime as it always has
+			return Lhs.GetType() == ESUDSValueType::Boolean && Rhs.GetType() == ESUDSValueType::Boolean;
+		case ESUDSExpressionItemType::Divide:
+		case ESUDSExpressionItemType::Modulo:
+			// Don't fold integer division by zero
+			return !(Lhs.GetType() == ESUDSValueType::Int && Rhs.GetType() == ESUDSValueType::Int && Rhs.GetIntValue() == 0);
+		default:
+			return true;
+		}
+	}
+
+	FSUDSValue EvaluateLiterals(ESUDSExpressionItemType Op, const FSUDSValue& Lhs, const FSUDSValue& Rhs)
+	{
+		switch (Op)
+		{
+		case ESUDSExpressionItemType::Multiply:
+			return Lhs * Rhs;
+		case ESUDSExpressionItemType::Divide:
+			return Lhs / Rhs;
+		case ESUDSExpressionItemType::Modulo:
+			return Lhs % Rhs;
+		case ESUDSExpressionItemType::Add:
+			return Lhs + Rhs;
+		case ESUDSExpressionItemType::Subtract:
+			return Lhs - Rhs;
+		case ESUDSExpressionItemType::Less:
+			return Lhs < Rhs;
+		case ESUDSExpressionItemType::LessEqual:
+			return Lhs <= Rhs;
+		case ESUDSExpressionItemType::Greater:
+			return Lhs > Rhs;
+		case ESUDSExpressionItemType::GreaterEqual:
+			return Lhs >= Rhs;
+		case ESUDSExpressionItemType::Equal:
+			return Lhs == Rhs;
+		case ESUDSExpressionItemType::NotEqual:
+			return Lhs != Rhs;
+		case ESUDSExpressionItemType::And:
+			return Lhs && Rhs;
+		case ESUDSExpressionItemType::Or:
+			return Lhs || Rhs;
+		default:
+			checkf(false, TEXT("Unexpected operator"));
+			return FSUDSValue();
+		}
+	}
+
+	FSUDSExpressionFragment SimplifyBinaryOperator(ESUDSExpressionItemType Op,
+	                                               FSUDSExpressionFragment&& Lhs,
+	                                               FSUDSExpressionFragment&& Rhs,
+	                                               bool bIsCondition)
+	{
+		if (Lhs.IsLiteral() && Rhs.IsLiteral() && CanFoldLiterals(Op, Lhs.GetLiteral(), Rhs.GetLiteral()))
+		{
+			return FSUDSExpressionFragment(EvaluateLiterals(Op, Lhs.GetLiteral(), Rhs.GetLiteral()));
+		}
+
+		// An operand of 'and' / 'or' can stand in for the whole operation if we know it's boolean, or if the result
+		// is only going to be used as a condition anyway
+		auto CanReplaceBoolean = [bIsCondition](const FSUDSExpressionFragment& F)
+		{
+			return bIsCondition || F.ResultType == ESUDSValueType::Boolean;
+		};
+		// Only absorb operands which would have been valid at runtime anyway, and never drop calls since functions
+		// can have side effects
+		auto CanAbsorb = [](const FSUDSExpressionFragment& F)
+		{
+			return (F.ResultType == ESUDSValueType::Boolean || F.ResultType == ESUDSValueType::Variable) &&
+				!F.HasFunctionCall();
+		};
+		
+		switch (Op)
+		{
+		case ESUDSExpressionItemType::And:
+			if ((Lhs.IsBooleanLiteral(false) && CanAbsorb(Rhs)) || (Rhs.IsBooleanLiteral(false) && CanAbsorb(Lhs)))
+				return FSUDSExpressionFragment(FSUDSValue(false));
+			if (Lhs.IsBooleanLiteral(true) && CanReplaceBoolean(Rhs))
+				return MoveTemp(Rhs);
+			if (Rhs.IsBooleanLiteral(true) && CanReplaceBoolean(Lhs))
+				return MoveTemp(Lhs);
+			break;
+		case ESUDSExpressionItemType::Or:
+			if ((Lhs.IsBooleanLiteral(true) && CanAbsorb(Rhs)) || (Rhs.IsBooleanLiteral(true) && CanAbsorb(Lhs)))
+				return FSUDSExpressionFragment(FSUDSValue(true));
+			if (Lhs.IsBooleanLiteral(false) && CanReplaceBoolean(Rhs))
+				return MoveTemp(Rhs);
+			if (Rhs.IsBooleanLiteral(false) && CanReplaceBoolean(Lhs))
+				return MoveTemp(Lhs);
+			break;
+		case ESUDSExpressionItemType::Add:
+			if (Rhs.IsArithmeticIdentity(0, Lhs.ResultType))
+				return MoveTemp(Lhs);
+			if (Lhs.IsArithmeticIdentity(0, Rhs.ResultType))
+				return MoveTemp(Rhs);
+			break;
+		case ESUDSExpressionItemType::Subtract:
+			if (Rhs.IsArithmeticIdentity(0, Lhs.ResultType))
+				return MoveTemp(Lhs);
+			break;
+		case ESUDSExpressionItemType::Multiply:
+			if (Rhs.IsArithmeticIdentity(1, Lhs.ResultType))
+				return MoveTemp(Lhs);
+			if (Lhs.IsArithmeticIdentity(1, Rhs.ResultType))
+				return MoveTemp(Rhs);
+			break;
+		case ESUDSExpressionItemType::Divide:
+			if (Rhs.IsArithmeticIdentity(1, Lhs.ResultType))
+				return MoveTemp(Lhs);
+			break;
+		default:
+			break;
+		}
+
+		FSUDSExpressionFragment Ret = MoveTemp(Lhs);
+		Ret.ResultType = GetOperatorResultType(Op, Ret.ResultType, Rhs.ResultType);
+		Ret.Items.Append(MoveTemp(Rhs.Items));
+		Ret.Items.Add(FSUDSExpressionItem(Op));
+		return Ret;
+	}
+}
 
-	TArray<FSUDSExpressionItem> EvalStack;
-	// We could pre-optimise all literal expressions, but let's not for now
+bool FSUDSExpression::Optimise(bool bIsCondition)
+{
+	if (!bIsValid || Queue.IsEmpty())
+		return false;
+
+	const int OriginalLen = Queue.Num();
+	TArray<FSUDSExpressionFragment> Stack;
 	for (auto& Item : Queue)
 	{
-		if (Item.IsOperator())
+		if (Item.IsOperand())
 		{
-			FSUDSExpressionItem Arg1, Arg2;
-			// Arg2 (RHS) has to be popped first
-			if (Item.IsBinaryOperator())
+			FSUDSExpressionFragment& F = Stack.AddDefaulted_GetRef();
+			F.Items.Add(Item);
+			F.ResultType = Item.GetOperandValue().GetType();
+		}
+		else if (Item.IsFunctionCall())
+		{
+			// Functions can return something different every time, so are never folded
+			const int32 NumArgs = Item.GetNumArgs();
+			checkf(Stack.Num() >= NumArgs, TEXT("Args missing before function call, bad expression %s"), *SourceString);
+			FSUDSExpressionFragment Call;
+			for (int32 i = Stack.Num() - NumArgs; i < Stack.Num(); ++i)
 			{
-				checkf(!EvalStack.IsEmpty(), TEXT("Args missing before operator, bad expression"));
-				Arg2 = EvalStack.Pop();
+				Call.Items.Append(MoveTemp(Stack[i].Items));
+			}
+			Stack.SetNum(Stack.Num() - NumArgs);
+			Call.Items.Add(Item);
+			const FSUDSExpressionFunctionInfo* Info = USUDSSubsystem::FindExpressionFunction(Item.GetFunctionName());
+			Call.ResultType = Info ? Info->ReturnType : ESUDSValueType::Variable;
+			Stack.Push(MoveTemp(Call));
+		}
+		else if (!Item.IsBinaryOperator())
+		{
+			checkf(Stack.Num() > 0, TEXT("Args missing before operator, bad expression %s"), *SourceString);
+			FSUDSExpressionFragment& Arg = Stack.Top();
+			if (Arg.IsLiteral() && Arg.GetLiteral().GetType() == ESUDSValueType::Boolean)
+			{
+				Arg = FSUDSExpressionFragment(!Arg.GetLiteral());
+			}
+			else
+			{
+				Arg.Items.Add(Item);
+				Arg.ResultType = ESUDSValueType::Boolean;
 			}
-			checkf(!EvalStack.IsEmpty(), TEXT("Args missing before operator, bad expression"));
-			Arg1 = EvalStack.Pop();
-			EvalStack.Push(EvaluateOperator(Item.GetType(), Arg1, Arg2, Variables, GlobalVariables));
 		}
 		else
 		{
-			EvalStack.Push(Item);
+			checkf(Stack.Num() > 1, TEXT("Args missing before operator, bad expression %s"), *SourceString);
+			FSUDSExpressionFragment Rhs = Stack.Pop();
+			FSUDSExpressionFragment Lhs = Stack.Pop();
+			Stack.Push(SimplifyBinaryOperator(Item.GetType(), MoveTemp(Lhs), MoveTemp(Rhs), bIsCondition));
 		}
 	}
+	checkf(Stack.Num() == 1, TEXT("Expression should reduce to a single result: %s"), *SourceString);
+
+	Queue = MoveTemp(Stack[0].Items);
+	if (bIsCondition && IsLiteral() && GetLiteralValue().GetType() == ESUDSValueType::Boolean && GetBooleanLiteralValue())
+	{
+		// Always true is the same as no condition. Leave SourceString for reference
+		Queue.Empty();
+	}
 	
-	checkf(EvalStack.Num() == 1, TEXT("We should end with a single item in the eval stack and it should be an operand"));
+	// Every simplification shortens the queue
+	const bool bChanged = Queue.Num() != OriginalLen;
+	if (bChanged)
+	{
+		UpdateVariableNames();
+		Compile();
+	}
+	return bChanged;
+}
 
-	return EvaluateOperand(EvalStack.Top().GetOperandValue(), Variables, GlobalVariables);
+ESUDSValueType FSUDSExpression::GetOperandTypeHint(const FSUDSValue& Operand) const
+{
+	if (Operand.IsVariable())
+	{
+		if (const ESUDSValueType* Hint = VariableTypeHints.Find(Operand.GetVariableNameValue()))
+		{
+			return *Hint;
+		}
+	}
+	return Operand.GetType();
 }
 
-bool FSUDSExpression::EvaluateBoolean(const TMap<FName, FSUDSValue>& Variables, const TMap<FName, FSUDSValue>& GlobalVariables, const FString& ErrorContext) const
+void FSUDSExpression::SetVariableTypeHints(const TMap<FName, ESUDSValueType>& VariableTypes)
 {
-	const auto Result = Evaluate(Variables, GlobalVariables);
+	VariableTypeHints.Empty();
+	for (const FName& Name : VariableNames)
+	{
+		const ESUDSValueType* Type = VariableTypes.Find(Name);
+		if (Type && *Type != ESUDSValueType::Variable && *Type != ESUDSValueType::Empty)
+		{
+			VariableTypeHints.Add(Name, *Type);
+		}
+	}
+	Compile();
+}
 
-	if (Result.GetType() != ESUDSValueType::Boolean &&
-		Result.GetType() != ESUDSValueType::Variable) // Allow unresolved variable, will assume false
+ESUDSValueType FSUDSExpression::GetInferredResultType() const
+{
+	if (!bIsValid || Queue.IsEmpty())
+		return ESUDSValueType::Variable;
+
+	TArray<ESUDSValueType, TInlineAllocator<8>> TypeStack;
+	for (auto& Item : Queue)
 	{
-		UE_LOG(LogSUDS, Error, TEXT("%s: Condition '%s' did not return a boolean result"), *ErrorContext, *SourceString)
+		if (Item.IsOperand())
+		{
+			TypeStack.Push(GetOperandTypeHint(Item.GetOperandValue()));
+		}
+		else if (Item.IsFunctionCall())
+		{
+			TypeStack.SetNum(TypeStack.Num() - Item.GetNumArgs());
+			const FSUDSExpressionFunctionInfo* Info = USUDSSubsystem::FindExpressionFunction(Item.GetFunctionName());
+			TypeStack.Push(Info ? Info->ReturnType : ESUDSValueType::Variable);
+		}
+		else if (!Item.IsBinaryOperator())
+		{
+			TypeStack.Top() = ESUDSValueType::Boolean;
+		}
+		else
+		{
+			const ESUDSValueType RhsType = TypeStack.Pop();
+			TypeStack.Top() = GetOperatorResultType(Item.GetType(), TypeStack.Top(), RhsType);
+		}
 	}
+	return TypeStack.Top();
+}
 
-	return Result.GetBooleanValue();
+void FSUDSExpression::PostSerialize(const FArchive& Ar)
+{
+	if (Ar.IsLoading())
+	{
+		Compile();
+	}
 }
 
-FSUDSExpressionItem FSUDSExpression::EvaluateOperator(ESUDSExpressionItemType Op,
-                                                      const FSUDSExpressionItem& Arg1,
-                                                      const FSUDSExpressionItem& Arg2,
-                                                      const TMap<FName, FSUDSValue>& Variables,
-                                                      const TMap<FName, FSUDSValue>& GlobalVariables) const
+bool FSUDSExpression::ImportTextItem(const TCHAR*& Buffer, int32 PortFlags, UObject* Parent, FOutputDevice* ErrorText)
 {
-	const FSUDSValue Val1 = EvaluateOperand(Arg1.GetOperandValue(), Variables, GlobalVariables);
-	FSUDSValue Val2;
-	if (Arg1.IsBinaryOperator())
-	{
-		Val2 = EvaluateOperand(Arg2.GetOperandValue(), Variables, GlobalVariables);
-	}
-
-	switch (Op)
-	{
-	case ESUDSExpressionItemType::Not:
-		return FSUDSExpressionItem(!Val1);
-	case ESUDSExpressionItemType::Multiply:
-		return FSUDSExpressionItem(Val1 * Val2);
-	case ESUDSExpressionItemType::Divide:
-		return FSUDSExpressionItem(Val1 / Val2);
-	case ESUDSExpressionItemType::Modulo:
-		return FSUDSExpressionItem(Val1 % Val2);
-	case ESUDSExpressionItemType::Add:
-		return FSUDSExpressionItem(Val1 + Val2);
-	case ESUDSExpressionItemType::Subtract:
-		return FSUDSExpressionItem(Val1 - Val2);
-	case ESUDSExpressionItemType::Less:
-		return FSUDSExpressionItem(Val1 < Val2);
-	case ESUDSExpressionItemType::LessEqual:
-		return FSUDSExpressionItem(Val1 <= Val2);
-	case ESUDSExpressionItemType::Greater:
-		return FSUDSExpressionItem(Val1 > Val2);
-	case ESUDSExpressionItemType::GreaterEqual:
-		return FSUDSExpressionItem(Val1 >= Val2);
-	case ESUDSExpressionItemType::Equal:
-		return FSUDSExpressionItem(Val1 == Val2);
-	case ESUDSExpressionItemType::NotEqual:
-		return FSUDSExpressionItem(Val1 != Val2);
-	case ESUDSExpressionItemType::And:
-		return FSUDSExpressionItem(Val1 && Val2);
-	case ESUDSExpressionItemType::Or:
-		return FSUDSExpressionItem(Val1 || Val2);
+	// Use the standard property import rather than calling back into this
+	const TCHAR* Result = StaticStruct()->ImportText(Buffer, this, Parent, PortFlags, ErrorText, StaticStruct()->GetName(), false);
+	if (!Result)
+	{
+		return false;
+	}
+	Buffer = Result;
+	Compile();
+	return true;
+}
 
-		
-	default: // these won't occur
-	case ESUDSExpressionItemType::Null:
-	case ESUDSExpressionItemType::Operand:
-	case ESUDSExpressionItemType::LParens:
-	case ESUDSExpressionItemType::RParens:
-		return FSUDSExpressionItem();
+namespace
+{
+	// Runtime guards for the type-specialised operators
+	FORCEINLINE bool AreInts(const FSUDSValue& A, const FSUDSValue& B)
+	{
+		return A.GetType() == ESUDSValueType::Int && B.GetType() == ESUDSValueType::Int;
+	}
+	FORCEINLINE bool AreFloats(const FSUDSValue& A, const FSUDSValue& B)
+	{
+		return A.GetType() == ESUDSValueType::Float && B.GetType() == ESUDSValueType::Float;
+	}
+	/// Numeric, but not both int (which would keep an int result)
+	FORCEINLINE bool AreWidenedToFloat(const FSUDSValue& A, const FSUDSValue& B)
+	{
+		return A.IsNumeric() && B.IsNumeric() && !AreInts(A, B);
+	}
+
+	/// Fixed size evaluation stack over memory provided by the caller, so evaluating doesn't touch the heap.
+	/// Literals and variables are referenced where they live rather than copied, only the results of operators and
+	/// functions are held by value in the entry's own slot.
+	/// The references are kept contiguous so the top of the stack can be passed to functions as their args.
+	class FSUDSEvalStack
+	{
+	public:
+		static int32 GetMemorySize(int32 Capacity)
+		{
+			return Capacity * (sizeof(FSUDSValue) + sizeof(const FSUDSValue*));
+		}
+
+		static_assert(alignof(FSUDSValue) >= alignof(const FSUDSValue*), "Refs are placed straight after Values");
+
+		FSUDSEvalStack(void* Memory, int32 InCapacity)
+			: Values(static_cast<FSUDSValue*>(Memory)),
+			  Refs(reinterpret_cast<const FSUDSValue**>(Values + InCapacity)),
+			  Capacity(InCapacity)
+		{
+		}
+
+		~FSUDSEvalStack()
+		{
+			while (Count > 0)
+			{
+				Pop();
+			}
+		}
+
+		void PushRef(const FSUDSValue& Value)
+		{
+			checkf(Count < Capacity, TEXT("Expression evaluation stack overflow"));
+			new (&Values[Count]) FSUDSValue(ESUDSValueType::Empty);
+			Refs[Count++] = &Value;
+		}
+
+		void PushResult(FSUDSValue&& Result)
+		{
+			checkf(Count < Capacity, TEXT("Expression evaluation stack overflow"));
+			new (&Values[Count]) FSUDSValue(MoveTemp(Result));
+			Refs[Count] = &Values[Count];
+			++Count;
+		}
+
+		/// Replace an entry with a result, it's safe to pass a value which refers to the entry being replaced
+		void SetResult(int32 Index, FSUDSValue&& Result)
+		{
+			Values[Index] = MoveTemp(Result);
+			Refs[Index] = &Values[Index];
+		}
+
+		void Pop()
+		{
+			Values[--Count].~FSUDSValue();
+		}
+
+		const FSUDSValue& Get(int32 Index) const { return *Refs[Index]; }
+		const FSUDSValue& Top() const { return *Refs[Count - 1]; }
+		/// The top NumEntries entries, oldest first
+		TArrayView<const FSUDSValue* const> TopRefs(int32 NumEntries) const
+		{
+			return TArrayView<const FSUDSValue* const>(Refs + Count - NumEntries, NumEntries);
+		}
+		int32 Num() const { return Count; }
+		bool IsEmpty() const { return Count == 0; }
+
+	private:
+		FSUDSValue* Values;
+		const FSUDSValue** Refs;
+		int32 Capacity;
+		int32 Count = 0;
 	};
-	
 }
 
-FSUDSValue FSUDSExpression::EvaluateOperand(const FSUDSValue& Operand,
-                                            const TMap<FName, FSUDSValue>& Variables,
-                                            const TMap<FName, FSUDSValue>& GlobalVariables) const
+FSUDSValue FSUDSExpression::Evaluate(const TMap<FName, FSUDSValue>& Variables,
+                                     const TMap<FName, FSUDSValue>& GlobalVariables,
+                                     ISUDSExpressionVariableHandler* VariableHandler) const
 {
-	// Simplify conversion to variable values
-	if (Operand.IsVariable())
+	checkf(bIsValid, TEXT("Cannot execute an invalid expression tree"));
+
+	// Blanks are mostly used for conditionals, for simplicity always return true
+	if (Queue.IsEmpty())
+		return FSUDSValue(true);
+
+	// Everything which changes the queue compiles it, including loading & text import
+	if (!ensureMsgf(!Program.IsEmpty(), TEXT("Expression '%s' was evaluated without being compiled"), *SourceString))
 	{
-		FName Name = Operand.GetVariableNameValue();
-		FName GlobalName;
-		if (USUDSLibrary::IsDialogueVariableGlobal(Name, GlobalName))
+		return FSUDSValue();
+	}
+
+	FSUDSEvalStack EvalStack(FMemory_Alloca_Aligned(FSUDSEvalStack::GetMemorySize(MaxStackDepth), alignof(FSUDSValue)), MaxStackDepth);
+	for (int PC = 0; PC < Program.Num(); ++PC)
+	{
+		const FSUDSExpressionInstruction& Instr = Program[PC];
+		switch (Instr.OpCode)
 		{
-			// This will have stripped the prefix so direct find is OK
-			if (const auto Var = GlobalVariables.Find(GlobalName))
+		case ESUDSExpressionOpCode::PushConstant:
+			EvalStack.PushRef(Constants[Instr.Operand]);
+			continue;
+		case ESUDSExpressionOpCode::PushVariable:
+			{
+				const FSUDSExpressionVariable& Var = ProgramVariables[Instr.Operand];
+				if (VariableHandler)
+				{
+					FSUDSValue Provided;
+					if (VariableHandler->ProvideExpressionVariable(Var.Name, Provided))
+					{
+						EvalStack.PushResult(MoveTemp(Provided));
+						continue;
+					}
+					VariableHandler->OnExpressionVariableRequested(Var.Name);
+					// The handler can change the variable state, which could invalidate references into it, so copy
+					EvalStack.PushResult(FSUDSValue(EvaluateVariable(Var, Variables, GlobalVariables)));
+				}
+				else
+				{
+					EvalStack.PushRef(EvaluateVariable(Var, Variables, GlobalVariables));
+				}
+				continue;
+			}
+		case ESUDSExpressionOpCode::Not:
 			{
-				return *Var;
+				checkf(!EvalStack.IsEmpty(), TEXT("Args missing before operator, bad expression"));
+				EvalStack.SetResult(EvalStack.Num() - 1, !EvalStack.Top());
+				continue;
 			}
+		case ESUDSExpressionOpCode::JumpIfFalse:
+		case ESUDSExpressionOpCode::JumpIfTrue:
+			{
+				checkf(!EvalStack.IsEmpty(), TEXT("Args missing before operator, bad expression"));
+				const FSUDSValue& Lhs = EvalStack.Top();
+				// Same as FSUDSValue's && and ||, which don't get run if we skip: unset variables degrade to false,
+				// anything else which isn't boolean is an error rather than being coerced
+				check(Lhs.GetType() == ESUDSValueType::Boolean || Lhs.GetType() == ESUDSValueType::Variable);
+				const bool bJumpOn = Instr.OpCode == ESUDSExpressionOpCode::JumpIfTrue;
+				if (Lhs.GetBooleanValue() == bJumpOn)
+				{
+					// LHS decides the result, skip the RHS & the operator
+					EvalStack.SetResult(EvalStack.Num() - 1, FSUDSValue(bJumpOn));
+					PC += Instr.Operand;
+				}
+				continue;
+			}
+		case ESUDSExpressionOpCode::CallFunction:
+			{
+				const FSUDSExpressionFunctionCall& Call = ProgramFunctions[Instr.Operand];
+				checkf(EvalStack.Num() >= Call.NumArgs, TEXT("Args missing before function call, bad expression"));
+				FSUDSValue Result;
+				if (FSUDSExpressionFunction Function = Call.GetFunction())
+				{
+					// Args are passed straight from the stack, they're popped after the call
+					Result = Function(VariableHandler ? VariableHandler->GetExpressionDialogue() : nullptr,
+					                  FSUDSExpressionFunctionArgs(EvalStack.TopRefs(Call.NumArgs)));
+				}
+				else
+				{
+					UE_LOG(LogSUDS, Error, TEXT("Expression '%s' calls function '%s' which isn't registered"), *SourceString, *Call.Name.ToString());
+				}
+				for (int32 i = 0; i < Call.NumArgs; ++i)
+				{
+					EvalStack.Pop();
+				}
+				EvalStack.PushResult(MoveTemp(Result));
+				continue;
+			}
+		default:
+			break;
 		}
-		if (const auto Var = Variables.Find(Operand.GetVariableNameValue()))
+
+		// Everything else is a binary operator, Arg2 (RHS) is on top
+		checkf(EvalStack.Num() >= 2, TEXT("Args missing before operator, bad expression"));
+		const FSUDSValue& Val2 = EvalStack.Top();
+		const int32 Arg1Index = EvalStack.Num() - 2;
+		const FSUDSValue& Val1 = EvalStack.Get(Arg1Index);
+		switch (Instr.OpCode)
 		{
-			return *Var;
+		case ESUDSExpressionOpCode::Multiply:
+			EvalStack.SetResult(Arg1Index, Val1 * Val2);
+			break;
+		case ESUDSExpressionOpCode::Divide:
+			EvalStack.SetResult(Arg1Index, Val1 / Val2);
+			break;
+		case ESUDSExpressionOpCode::Modulo:
+			EvalStack.SetResult(Arg1Index, Val1 % Val2);
+			break;
+		case ESUDSExpressionOpCode::Add:
+			EvalStack.SetResult(Arg1Index, Val1 + Val2);
+			break;
+		case ESUDSExpressionOpCode::Subtract:
+			EvalStack.SetResult(Arg1Index, Val1 - Val2);
+			break;
+		case ESUDSExpressionOpCode::Less:
+			EvalStack.SetResult(Arg1Index, Val1 < Val2);
+			break;
+		case ESUDSExpressionOpCode::LessEqual:
+			EvalStack.SetResult(Arg1Index, Val1 <= Val2);
+			break;
+		case ESUDSExpressionOpCode::Greater:
+			EvalStack.SetResult(Arg1Index, Val1 > Val2);
+			break;
+		case ESUDSExpressionOpCode::GreaterEqual:
+			EvalStack.SetResult(Arg1Index, Val1 >= Val2);
+			break;
+		case ESUDSExpressionOpCode::Equal:
+			EvalStack.SetResult(Arg1Index, Val1 == Val2);
+			break;
+		case ESUDSExpressionOpCode::NotEqual:
+			EvalStack.SetResult(Arg1Index, Val1 != Val2);
+			break;
+		case ESUDSExpressionOpCode::And:
+			EvalStack.SetResult(Arg1Index, Val1 && Val2);
+			break;
+		case ESUDSExpressionOpCode::Or:
+			EvalStack.SetResult(Arg1Index, Val1 || Val2);
+			break;
+
+		// Type-specialised operators, falling back on generic if the types aren't what we expected at import
+		case ESUDSExpressionOpCode::MultiplyInt:
+			EvalStack.SetResult(Arg1Index, AreInts(Val1, Val2) ? FSUDSValue(Val1.GetIntValueUnchecked() * Val2.GetIntValueUnchecked()) : Val1 * Val2);
+			break;
+		case ESUDSExpressionOpCode::DivideInt:
+			EvalStack.SetResult(Arg1Index, AreInts(Val1, Val2) ? FSUDSValue(Val1.GetIntValueUnchecked() / Val2.GetIntValueUnchecked()) : Val1 / Val2);
+			break;
+		case ESUDSExpressionOpCode::ModuloInt:
+			EvalStack.SetResult(Arg1Index, AreInts(Val1, Val2) ? FSUDSValue(Val1.GetIntValueUnchecked() % Val2.GetIntValueUnchecked()) : Val1 % Val2);
+			break;
+		case ESUDSExpressionOpCode::AddInt:
+			EvalStack.SetResult(Arg1Index, AreInts(Val1, Val2) ? FSUDSValue(Val1.GetIntValueUnchecked() + Val2.GetIntValueUnchecked()) : Val1 + Val2);
+			break;
+		case ESUDSExpressionOpCode::SubtractInt:
+			EvalStack.SetResult(Arg1Index, AreInts(Val1, Val2) ? FSUDSValue(Val1.GetIntValueUnchecked() - Val2.GetIntValueUnchecked()) : Val1 - Val2);
+			break;
+		case ESUDSExpressionOpCode::LessInt:
+			EvalStack.SetResult(Arg1Index, AreInts(Val1, Val2) ? FSUDSValue(Val1.GetIntValueUnchecked() < Val2.GetIntValueUnchecked()) : Val1 < Val2);
+			break;
+		case ESUDSExpressionOpCode::LessEqualInt:
+			EvalStack.SetResult(Arg1Index, AreInts(Val1, Val2) ? FSUDSValue(Val1.GetIntValueUnchecked() <= Val2.GetIntValueUnchecked()) : Val1 <= Val2);
+			break;
+		case ESUDSExpressionOpCode::GreaterInt:
+			EvalStack.SetResult(Arg1Index, AreInts(Val1, Val2) ? FSUDSValue(Val1.GetIntValueUnchecked() > Val2.GetIntValueUnchecked()) : Val1 > Val2);
+			break;
+		case ESUDSExpressionOpCode::GreaterEqualInt:
+			EvalStack.SetResult(Arg1Index, AreInts(Val1, Val2) ? FSUDSValue(Val1.GetIntValueUnchecked() >= Val2.GetIntValueUnchecked()) : Val1 >= Val2);
+			break;
+		case ESUDSExpressionOpCode::EqualInt:
+			EvalStack.SetResult(Arg1Index, AreInts(Val1, Val2) ? FSUDSValue(Val1.GetIntValueUnchecked() == Val2.GetIntValueUnchecked()) : Val1 == Val2);
+			break;
+		case ESUDSExpressionOpCode::NotEqualInt:
+			EvalStack.SetResult(Arg1Index, AreInts(Val1, Val2) ? FSUDSValue(Val1.GetIntValueUnchecked() != Val2.GetIntValueUnchecked()) : Val1 != Val2);
+			break;
+		case ESUDSExpressionOpCode::MultiplyFloat:
+			EvalStack.SetResult(Arg1Index, AreWidenedToFloat(Val1, Val2) ? FSUDSValue(Val1.GetNumericValueAsFloatUnchecked() * Val2.GetNumericValueAsFloatUnchecked()) : Val1 * Val2);
+			break;
+		case ESUDSExpressionOpCode::DivideFloat:
+			EvalStack.SetResult(Arg1Index, AreWidenedToFloat(Val1, Val2) ? FSUDSValue(Val1.GetNumericValueAsFloatUnchecked() / Val2.GetNumericValueAsFloatUnchecked()) : Val1 / Val2);
+			break;
+		case ESUDSExpressionOpCode::ModuloFloat:
+			if (AreWidenedToFloat(Val1, Val2))
+			{
+				// Same protection against NaN as the generic operator
+				const float Divisor = Val2.GetNumericValueAsFloatUnchecked();
+				EvalStack.SetResult(Arg1Index, FSUDSValue(Divisor != 0 ? FMath::Fmod(Val1.GetNumericValueAsFloatUnchecked(), Divisor) : 0.0f));
+			}
+			else
+			{
+				EvalStack.SetResult(Arg1Index, Val1 % Val2);
+			}
+			break;
+		case ESUDSExpressionOpCode::AddFloat:
+			EvalStack.SetResult(Arg1Index, AreWidenedToFloat(Val1, Val2) ? FSUDSValue(Val1.GetNumericValueAsFloatUnchecked() + Val2.GetNumericValueAsFloatUnchecked()) : Val1 + Val2);
+			break;
+		case ESUDSExpressionOpCode::SubtractFloat:
+			EvalStack.SetResult(Arg1Index, AreWidenedToFloat(Val1, Val2) ? FSUDSValue(Val1.GetNumericValueAsFloatUnchecked() - Val2.GetNumericValueAsFloatUnchecked()) : Val1 - Val2);
+			break;
+		case ESUDSExpressionOpCode::LessFloat:
+			EvalStack.SetResult(Arg1Index, AreWidenedToFloat(Val1, Val2) ? FSUDSValue(Val1.GetNumericValueAsFloatUnchecked() < Val2.GetNumericValueAsFloatUnchecked()) : Val1 < Val2);
+			break;
+		case ESUDSExpressionOpCode::GreaterFloat:
+			EvalStack.SetResult(Arg1Index, AreWidenedToFloat(Val1, Val2) ? FSUDSValue(Val1.GetNumericValueAsFloatUnchecked() > Val2.GetNumericValueAsFloatUnchecked()) : Val1 > Val2);
+			break;
+		case ESUDSExpressionOpCode::LessEqualFloat:
+			EvalStack.SetResult(Arg1Index, AreFloats(Val1, Val2) ? FSUDSValue(Val1.GetNumericValueAsFloatUnchecked() <= Val2.GetNumericValueAsFloatUnchecked()) : Val1 <= Val2);
+			break;
+		case ESUDSExpressionOpCode::GreaterEqualFloat:
+			EvalStack.SetResult(Arg1Index, AreFloats(Val1, Val2) ? FSUDSValue(Val1.GetNumericValueAsFloatUnchecked() >= Val2.GetNumericValueAsFloatUnchecked()) : Val1 >= Val2);
+			break;
+		case ESUDSExpressionOpCode::EqualFloat:
+			EvalStack.SetResult(Arg1Index, AreFloats(Val1, Val2) ? FSUDSValue(Val1.GetNumericValueAsFloatUnchecked() == Val2.GetNumericValueAsFloatUnchecked()) : Val1 == Val2);
+			break;
+		case ESUDSExpressionOpCode::NotEqualFloat:
+			EvalStack.SetResult(Arg1Index, AreFloats(Val1, Val2) ? FSUDSValue(Val1.GetNumericValueAsFloatUnchecked() != Val2.GetNumericValueAsFloatUnchecked()) : Val1 != Val2);
+			break;
+		default:
+			checkf(false, TEXT("Unknown instruction in expression %s"), *SourceString);
+			break;
 		}
-		// Note: we're NOT warning about unset variables here, and just defaulting to initial values (false, 0 etc)
-		// This is more usable in practice than complaining about it
+		EvalStack.Pop();
+	}
+	
+	checkf(EvalStack.Num() == 1, TEXT("We should end with a single item in the eval stack and it should be an operand"));
+
+	return EvalStack.Top();
+}
+
+bool FSUDSExpression::EvaluateBoolean(const TMap<FName, FSUDSValue>& Variables,
+                                      const TMap<FName, FSUDSValue>& GlobalVariables,
+                                      const FString& ErrorContext,
+                                      ISUDSExpressionVariableHandler* VariableHandler) const
+{
+	const auto Result = Evaluate(Variables, GlobalVariables, VariableHandler);
+
+	if (Result.GetType() != ESUDSValueType::Boolean &&
+		Result.GetType() != ESUDSValueType::Variable) // Allow unresolved variable, will assume false
+	{
+		UE_LOG(LogSUDS, Error, TEXT("%s: Condition '%s' did not return a boolean result"), *ErrorContext, *SourceString)
 	}
 
-	return Operand;
+	return Result.GetBooleanValue();
+}
+
+const FSUDSValue& FSUDSExpression::EvaluateVariable(const FSUDSExpressionVariable& Var,
+                                                    const TMap<FName, FSUDSValue>& Variables,
+                                                    const TMap<FName, FSUDSValue>& GlobalVariables) const
+{
+	if (Var.Name.bIsGlobal)
+	{
+		// Prefix already stripped so direct find is OK
+		if (const auto Val = GlobalVariables.Find(Var.Name.ScopedName))
+		{
+			return *Val;
+		}
+	}
+	if (const auto Val = Variables.Find(Var.Name.Name))
+	{
+		return *Val;
+	}
+	// Note: we're NOT warning about unset variables here, and just defaulting to initial values (false, 0 etc)
+	// This is more usable in practice than complaining about it
+	return Var.Unset;
 }
@@ -21,6 +21,16 @@ inline const TMap<FName, FSUDSValue>& InternalGetGlobalVariables(UWorld* WorldCo
 	
 }
 
+/// Versions of global variables, or null if they can't be tracked (dummy globals used by tests are changed directly)
+inline const FSUDSVariableVersions* InternalGetGlobalVariableVersions(UWorld* WorldContext)
+{
+	if (auto Sub = GetSUDSSubsystem(WorldContext))
+	{
+		return &Sub->GetGlobalVariableVersions();
+	}
+	return nullptr;
+}
+
 // For our code only
 inline void InternalSetGlobalVariable(UWorld* WorldContext, FName Name, const FSUDSValue& Value, bool bFromScript, const FString& ScriptName, int LineNo)
 {
@@ -2,7 +2,9 @@
 // Released under the MIT license https://opensource.org/license/MIT/
 #include "SUDSScript.h"
 
+#include "SUDSCommon.h"
 #include "SUDSScriptNode.h"
+#include "SUDSScriptGraph.h"
 #include "SUDSScriptNodeGosub.h"
 #include "SUDSScriptNodeText.h"
 #include "EditorFramework/AssetImportData.h"
@@ -18,16 +20,243 @@ void USUDSScript::StartImport(TArray<TObjectPtr<USUDSScriptNode>>** ppNodes,
 	*ppLabelList = &LabelList;
 	*ppHeaderLabelList = &HeaderLabelList;
 	*ppSpeakerList = &Speakers;
+
+	Expressions.Empty();
+	ExpressionLookup.Empty();
+	++ImportGeneration;
+	Graph.Reset();
+	TextIDLookup.Empty();
+	GosubIDLookup.Empty();
+}
+
+int32 USUDSScript::AddExpression(const FSUDSExpression& Expression)
+{
+	if (Expression.IsValid() && Expression.IsEmpty() && Expression.GetSourceString().IsEmpty())
+	{
+		// Blank, nodes & edges share a single blank expression instead
+		return INDEX_NONE;
+	}
+
+	const uint32 Hash = HashCombine(GetTypeHash(Expression.GetSourceString()), GetTypeHash(Expression.GetQueue().Num()));
+	TArray<int32, TInlineAllocator<4>> Candidates;
+	ExpressionLookup.MultiFind(Hash, Candidates);
+	for (const int32 Idx : Candidates)
+	{
+		if (Expressions[Idx].IsIdenticalTo(Expression))
+		{
+			return Idx;
+		}
+	}
+
+	const int32 NewIdx = Expressions.Add(Expression);
+	ExpressionLookup.Add(Hash, NewIdx);
+	return NewIdx;
+}
+
+void USUDSScript::BindExpressions()
+{
+	for (auto Node : Nodes)
+	{
+		if (Node)
+		{
+			Node->BindExpressions(Expressions);
+		}
+	}
+	for (auto Node : HeaderNodes)
+	{
+		if (Node)
+		{
+			Node->BindExpressions(Expressions);
+		}
+	}
+}
+
+void USUDSScript::PrepareTextFormats(bool bExtractParameterNames)
+{
+	for (auto Node : Nodes)
+	{
+		if (Node)
+		{
+			Node->PrepareTextFormats(bExtractParameterNames);
+		}
+	}
+	for (auto Node : HeaderNodes)
+	{
+		if (Node)
+		{
+			Node->PrepareTextFormats(bExtractParameterNames);
+		}
+	}
+}
+
+void USUDSScript::BuildGraph()
+{
+	Graph.Build(ObjectPtrDecay(Nodes), ObjectPtrDecay(HeaderNodes), LabelList);
+}
+
+void USUDSScript::BuildSpeakerTable()
+{
+	static const FString SpeakerIDPrefix = "SpeakerName.";
+
+	SpeakerTable.Empty(Speakers.Num());
+	TMap<FString, int32> SpeakerIndexLookup;
+	auto AddSpeaker = [&](const FString& SpeakerID)
+	{
+		FSUDSSpeakerInfo& Info = SpeakerTable.AddDefaulted_GetRef();
+		Info.SpeakerID = SpeakerID;
+		Info.DisplayNameKey = FName(SpeakerIDPrefix + SpeakerID);
+		Info.Voice = GetSpeakerVoice(SpeakerID);
+		return SpeakerIndexLookup.Add(SpeakerID, SpeakerTable.Num() - 1);
+	};
+	for (const auto& SpeakerID : Speakers)
+	{
+		if (!SpeakerIndexLookup.Contains(SpeakerID))
+		{
+			AddSpeaker(SpeakerID);
+		}
+	}
+	// Only the listed speakers are candidates for targets, as before
+	const int32 NumListed = SpeakerTable.Num();
+
+	auto BindNodes = [&](const TArray<TObjectPtr<USUDSScriptNode>>& InNodes)
+	{
+		for (auto Node : InNodes)
+		{
+			if (auto TN = Cast<USUDSScriptNodeText>(Node))
+			{
+				const int32* pIndex = SpeakerIndexLookup.Find(TN->GetSpeakerID());
+				TN->SetSpeakerIndex(pIndex ? *pIndex : AddSpeaker(TN->GetSpeakerID()));
+			}
+		}
+	};
+	BindNodes(Nodes);
+	BindNodes(HeaderNodes);
+	RefreshHasVoicedLines();
+
+	for (int32 i = 0; i < SpeakerTable.Num(); ++i)
+	{
+		for (int32 t = 0; t < NumListed; ++t)
+		{
+			if (t != i)
+			{
+				SpeakerTable[i].DefaultTargetIndex = t;
+				break;
+			}
+		}
+	}
+}
+
+void USUDSScript::RefreshHasVoicedLines()
+{
+	bHasVoicedLines = false;
+	for (auto Node : Nodes)
+	{
+		auto TN = Cast<USUDSScriptNodeText>(Node);
+		if (TN && TN->HasWave())
+		{
+			bHasVoicedLines = true;
+			break;
+		}
+	}
+}
+
+void USUDSScript::BuildIDLookups()
+{
+	TextIDLookup.Empty();
+	GosubIDLookup.Empty();
+	for (int32 i = 0; i < Nodes.Num(); ++i)
+	{
+		const USUDSScriptNode* N = Nodes[i];
+		if (!N)
+			continue;
+
+		// If IDs are duplicated, the first node wins as it did when we searched linearly
+		if (N->GetNodeType() == ESUDSScriptNodeType::Text)
+		{
+			if (auto TN = Cast<USUDSScriptNodeText>(N))
+			{
+				const FString TextID = TN->GetTextID();
+				if (!TextIDLookup.Contains(TextID))
+				{
+					TextIDLookup.Add(TextID, i);
+				}
+			}
+		}
+		else if (N->GetNodeType() == ESUDSScriptNodeType::Gosub)
+		{
+			if (auto GN = Cast<USUDSScriptNodeGosub>(N))
+			{
+				if (!GosubIDLookup.Contains(GN->GetGosubID()))
+				{
+					GosubIDLookup.Add(GN->GetGosubID(), i);
+				}
+			}
+		}
+	}
+}
+
+void USUDSScript::UpgradeExpressions()
+{
+	// Scripts saved before the expression pool existed have their expressions inline on nodes & edges
+	bool bUpgraded = false;
+	for (auto Node : Nodes)
+	{
+		if (Node)
+		{
+			bUpgraded |= Node->UpgradeExpressions(*this);
+		}
+	}
+	for (auto Node : HeaderNodes)
+	{
+		if (Node)
+		{
+			bUpgraded |= Node->UpgradeExpressions(*this);
+		}
+	}
+	ExpressionLookup.Empty();
+
+	if (bUpgraded)
+	{
+		UE_LOG(LogSUDS,
+		       Warning,
+		       TEXT("%s was saved by an older version of SUDS and has been upgraded on load. Re-import or re-save it to avoid this."),
+		       *GetPathName());
+	}
+}
+
+void USUDSScript::PostLoad()
+{
+	Super::PostLoad();
+	UpgradeExpressions();
+	BindExpressions();
+	PrepareTextFormats(false);
+	BuildGraph();
+	BuildSpeakerTable();
+	if (TextIDLookup.Num() == 0 && GosubIDLookup.Num() == 0)
+	{
+		// Assets imported before the lookups were saved
+		BuildIDLookups();
+	}
+}
+
+void USUDSScript::PostDuplicate(bool bDuplicateForPIE)
+{
+	Super::PostDuplicate(bDuplicateForPIE);
+	BindExpressions();
+	PrepareTextFormats(false);
+	BuildGraph();
+	BuildSpeakerTable();
 }
 
 USUDSScriptNode* USUDSScript::GetNextNode(const USUDSScriptNode* Node) const
 {
-	switch (Node->GetEdgeCount())
+	const TArrayView<const FSUDSScriptGraphEdge> Edges = Graph.GetEdges(Node->GetGraphIndex());
+	switch (Edges.Num())
 	{
 	case 0:
 		return nullptr;
 	case 1:
-		return Node->GetEdge(0)->GetTargetNode().Get();
+		return Graph.GetNodeObject(Edges[0].TargetNode);
 	default:
 		UE_LOG(LogSUDS, Error, TEXT("Called GetNextNode on a node with more than one edge"));
 		return nullptr;
@@ -39,9 +268,12 @@ USUDSScriptNode* USUDSScript::GetNextNode(const USUDSScriptNode* Node) const
 #define kChoiceFound 1
 #define kChoiceNotFoundBeforeText -1
 #define kChoiceNotFoundBeforeEnd 0 
+// Memo states for nodes we don't have a result for yet
+#define kChoiceSearchNotVisited 2
+#define kChoiceSearchInProgress 3
 
 
-bool USUDSScript::DoesAnyPathAfterLeadToChoice(USUDSScriptNode* FromNode)
+bool USUDSScript::DoesAnyPathAfterLeadToChoice(USUDSScriptNode* FromNode, TArray<int8>& Results)
 {
 	// Look for any possible choice following a node (text or gosub)
 	// If it's possible to find a choice in one of the paths ahead, before another text node, the return true
@@ -50,42 +282,77 @@ bool USUDSScript::DoesAnyPathAfterLeadToChoice(USUDSScriptNode* FromNode)
 	// For a gosub this is looking for the next after a return, not inside the sub
 	USUDSScriptNode* CurrNode = GetNextNode(FromNode);
 
-	return RecurseLookForChoice(CurrNode) == kChoiceFound;
+	bool bHitCycle = false;
+	return RecurseLookForChoice(CurrNode, Results, bHitCycle) == kChoiceFound;
 }
 
 
-int USUDSScript::RecurseLookForChoice(USUDSScriptNode* CurrNode)
+int USUDSScript::RecurseLookForChoice(USUDSScriptNode* CurrNode, TArray<int8>& Results, bool& bOutHitCycle)
 {
 	// Return int so that we can differentiate:
 	// 1  = we found a choice
 	// 0  = we didn't find a choice, but also didn't hit another text node (reached end, or gosub return)
 	// -1 = we hit a text node
-	while (CurrNode)
+	// The result only depends on the node we start from, so it's memoised per node in Results (indexed by graph
+	// index), and shared with every node on the straight run we follow. Without this, sequences of selects and shared
+	// gosubs are explored once per path, which is exponential.
+	// If we loop back to a node still being explored, that path contributes nothing; results which depended on that
+	// aren't memoised since they're only partial
+	TArray<int32, TInlineAllocator<16>> Visited;
+	bool bHitCycle = false;
+	int Result = kChoiceNotFoundBeforeEnd;
+	bool bDone = false;
+	while (CurrNode && !bDone)
 	{
+		const int32 NodeIdx = CurrNode->GetGraphIndex();
+		if (!Results.IsValidIndex(NodeIdx))
+			break;
+		const int8 Memo = Results[NodeIdx];
+		if (Memo == kChoiceSearchInProgress)
+		{
+			bHitCycle = true;
+			break;
+		}
+		if (Memo != kChoiceSearchNotVisited)
+		{
+			Result = Memo;
+			break;
+		}
+		Results[NodeIdx] = kChoiceSearchInProgress;
+		Visited.Add(NodeIdx);
+		
 		switch (CurrNode->GetNodeType())
 		{
 		case ESUDSScriptNodeType::Text:
 			// if we hit a text node, there was no choice
-			return kChoiceNotFoundBeforeText;
+			Result = kChoiceNotFoundBeforeText;
+			bDone = true;
+			break;
 		case ESUDSScriptNodeType::Choice:
 			// we found a choice
-			return kChoiceFound;
+			Result = kChoiceFound;
+			bDone = true;
+			break;
 		case ESUDSScriptNodeType::Select:
 			{
 				// Explore all possible routes
 				int WorstResult = kChoiceNotFoundBeforeEnd;
-				for (auto& Edge : CurrNode->GetEdges())
+				for (const FSUDSScriptGraphEdge& Edge : Graph.GetEdges(NodeIdx))
 				{
-					auto TargetNode = Edge.GetTargetNode();
-					if (TargetNode.IsValid())
+					if (USUDSScriptNode* TargetNode = Graph.GetNodeObject(Edge.TargetNode))
 					{
-						const int ConditionalPath = RecurseLookForChoice(TargetNode.Get());
+						const int ConditionalPath = RecurseLookForChoice(TargetNode, Results, bHitCycle);
 						if (ConditionalPath == kChoiceFound)
-							return kChoiceFound;
+						{
+							WorstResult = kChoiceFound;
+							break;
+						}
 						WorstResult = FMath::Min(ConditionalPath, WorstResult);
 					}
 				}
-				return WorstResult;
+				Result = WorstResult;
+				bDone = true;
+				break;
 			}
 		case ESUDSScriptNodeType::Event:
 		case ESUDSScriptNodeType::SetVariable:
@@ -93,13 +360,14 @@ int USUDSScript::RecurseLookForChoice(USUDSScriptNode* CurrNode)
 			break;
 		case ESUDSScriptNodeType::Gosub:
 			// When we hit a gosub here we go into it, not after it
-			if (auto GosubNode = Cast<USUDSScriptNodeGosub>(CurrNode))
 			{
-				int SubResult = RecurseLookForChoice(GetNodeByLabel(GosubNode->GetLabelName()));
+				int SubResult = RecurseLookForChoice(Graph.GetGosubTarget(NodeIdx), Results, bHitCycle);
 				if (SubResult != 0)
 				{
 					// Found definitive result (choice or text) inside sub
-					return SubResult;
+					Result = SubResult;
+					bDone = true;
+					break;
 				}
 			}
 			// Otherwise, we didn't conclude within the sub, continue following it
@@ -108,24 +376,45 @@ int USUDSScript::RecurseLookForChoice(USUDSScriptNode* CurrNode)
 		default: ;
 		case ESUDSScriptNodeType::Return:
 			// this is when we're exploring a sub for the choice
-			return kChoiceNotFoundBeforeEnd; 
+			Result = kChoiceNotFoundBeforeEnd;
+			bDone = true;
+			break;
 		};
 	}
 
-	return kChoiceNotFoundBeforeEnd;
+	// A found choice is definitive even if a loop was involved
+	const bool bMemoise = !bHitCycle || Result == kChoiceFound;
+	for (const int32 Idx : Visited)
+	{
+		Results[Idx] = bMemoise ? Result : kChoiceSearchNotVisited;
+	}
+	bOutHitCycle |= bHitCycle;
+	return Result;
 }
 
 void USUDSScript::FinishImport()
 {
+	// The pool is complete, so it's now safe to point at its contents
+	ExpressionLookup.Empty();
+	BindExpressions();
+	// Text is all in the string table now, so parameters can be extracted & saved
+	PrepareTextFormats(true);
+	BuildGraph();
+	BuildSpeakerTable();
+	BuildIDLookups();
+
 	// As an optimisation, make all text/gosub nodes pre-scan their follow-on nodes for choice nodes
 	// We can actually have intermediate nodes, for example set nodes which run for all choices that are placed
 	// between the text and the first choice. Resolve whether they exist now
+	// Results are shared across all nodes, since paths after different nodes converge
+	TArray<int8> ChoiceSearchResults;
+	ChoiceSearchResults.Init(kChoiceSearchNotVisited, Graph.Num());
 	for (auto Node : Nodes)
 	{
 		if (Node->GetNodeType() == ESUDSScriptNodeType::Text ||
 			Node->GetNodeType() == ESUDSScriptNodeType::Gosub)
 		{
-			if (DoesAnyPathAfterLeadToChoice(Node))
+			if (DoesAnyPathAfterLeadToChoice(Node, ChoiceSearchResults))
 			{
 				switch (Node->GetNodeType())
 				{
@@ -182,17 +471,11 @@ USUDSScriptNode* USUDSScript::GetNodeByLabel(const FName& Label) const
 
 USUDSScriptNodeText* USUDSScript::GetNodeByTextID(const FString& TextID) const
 {
-	for (auto N : Nodes)
+	if (const int32* pIdx = TextIDLookup.Find(TextID))
 	{
-		if (N->GetNodeType() == ESUDSScriptNodeType::Text)
+		if (Nodes.IsValidIndex(*pIdx))
 		{
-			if (auto TN = Cast<USUDSScriptNodeText>(N))
-			{
-				if (TextID.Equals(TN->GetTextID()))
-				{
-					return TN;
-				}
-			}
+			return Cast<USUDSScriptNodeText>(Nodes[*pIdx]);
 		}
 	}
 	return nullptr;
@@ -200,17 +483,11 @@ USUDSScriptNodeText* USUDSScript::GetNodeByTextID(const FString& TextID) const
 
 USUDSScriptNodeGosub* USUDSScript::GetNodeByGosubID(const FString& ID) const
 {
-	for (auto N : Nodes)
+	if (const int32* pIdx = GosubIDLookup.Find(ID))
 	{
-		if (N->GetNodeType() == ESUDSScriptNodeType::Text)
+		if (Nodes.IsValidIndex(*pIdx))
 		{
-			if (auto GN = Cast<USUDSScriptNodeGosub>(N))
-			{
-				if (ID.Equals(GN->GetGosubID()))
-				{
-					return GN;
-				}
-			}
+			return Cast<USUDSScriptNodeGosub>(Nodes[*pIdx]);
 		}
 	}
 	return nullptr;
@@ -228,6 +505,17 @@ UDialogueVoice* USUDSScript::GetSpeakerVoice(const FString& SpeakerID) const
 void USUDSScript::SetSpeakerVoice(const FString& SpeakerID, UDialogueVoice* Voice)
 {
 	SpeakerVoices.Add(SpeakerID, Voice);
+	// Update in place rather than rebuild, so existing speaker info isn't reallocated. Speakers without an entry have
+	// no lines, so don't need one
+	for (FSUDSSpeakerInfo& Info : SpeakerTable)
+	{
+		// Same as the SpeakerVoices lookup
+		if (Info.SpeakerID.Equals(SpeakerID, ESearchCase::IgnoreCase))
+		{
+			Info.Voice = Voice;
+		}
+	}
+	++VoiceGeneration;
 }
 
 #if WITH_EDITORONLY_DATA
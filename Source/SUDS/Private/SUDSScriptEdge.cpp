@@ -2,6 +2,7 @@
 // Released under the MIT license https://opensource.org/license/MIT/
 #include "SUDSScriptEdge.h"
 
+#include "SUDSScript.h"
 #include "SUDSScriptNode.h"
 
 
@@ -18,18 +19,36 @@ FSUDSScriptEdge::FSUDSScriptEdge(const FText& InText, USUDSScriptNode* ToNode, i
 {
 }
 
-void FSUDSScriptEdge::ExtractFormat() const
+void FSUDSScriptEdge::PrepareTextFormat(bool bExtractParameterNames)
 {
-	// Only do this on demand, and only once
+	if (Text.IsEmpty())
+	{
+		// Not a choice, or a choice without text
+		TextFormat = FTextFormat();
+		ParameterNames.Empty();
+		ParameterVariables.Empty();
+		bParameterNamesExtracted = true;
+		return;
+	}
+	
+	// FTextFormat compiles again by itself if the text changes, e.g. because of a culture change
 	TextFormat = Text;
-	ParameterNames.Empty();
-	TArray<FString> TextParams;
-	TextFormat.GetFormatArgumentNames(TextParams);
-	for (auto Param : TextParams)
+	if (bExtractParameterNames || !bParameterNamesExtracted)
+	{
+		ParameterNames.Empty();
+		TArray<FString> TextParams;
+		TextFormat.GetFormatArgumentNames(TextParams);
+		for (const auto& Param : TextParams)
+		{
+			ParameterNames.Add(FName(Param));
+		}
+		bParameterNamesExtracted = true;
+	}
+	ParameterVariables.Empty(ParameterNames.Num());
+	for (const auto& Name : ParameterNames)
 	{
-		ParameterNames.Add(FName(Param));
+		ParameterVariables.Emplace(Name);
 	}
-	bFormatExtracted = true;
 }
 
 FString FSUDSScriptEdge::GetTextID() const
@@ -40,40 +59,30 @@ FString FSUDSScriptEdge::GetTextID() const
 void FSUDSScriptEdge::SetText(const FText& InText)
 {
 	Text = InText;
-	bFormatExtracted = false;
-}
-
-void FSUDSScriptEdge::SetTargetNode(const TWeakObjectPtr<USUDSScriptNode>& InTargetNode)
-{
-	TargetNode = InTargetNode;
+	// Prepared again when the script finishes importing
+	bParameterNamesExtracted = false;
 }
 
-const FTextFormat& FSUDSScriptEdge::GetTextFormat() const
+bool FSUDSScriptEdge::UpgradeCondition(USUDSScript& Script)
 {
-	if (!bFormatExtracted)
+	if (ConditionIndex != INDEX_NONE || Condition_DEPRECATED.IsEmpty())
 	{
-		ExtractFormat();
+		return false;
 	}
-	return TextFormat;
-	
+	ConditionIndex = Script.AddExpression(Condition_DEPRECATED);
+	Condition_DEPRECATED = FSUDSExpression();
+	return true;
 }
 
-const TArray<FName>& FSUDSScriptEdge::GetParameterNames() const
+void FSUDSScriptEdge::SetTargetNode(const TWeakObjectPtr<USUDSScriptNode>& InTargetNode)
 {
-	if (!bFormatExtracted)
-	{
-		ExtractFormat();
-	}
-	return ParameterNames;
-	
+	TargetNode = InTargetNode;
+	TargetNodeIndex = INDEX_NONE;
 }
 
-bool FSUDSScriptEdge::HasParameters() const
+void FSUDSScriptEdge::BindTargetNodeIndex()
 {
-	if (!bFormatExtracted)
-	{
-		ExtractFormat();
-	}
-	return !ParameterNames.IsEmpty();
-	
+	const USUDSScriptNode* Target = TargetNode.Get();
+	TargetNodeIndex = Target ? Target->GetGraphIndex() : INDEX_NONE;
 }
+
@@ -0,0 +1,73 @@
+﻿// Copyright Steve Streeting 2022
+// Released under the MIT license https://opensource.org/license/MIT/
+#include "SUDSScriptGraph.h"
+
+#include "SUDSScriptNodeGosub.h"
+
+void FSUDSScriptGraph::Build(const TArray<USUDSScriptNode*>& InNodes,
+                             const TArray<USUDSScriptNode*>& InHeaderNodes,
+                             const TMap<FName, int>& LabelList)
+{
+	Reset();
+
+	NodeObjects.Reserve(InNodes.Num() + InHeaderNodes.Num());
+	NodeObjects.Append(InNodes);
+	NodeObjects.Append(InHeaderNodes);
+
+	// Indexes first, so that edges can resolve their targets
+	int32 NumEdges = 0;
+	for (int32 i = 0; i < NodeObjects.Num(); ++i)
+	{
+		if (USUDSScriptNode* Node = NodeObjects[i])
+		{
+			Node->SetGraphIndex(i);
+			NumEdges += Node->GetEdgeCount();
+		}
+	}
+
+	Nodes.Reserve(NodeObjects.Num());
+	Edges.Reserve(NumEdges);
+	for (USUDSScriptNode* Node : NodeObjects)
+	{
+		FSUDSScriptGraphNode& Record = Nodes.AddDefaulted_GetRef();
+		Record.FirstEdge = Edges.Num();
+		if (!Node)
+			continue;
+
+		Node->BindEdgeTargets();
+		Record.Type = Node->GetNodeType();
+		Record.NumEdges = Node->GetEdgeCount();
+		for (const FSUDSScriptEdge& Edge : Node->GetEdges())
+		{
+			FSUDSScriptGraphEdge& EdgeRecord = Edges.AddDefaulted_GetRef();
+			EdgeRecord.TargetNode = Edge.GetTargetNodeIndex();
+			EdgeRecord.ConditionIndex = Edge.GetConditionIndex();
+			EdgeRecord.SourceLineNo = Edge.GetSourceLineNo();
+			EdgeRecord.Type = Edge.GetType();
+		}
+
+		switch (Record.Type)
+		{
+		case ESUDSScriptNodeType::Gosub:
+			if (const USUDSScriptNodeGosub* GosubNode = Cast<USUDSScriptNodeGosub>(Node))
+			{
+				// Labels always refer to main nodes, which come first so have the same index
+				const int* pLabelIdx = LabelList.Find(GosubNode->GetLabelName());
+				Record.Payload = pLabelIdx ? *pLabelIdx : INDEX_NONE;
+			}
+			break;
+		case ESUDSScriptNodeType::Select:
+			Record.Payload = Node->IsRandomSelect() ? 1 : 0;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void FSUDSScriptGraph::Reset()
+{
+	Nodes.Reset();
+	Edges.Reset();
+	NodeObjects.Reset();
+}
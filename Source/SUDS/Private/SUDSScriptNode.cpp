@@ -36,3 +36,37 @@ void USUDSScriptNode::AddEdge(const FSUDSScriptEdge& NewEdge)
 	Edges.Add(NewEdge);
 }
 
+void USUDSScriptNode::BindExpressions(const TArray<FSUDSExpression>& Pool)
+{
+	for (auto& Edge : Edges)
+	{
+		Edge.BindCondition(Pool);
+	}
+}
+
+bool USUDSScriptNode::UpgradeExpressions(USUDSScript& Script)
+{
+	bool bUpgraded = false;
+	for (auto& Edge : Edges)
+	{
+		bUpgraded |= Edge.UpgradeCondition(Script);
+	}
+	return bUpgraded;
+}
+
+void USUDSScriptNode::PrepareTextFormats(bool bExtractParameterNames)
+{
+	for (auto& Edge : Edges)
+	{
+		Edge.PrepareTextFormat(bExtractParameterNames);
+	}
+}
+
+void USUDSScriptNode::BindEdgeTargets()
+{
+	for (auto& Edge : Edges)
+	{
+		Edge.BindTargetNodeIndex();
+	}
+}
+
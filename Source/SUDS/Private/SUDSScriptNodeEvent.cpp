@@ -2,11 +2,40 @@
 // Released under the MIT license https://opensource.org/license/MIT/
 #include "SUDSScriptNodeEvent.h"
 
-void USUDSScriptNodeEvent::Init(const FString& EvtName, const TArray<FSUDSExpression>& InArgs, int LineNo)
+#include "SUDSScript.h"
+
+void USUDSScriptNodeEvent::Init(const FString& EvtName, const TArray<int32>& InArgIndices, int LineNo)
 {
 	NodeType = ESUDSScriptNodeType::Event;
 	EventName = FName(EvtName);
-	Args = InArgs;
+	ArgIndices = InArgIndices;
+	Args.Empty();
 	SourceLineNo = LineNo;
 	
 }
+
+bool USUDSScriptNodeEvent::UpgradeExpressions(USUDSScript& Script)
+{
+	bool bUpgraded = Super::UpgradeExpressions(Script);
+	if (ArgIndices.IsEmpty() && !Args_DEPRECATED.IsEmpty())
+	{
+		for (const auto& Arg : Args_DEPRECATED)
+		{
+			// Blank args stay as INDEX_NONE, which binds to the blank expression
+			ArgIndices.Add(Script.AddExpression(Arg));
+		}
+		Args_DEPRECATED.Empty();
+		bUpgraded = true;
+	}
+	return bUpgraded;
+}
+
+void USUDSScriptNodeEvent::BindExpressions(const TArray<FSUDSExpression>& Pool)
+{
+	Super::BindExpressions(Pool);
+	Args.Empty(ArgIndices.Num());
+	for (const int32 Idx : ArgIndices)
+	{
+		Args.Add(Pool.IsValidIndex(Idx) ? &Pool[Idx] : &FSUDSExpression::GetBlank());
+	}
+}
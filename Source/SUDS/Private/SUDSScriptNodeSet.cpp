@@ -2,10 +2,42 @@
 // Released under the MIT license https://opensource.org/license/MIT/
 #include "SUDSScriptNodeSet.h"
 
-void USUDSScriptNodeSet::Init(const FString& VarName, const FSUDSExpression& InExpression, int LineNo)
+#include "SUDSScript.h"
+
+void USUDSScriptNodeSet::Init(const FString& VarName, int32 InExpressionIndex, int LineNo)
 {
 	NodeType = ESUDSScriptNodeType::SetVariable;
 	Identifier = FName(VarName);
-	Expression = InExpression;
+	ScopedIdentifier = FSUDSScopedVariableName(Identifier);
+	ExpressionIndex = InExpressionIndex;
+	Expression = nullptr;
 	SourceLineNo = LineNo;
 }
+
+void USUDSScriptNodeSet::BindExpressions(const TArray<FSUDSExpression>& Pool)
+{
+	Super::BindExpressions(Pool);
+	Expression = Pool.IsValidIndex(ExpressionIndex) ? &Pool[ExpressionIndex] : nullptr;
+}
+
+bool USUDSScriptNodeSet::UpgradeExpressions(USUDSScript& Script)
+{
+	bool bUpgraded = Super::UpgradeExpressions(Script);
+	if (ExpressionIndex == INDEX_NONE && !Expression_DEPRECATED.IsEmpty())
+	{
+		ExpressionIndex = Script.AddExpression(Expression_DEPRECATED);
+		Expression_DEPRECATED = FSUDSExpression();
+		bUpgraded = true;
+	}
+	return bUpgraded;
+}
+
+void USUDSScriptNodeSet::Serialize(FArchive& Ar)
+{
+	Super::Serialize(Ar);
+	// Covers both loading and duplication
+	if (Ar.IsLoading())
+	{
+		ScopedIdentifier = FSUDSScopedVariableName(Identifier);
+	}
+}
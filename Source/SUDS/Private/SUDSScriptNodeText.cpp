@@ -7,9 +7,9 @@ void USUDSScriptNodeText::Init(const FString& InSpeakerID, const FText& InText,
 	NodeType = ESUDSScriptNodeType::Text;
 	SpeakerID = InSpeakerID;
 	Text = InText;
-	TextFormat = Text;
 	SourceLineNo = LineNo;
-	bFormatExtracted = false;
+	// Prepared when the script finishes importing
+	bParameterNamesExtracted = false;
 	
 }
 
@@ -18,45 +18,26 @@ FString USUDSScriptNodeText::GetTextID() const
 	return SUDS_GET_TEXT_KEY(Text);
 }
 
-const FTextFormat& USUDSScriptNodeText::GetTextFormat() const
+void USUDSScriptNodeText::PrepareTextFormats(bool bExtractParameterNames)
 {
-	if (!bFormatExtracted)
-	{
-		ExtractFormat();
-	}
-	return TextFormat;
-}
-
-const TArray<FName>& USUDSScriptNodeText::GetParameterNames() const
-{
-	if (!bFormatExtracted)
-	{
-		ExtractFormat();
-	}
-	return ParameterNames;
-}
+	Super::PrepareTextFormats(bExtractParameterNames);
 
-bool USUDSScriptNodeText::HasParameters() const
-{
-	if (!bFormatExtracted)
+	// FTextFormat compiles again by itself if the text changes, e.g. because of a culture change
+	TextFormat = Text;
+	if (bExtractParameterNames || !bParameterNamesExtracted)
 	{
-		ExtractFormat();
+		ParameterNames.Empty();
+		TArray<FString> TextParams;
+		TextFormat.GetFormatArgumentNames(TextParams);
+		for (const auto& Param : TextParams)
+		{
+			ParameterNames.Add(FName(Param));
+		}
+		bParameterNamesExtracted = true;
 	}
-	return !ParameterNames.IsEmpty();
-	
-}
-
-void USUDSScriptNodeText::ExtractFormat() const
-{
-	// Only do this on demand, and only once
-	TextFormat = Text;
-	ParameterNames.Empty();
-
-	TArray<FString> TextParams;
-	TextFormat.GetFormatArgumentNames(TextParams);
-	for (auto Param : TextParams)
+	ParameterVariables.Empty(ParameterNames.Num());
+	for (const auto& Name : ParameterNames)
 	{
-		ParameterNames.Add(FName(Param));
+		ParameterVariables.Emplace(Name);
 	}
-	bFormatExtracted = true;
 }
@@ -8,6 +8,9 @@ DEFINE_LOG_CATEGORY(LogSUDSSubsystem)
 #if WITH_EDITORONLY_DATA
 	TMap<FName, FSUDSValue> USUDSSubsystem::Test_DummyGlobalVariables;
 #endif
+TMap<FName, FSUDSExpressionFunctionInfo> USUDSSubsystem::ExpressionFunctions;
+uint32 USUDSSubsystem::ExpressionFunctionGeneration = 0;
+FSUDSVariableProviderRegistry USUDSSubsystem::GlobalVariableProviders;
 
 void USUDSSubsystem::Initialize(FSubsystemCollectionBase& Collection)
 {
@@ -43,7 +46,10 @@ int USUDSSubsystem::GetMaxConcurrentVoicedLines() const
 void USUDSSubsystem::ResetGlobalState(bool bResetVariables)
 {
 	if (bResetVariables)
+	{
 		GlobalVariableState.Empty();
+		GlobalVariableVersions.Reset();
+	}
 }
 
 FSUDSGlobalState USUDSSubsystem::GetSavedGlobalState() const
@@ -55,6 +61,10 @@ void USUDSSubsystem::RestoreSavedGlobalState(const FSUDSGlobalState& State)
 {
 	ResetGlobalState();
 	GlobalVariableState.Append(State.GetGlobalVariables());
+	for (const auto& Pair : State.GetGlobalVariables())
+	{
+		GlobalVariableVersions.Bump(Pair.Key);
+	}
 }
 
 
@@ -193,7 +203,52 @@ FName USUDSSubsystem::GetGlobalVariableName(FName Name) const
 	return NAME_None;
 }
 
+void USUDSSubsystem::RegisterExpressionFunction(FName Name, int32 NumArgs, FSUDSExpressionFunction Function, ESUDSValueType ReturnType)
+{
+	check(Function);
+	checkf(NumArgs >= 0 && NumArgs <= MAX_uint8, TEXT("Too many arguments for expression function %s"), *Name.ToString());
+	FSUDSExpressionFunctionInfo& Info = ExpressionFunctions.Add(Name);
+	Info.Function = Function;
+	Info.NumArgs = NumArgs;
+	Info.ReturnType = ReturnType;
+	++ExpressionFunctionGeneration;
+}
+
+void USUDSSubsystem::UnregisterExpressionFunction(FName Name)
+{
+	if (ExpressionFunctions.Remove(Name) > 0)
+	{
+		++ExpressionFunctionGeneration;
+	}
+}
+
+const FSUDSExpressionFunctionInfo* USUDSSubsystem::FindExpressionFunction(FName Name)
+{
+	return ExpressionFunctions.Find(Name);
+}
+
+void USUDSSubsystem::RegisterGlobalVariableProvider(FName Name, FSUDSVariableProvider Provider)
+{
+	GlobalVariableProviders.Register(Name, MoveTemp(Provider));
+}
+
+void USUDSSubsystem::RegisterGlobalVariableProviderPrefix(const FString& Prefix, FSUDSVariableProvider Provider)
+{
+	GlobalVariableProviders.RegisterPrefix(Prefix, MoveTemp(Provider));
+}
+
+void USUDSSubsystem::UnregisterGlobalVariableProvider(FName Name)
+{
+	GlobalVariableProviders.Unregister(Name);
+}
+
+void USUDSSubsystem::UnregisterGlobalVariableProviderPrefix(const FString& Prefix)
+{
+	GlobalVariableProviders.UnregisterPrefix(Prefix);
+}
+
 void USUDSSubsystem::UnSetGlobalVariable(FName Name)
 {
 	GlobalVariableState.Remove(Name);
+	GlobalVariableVersions.Bump(Name);
 }
@@ -5,30 +5,41 @@
 #include "UObject/Class.h"
 #include "Internationalization/Text.h"
 
+#if !WITH_CASE_PRESERVING_NAME
+static_assert(sizeof(FSUDSValue) == 16, "FSUDSValue should be a 16-byte tagged union");
+#endif
+
 FArchive& operator<<(FArchive& Ar, FSUDSValue& Value)
 {
-	// Custom serialisation since we can't auto-serialise union, TOptional
+	// Custom serialisation since we can't auto-serialise a union
+	// The format predates the tagged union: type, then the int bits (always written, 0 for text & names), then the
+	// text or name if relevant. Keep it that way so older saves and assets still load
 	uint8 TypeAsInt = (uint8)Value.Type; 
 	Ar << TypeAsInt;
-	if (Ar.IsLoading())
-		Value.Type = static_cast<ESUDSValueType>(TypeAsInt);
+	const ESUDSValueType Type = static_cast<ESUDSValueType>(TypeAsInt);
 
 	// This gets/sets float value too
-	Ar << Value.IntValue;
+	int32 IntBits = Value.HasNumericPayload() ? Value.IntValue : 0;
+	Ar << IntBits;
 
-	if (Value.Type == ESUDSValueType::Text)
+	if (Type == ESUDSValueType::Text)
 	{
-		FText Text = Value.TextValue.Get(FText::GetEmpty());
+		FText Text = Value.GetTextValueUnchecked();
 		Ar << Text;
 		if (Ar.IsLoading())
-			Value.TextValue = Text;
+			Value = FSUDSValue(MoveTemp(Text));
 	}
-	else if (Value.Type == ESUDSValueType::Variable || Value.Type == ESUDSValueType::Name)
+	else if (Type == ESUDSValueType::Variable || Type == ESUDSValueType::Name)
 	{
-		FString VarNameStr = Value.Name.Get(NAME_None).ToString();
+		FString VarNameStr = Value.GetNameValueUnchecked().ToString();
 		Ar << VarNameStr;
 		if (Ar.IsLoading())
-			Value.Name = FName(VarNameStr);
+			Value = FSUDSValue(FName(VarNameStr), Type == ESUDSValueType::Variable);
+	}
+	else if (Ar.IsLoading())
+	{
+		Value = FSUDSValue(Type);
+		Value.IntValue = IntBits;
 	}
 		
 	return Ar;
@@ -36,22 +47,63 @@ FArchive& operator<<(FArchive& Ar, FSUDSValue& Value)
 
 void operator<<(FStructuredArchive::FSlot Slot, FSUDSValue& Value)
 {
+	const bool bLoading = Slot.GetUnderlyingArchive().IsLoading();
 	FStructuredArchive::FRecord Record = Slot.EnterRecord();
+	ESUDSValueType Type = Value.Type;
+	int32 IntBits = Value.HasNumericPayload() ? Value.IntValue : 0;
 	Record
-		<< SA_VALUE(TEXT("Type"), Value.Type)
-		<< SA_VALUE(TEXT("IntValue"), Value.IntValue); // gets/sets float/boolean/gender too
+		<< SA_VALUE(TEXT("Type"), Type)
+		<< SA_VALUE(TEXT("IntValue"), IntBits); // gets/sets float/boolean/gender too
 
-	if (Value.Type == ESUDSValueType::Text)
+	// Text & name are written as optionals, as they were when they were stored that way
+	if (Type == ESUDSValueType::Text)
+	{
+		TOptional<FText> TextValue;
+		if (!bLoading)
+			TextValue = Value.GetTextValueUnchecked();
+		Record << SA_VALUE(TEXT("TextValue"), TextValue);
+		if (bLoading)
+			Value = FSUDSValue(TextValue.Get(FText::GetEmpty()));
+	}
+	else if (Type == ESUDSValueType::Variable || Type == ESUDSValueType::Name)
 	{
-		Record << SA_VALUE(TEXT("TextValue"), Value.TextValue);
+		TOptional<FName> Name;
+		if (!bLoading)
+			Name = Value.GetNameValueUnchecked();
+		Record << SA_VALUE(TEXT("Name"), Name);
+		if (bLoading)
+			Value = FSUDSValue(Name.Get(NAME_None), Type == ESUDSValueType::Variable);
 	}
-	else if (Value.Type == ESUDSValueType::Variable || Value.Type == ESUDSValueType::Name)
+	else if (bLoading)
 	{
-		Record << SA_VALUE(TEXT("Name"), Value.Name);
+		Value = FSUDSValue(Type);
+		Value.IntValue = IntBits;
 	}
 
 }
 
+bool FSUDSValue::IsIdenticalTo(const FSUDSValue& Other) const
+{
+	if (Type != Other.Type)
+		return false;
+
+	switch (Type)
+	{
+	case ESUDSValueType::Text:
+		// Must be the same localised text, not just the same source string
+		return TextHolder == Other.TextHolder ||
+			GetTextValueUnchecked().IdenticalTo(Other.GetTextValueUnchecked(), ETextIdenticalModeFlags::DeepCompare);
+	case ESUDSValueType::Name:
+	case ESUDSValueType::Variable:
+		return NameValue == Other.NameValue;
+	case ESUDSValueType::Empty:
+		return true;
+	default:
+		// Int, float, boolean and gender all live in the same bits
+		return IntValue == Other.IntValue;
+	}
+}
+
 FString FSUDSValue::ToString() const
 {
 	switch (Type)
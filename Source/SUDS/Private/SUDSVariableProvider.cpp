@@ -0,0 +1,79 @@
+﻿// Copyright Steve Streeting 2022
+// Released under the MIT license https://opensource.org/license/MIT/
+#include "SUDSVariableProvider.h"
+
+void FSUDSVariableProviderRegistry::Register(FName Name, FSUDSVariableProvider Provider)
+{
+	check(Provider.IsBound());
+	Providers.Add(Name, MoveTemp(Provider));
+	++Generation;
+}
+
+void FSUDSVariableProviderRegistry::RegisterPrefix(const FString& Prefix, FSUDSVariableProvider Provider)
+{
+	check(Provider.IsBound());
+	check(!Prefix.IsEmpty());
+	++Generation;
+	for (auto& Pair : PrefixProviders)
+	{
+		if (Pair.Key.Equals(Prefix, ESearchCase::IgnoreCase))
+		{
+			Pair.Value = MoveTemp(Provider);
+			return;
+		}
+	}
+	PrefixProviders.Emplace(Prefix, MoveTemp(Provider));
+}
+
+void FSUDSVariableProviderRegistry::Unregister(FName Name)
+{
+	if (Providers.Remove(Name) > 0)
+	{
+		++Generation;
+	}
+}
+
+void FSUDSVariableProviderRegistry::UnregisterPrefix(const FString& Prefix)
+{
+	if (PrefixProviders.RemoveAll([&Prefix](const TPair<FString, FSUDSVariableProvider>& Pair)
+	{
+		return Pair.Key.Equals(Prefix, ESearchCase::IgnoreCase);
+	}) > 0)
+	{
+		++Generation;
+	}
+}
+
+void FSUDSVariableProviderRegistry::Reset()
+{
+	if (!IsEmpty())
+	{
+		Providers.Empty();
+		PrefixProviders.Empty();
+		++Generation;
+	}
+}
+
+bool FSUDSVariableProviderRegistry::Provide(USUDSDialogue* Dialogue, FName Name, FSUDSValue& OutValue) const
+{
+	if (const FSUDSVariableProvider* Provider = Providers.Find(Name))
+	{
+		if (Provider->Execute(Dialogue, Name, OutValue))
+		{
+			return true;
+		}
+	}
+
+	if (!PrefixProviders.IsEmpty())
+	{
+		const FString NameStr = Name.ToString();
+		for (const auto& Pair : PrefixProviders)
+		{
+			if (NameStr.StartsWith(Pair.Key, ESearchCase::IgnoreCase) && Pair.Value.Execute(Dialogue, Name, OutValue))
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
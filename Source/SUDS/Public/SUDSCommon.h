@@ -16,6 +16,44 @@ struct FSUDSConstants
 
 };
 
+/// A variable name with its scope resolved up front, so that the "global." prefix doesn't have to be checked
+/// every time the variable is looked up
+struct SUDS_API FSUDSScopedVariableName
+{
+	/// The name as written, including any "global." prefix
+	FName Name;
+	/// The name to look up in the relevant variable state, i.e. without the "global." prefix
+	FName ScopedName;
+	/// Whether this is a global variable
+	bool bIsGlobal = false;
+
+	FSUDSScopedVariableName() = default;
+	explicit FSUDSScopedVariableName(const FName& InName);
+};
+
+/// Tracks a version number for each variable in a variable store, which changes whenever the variable does. Version
+/// numbers are never re-used, so comparing a remembered version with the current one tells you whether the variable
+/// has changed since. Variables which aren't set are version 0.
+struct SUDS_API FSUDSVariableVersions
+{
+protected:
+	TMap<FName, uint32> Versions;
+	uint32 LastVersion = 0;
+
+public:
+	uint32 Get(const FName& Name) const
+	{
+		const uint32* pVersion = Versions.Find(Name);
+		return pVersion ? *pVersion : 0;
+	}
+
+	/// Record that a variable has changed (including being unset)
+	void Bump(const FName& Name) { Versions.Add(Name, ++LastVersion); }
+
+	/// Record that all variables have been unset
+	void Reset() { Versions.Empty(); }
+};
+
 #if ENGINE_MINOR_VERSION >= 5
 #define SUDS_GET_TEXT_KEY(Text) FTextInspector::GetTextId(Text).GetKey().ToString()
 #else
@@ -5,17 +5,22 @@
 #include "CoreMinimal.h"
 #include "SUDSScriptNode.h"
 #include "SUDSExpression.h"
+#include "SUDSVariableProvider.h"
 #include "UObject/Object.h"
+#include "UObject/SoftObjectPath.h"
 #include "SUDSDialogue.generated.h"
 
 class USUDSScriptNodeGosub;
 class USUDSScriptNodeText;
 struct FSUDSScriptEdge;
+struct FSUDSSpeakerInfo;
+struct FStreamableHandle;
 class USUDSScriptNode;
 class USUDSScript;
 class UDialogueWave;
 class UDialogueVoice;
 class USoundBase;
+class ISUDSParticipant;
 
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnDialogueSpeakerLine, class USUDSDialogue*, Dialogue);
@@ -27,6 +32,16 @@ DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FOnDialogueEvent, class USUDSDial
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_FourParams(FOnVariableChangedEvent, class USUDSDialogue*, Dialogue, FName, VariableName, const FSUDSValue&, Value, bool, bFromScript);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnVariableRequestedEvent, class USUDSDialogue*, Dialogue, FName, VariableName);
 
+// Native equivalents of the above, for C++ listeners. Broadcast before the dynamic versions and don't need reflection
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnDialogueSpeakerLineNative, class USUDSDialogue* /*Dialogue*/);
+DECLARE_MULTICAST_DELEGATE_TwoParams(FOnDialogueChoiceNative, class USUDSDialogue* /*Dialogue*/, int /*ChoiceIndex*/);
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnDialogueProceedingNative, class USUDSDialogue* /*Dialogue*/);
+DECLARE_MULTICAST_DELEGATE_TwoParams(FOnDialogueStartingNative, class USUDSDialogue* /*Dialogue*/, FName /*AtLabel*/);
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnDialogueFinishedNative, class USUDSDialogue* /*Dialogue*/);
+DECLARE_MULTICAST_DELEGATE_ThreeParams(FOnDialogueEventNative, class USUDSDialogue* /*Dialogue*/, FName /*EventName*/, const TArray<FSUDSValue>& /*Arguments*/);
+DECLARE_MULTICAST_DELEGATE_FourParams(FOnVariableChangedEventNative, class USUDSDialogue* /*Dialogue*/, FName /*VariableName*/, const FSUDSValue& /*Value*/, bool /*bFromScript*/);
+DECLARE_MULTICAST_DELEGATE_TwoParams(FOnVariableRequestedEventNative, class USUDSDialogue* /*Dialogue*/, FName /*VariableName*/);
+
 #if WITH_EDITOR
 	// Non-dynamic events for editor use
 	DECLARE_DELEGATE_TwoParams(FOnDialogueSpeakerLineInternal, class USUDSDialogue* /* Dialogue */, int /*SourceLineNo*/);
@@ -92,6 +107,87 @@ public:
 	}
 	
 };
+/// The last result of a condition, along with the versions of the variables it read, so that it only needs to be
+/// evaluated again when one of those variables has changed
+struct FSUDSConditionCacheEntry
+{
+	struct FVariableRead
+	{
+		/// Copied, the expression which read it may be replaced by a reimport while this is cached
+		FSUDSScopedVariableName Variable;
+		uint32 Version;
+		/// Globals fall back on local variables when not set, so need both
+		uint32 GlobalVersion;
+	};
+	TArray<FVariableRead, TInlineAllocator<4>> Reads;
+	bool bResult = false;
+};
+
+/// Parameterised text which has already been formatted, along with what it was formatted from, so that it only needs
+/// to be formatted again when one of those has changed
+struct FSUDSTextCacheEntry
+{
+	FText Text;
+	/// Version of each parameter variable when formatted, in the same order as the parameters
+	TArray<uint32, TInlineAllocator<4>> Versions;
+	/// Locale and localisation revision the text was formatted with
+	FCulturePtr Locale;
+	uint16 TextRevision = 0;
+	bool bValid = false;
+};
+
+/// Sound for a voiced line, resolved from its wave's contexts for the line's speaker & default target
+struct FSUDSLineSound
+{
+	/// Proxy of the context with both the speaker and target
+	TWeakObjectPtr<USoundBase> TargetMatch;
+	/// Proxy of the first context with the speaker, whatever the target
+	TWeakObjectPtr<USoundBase> SpeakerMatch;
+};
+
+/// Waves of the voiced lines within look-ahead range of a line, when reached with a given gosub stack
+struct FSUDSWavesInRange
+{
+	/// Graph indexes of the gosubs on the return stack, since returns decide which lines are reachable
+	TArray<int32> GosubStack;
+	TArray<FSoftObjectPath> Waves;
+};
+
+/// How to call a single participant, resolved once when participants change rather than on every event
+struct FSUDSParticipantDispatch
+{
+	/// Bit flags for each ISUDSParticipant handler
+	enum EHandler : uint16
+	{
+		Starting = 1 << 0,
+		Finished = 1 << 1,
+		SpeakerLine = 1 << 2,
+		ChoiceMade = 1 << 3,
+		Proceeding = 1 << 4,
+		Event = 1 << 5,
+		VariableChanged = 1 << 6,
+		VariableRequested = 1 << 7,
+		Priority = 1 << 8,
+	};
+
+	/// The participant. Weak, since it may be destroyed while still in the dialogue's Participants list
+	TWeakObjectPtr<UObject> Object;
+	/// The C++ interface, if the participant's class implements ISUDSParticipant natively. Only valid while Object is
+	ISUDSParticipant* NativeInterface = nullptr;
+	/// Handlers this participant implements at all
+	uint16 HandledMask = 0;
+	/// Handlers overridden in script, which have to be called through reflection
+	uint16 ScriptMask = 0;
+	/// Cached result of GetDialogueParticipantPriority
+	int CachedPriority = 0;
+
+	FSUDSParticipantDispatch() = default;
+	explicit FSUDSParticipantDispatch(UObject* InObject);
+
+	bool Handles(EHandler Handler) const { return (HandledMask & Handler) != 0; }
+	bool IsNative(EHandler Handler) const { return (ScriptMask & Handler) == 0; }
+};
+
 /**
  * A Dialogue is a runtime instance of a Script (the asset on which the dialogue is based)
  * An Dialogue always stops on a speaker line, which may have player choices. It progresses when you call Continue()
@@ -140,6 +236,17 @@ public:
 	/// Event raised when the dialogue finishes
 	UPROPERTY(BlueprintAssignable)
 	FOnDialogueFinished OnFinished;
+
+	/// Native versions of the events above, for C++ listeners. These are raised just before their dynamic equivalents
+	/// and are cheaper to call, since they don't go through reflection
+	FOnDialogueSpeakerLineNative OnSpeakerLineNative;
+	FOnDialogueChoiceNative OnChoiceNative;
+	FOnDialogueProceedingNative OnProceedingNative;
+	FOnDialogueEventNative OnEventNative;
+	FOnVariableChangedEventNative OnVariableChangedNative;
+	FOnVariableRequestedEventNative OnVariableRequestedNative;
+	FOnDialogueStartingNative OnStartingNative;
+	FOnDialogueFinishedNative OnFinishedNative;
 protected:
 	UPROPERTY()
 	TObjectPtr<const USUDSScript> BaseScript;
@@ -151,6 +258,8 @@ protected:
 	/// External objects which want to closely participate in the dialogue (not just listen to events)
 	UPROPERTY()
 	TArray<TObjectPtr<UObject>> Participants;
+	/// How to call each of Participants, in the same order. Rebuilt whenever participants change
+	TArray<FSUDSParticipantDispatch> ParticipantDispatch;
 	
 
 	/// All of the dialogue variables
@@ -159,6 +268,52 @@ protected:
 	/// or communication with external state.
 	typedef TMap<FName, FSUDSValue> FSUDSValueMap;
 	FSUDSValueMap VariableState;
+	/// Versions of variables in VariableState, used to tell when cached condition results are out of date
+	FSUDSVariableVersions VariableVersions;
+
+	/// Cached condition results, keyed on the index of the condition in the script's expression pool
+	TMap<int32, FSUDSConditionCacheEntry> ConditionCache;
+	/// Import generation of the script when the caches were last valid, they're flushed if it's reimported
+	uint32 ScriptImportGeneration = 0;
+	int32 ConditionCacheHits = 0;
+	int32 ConditionCacheMisses = 0;
+
+	/// Formatted text for the current speaker line, and each of the current choices
+	FSUDSTextCacheEntry SpeakerTextCache;
+	TArray<FSUDSTextCacheEntry> ChoiceTextCache;
+	int32 TextCacheHits = 0;
+
+	/// Sounds for each voiced line that's been played, by graph index of the text node
+	TMap<int32, FSUDSLineSound> LineSoundCache;
+	/// Voice generation of the script when LineSoundCache was last valid, it's flushed if speaker voices change
+	uint32 ScriptVoiceGeneration = 0;
+	/// Waves to stream for each line that's been reached, by graph index of the text node, so the graph only has to
+	/// be walked the first time a line is reached from each gosub stack
+	TMap<int32, TArray<FSUDSWavesInRange>> WavesInRangeCache;
+
+	/// How many speaker lines ahead of the current one to stream in DialogueWaves for
+	int32 VoiceLookAheadLines = 2;
+	/// Whether to load the current line's DialogueWave immediately if it's needed before streaming has finished
+	bool bLoadCurrentWaveIfNotStreamed = true;
+	/// Streaming handles for DialogueWaves which are in range of the current line, by wave path
+	TMap<FSoftObjectPath, TSharedPtr<FStreamableHandle>> StreamedWaves;
+	/// Number of times the current line's wave had to be loaded before streaming had finished
+	int32 VoiceSyncLoads = 0;
+
+	/// Variables which have already been requested in the current step (start, continue / choose, or resolving text)
+	/// Each variable is only requested once per step, unless it changes in between. Globals can change without going
+	/// through us, so the value is the global version when requested (0 for dialogue variables)
+	TMap<FName, uint32> VariablesRequestedThisStep;
+	/// Number of nested steps in progress, requests are only coalesced when > 0
+	int32 StepDepth = 0;
+	int32 VariableRequestsSkipped = 0;
+
+	/// Native providers of dialogue variable values, which are never stored in VariableState
+	FSUDSVariableProviderRegistry VariableProviders;
+	/// Values from providers (or unset if declined), cached for the current step only. Keyed on the name as written
+	TMap<FName, TOptional<FSUDSValue>> ProvidedVariablesThisStep;
+	/// Generation of global variable providers when the condition cache was last validated
+	uint32 GlobalProviderGeneration = 0;
 
 	/// Stack of Gosub nodes to return to
 	UPROPERTY()
@@ -180,10 +335,8 @@ protected:
 
 	void InitVariables();
 	void RunUntilNextSpeakerNodeOrEnd(USUDSScriptNode* FromNode, bool bRaiseAtEnd);
-	const USUDSScriptNode* WalkToNextChoiceNode(USUDSScriptNode* FromNode, bool bExecute);
-	USUDSScriptNode* RecurseWalkToNextChoiceOrTextNode(USUDSScriptNode* Node, bool bExecute, TArray<TObjectPtr<USUDSScriptNodeGosub>>& LocalGosubStack);
-	const USUDSScriptNode* RunUntilNextChoiceNode(USUDSScriptNode* FromTextNode);
-	const USUDSScriptNode* FindNextChoiceNode(USUDSScriptNode* FromNode);
+	/// If a choice follows FromNode, run the nodes in between and return the root choice node, otherwise run nothing
+	const USUDSScriptNode* RunUntilNextChoiceNode(USUDSScriptNode* FromNode);
 	void SetCurrentSpeakerNode(USUDSScriptNodeText* Node, bool bQuietly);
 	void SortParticipants();
 	void RaiseStarting(FName StartLabel);
@@ -192,8 +345,18 @@ protected:
 	void RaiseChoiceMade(int Index, int LineNo);
 	void RaiseProceeding();
 	void RaiseVariableChange(const FName& VarName, const FSUDSValue& Value, bool bFromScript, int LineNo);
-	void RaiseVariableRequested(const FName& VarName, int LineNo);
-	void RaiseExpressionVariablesRequested(const FSUDSExpression& Expression, int LineNo);
+	void RaiseVariableRequested(const FSUDSScopedVariableName& Variable, int LineNo);
+	/// Get a variable value from a registered provider, if there is one
+	bool ProvideVariable(const FSUDSScopedVariableName& Variable, FSUDSValue& OutValue);
+	void OnVariableProvidersChanged();
+	/// Evaluate an expression, requesting variables from participants only as they're actually read
+	FSUDSValue EvaluateExpression(const FSUDSExpression& Expression, int LineNo);
+	/// Evaluate a condition from the script's expression pool, using the cached result if nothing it read has changed
+	bool EvaluateCondition(int32 ConditionIndex, int LineNo);
+	/// Drop anything which refers to the script's previous contents, if it's been reimported since we last checked
+	void CheckScriptReimported();
+	friend struct FSUDSDialogueVariableRequester;
+	friend struct FSUDSDialogueStepScope;
 	const TMap<FName, FSUDSValue>& GetGlobalVariables() const;
 
 	USUDSScriptNode* GetNextNode(USUDSScriptNode* Node);
@@ -206,24 +369,56 @@ protected:
 	USUDSScriptNode* RunReturnNode(USUDSScriptNode* Node);
 	void UpdateChoices();
 	void RecurseAppendChoices(const USUDSScriptNode* Node, TArray<FSUDSScriptEdge>& OutChoices);
-	USoundBase* GetSoundForCurrentLine(bool bAllowAnyTarget) const;
+	USoundBase* GetSoundForCurrentLine(bool bAllowAnyTarget);
 	UDialogueVoice* GetTargetVoice() const;
+	const FSUDSSpeakerInfo* GetCurrentSpeakerInfo() const;
+	/// Stream in the waves for lines within range of the current line, and release those which are now out of range
+	void UpdateVoiceStreaming();
+	/// Get the waves of lines within VoiceLookAheadLines of the current line, from the cache if possible
+	const TArray<FSoftObjectPath>& GetWavesInRange();
+	/// Call OnLine for every speaker line within MaxLines of the current one along any path, with how many lines ahead
+	/// it is (the current line is 0). Nothing is run or evaluated. Lines may be passed more than once.
+	void WalkReachableSpeakerLines(int32 MaxLines, TFunctionRef<void(USUDSScriptNodeText*, int32)> OnLine) const;
+	void ReleaseStreamedWaves();
 	class USoundConcurrency* GetVoiceSoundConcurrency() const;
 
-	FText ResolveParameterisedText(const TArray<FName> Params, const FTextFormat& TextFormat, int LineNo);
-	void GetTextFormatArgs(const TArray<FName>& ArgNames, FFormatNamedArguments& OutArgs) const;
+	FText ResolveParameterisedText(const TArray<FSUDSScopedVariableName>& Params, const FTextFormat& TextFormat, int LineNo, FSUDSTextCacheEntry& Cache);
+	void GetTextFormatArgs(const TArray<FSUDSScopedVariableName>& ArgNames, FFormatNamedArguments& OutArgs) const;
 	bool CurrentNodeHasChoices() const;
 	void SetVariableImpl(FName Name, const FSUDSValue& Value, bool bFromScript, int LineNo)
 	{
-		const FSUDSValue OldValue = GetVariable(Name);
-		if (!IsVariableSet(Name) ||
-			(OldValue != Value).GetBooleanValue())
+		FSUDSValue* Existing = VariableState.Find(Name);
+		if (!Existing || !Existing->EqualTo(Value))
 		{
-			VariableState.Add(Name, Value);
+			// Assign in place if we can, no need to rehash
+			if (Existing)
+				*Existing = Value;
+			else
+				VariableState.Add(Name, Value);
+			VariableVersions.Bump(Name);
+			// Changed, so anyone providing it on request should be asked again
+			if (VariablesRequestedThisStep.Num() > 0)
+				VariablesRequestedThisStep.Remove(Name);
+			// Raise with the caller's value, listeners may set other variables & reallocate the map
 			RaiseVariableChange(Name, Value, bFromScript, LineNo);
 		}
 		
 	}
+	void SetVariableImpl(FName Name, FSUDSValue&& Value, bool bFromScript, int LineNo)
+	{
+		FSUDSValue* Existing = VariableState.Find(Name);
+		if (!Existing || !Existing->EqualTo(Value))
+		{
+			const FSUDSValue& Stored = Existing ? (*Existing = MoveTemp(Value)) : VariableState.Add(Name, MoveTemp(Value));
+			VariableVersions.Bump(Name);
+			// Changed, so anyone providing it on request should be asked again
+			if (VariablesRequestedThisStep.Num() > 0)
+				VariablesRequestedThisStep.Remove(Name);
+			// Value has been moved from, and listeners may set other variables & reallocate the map, so raise with a
+			// copy of what was stored
+			RaiseVariableChange(Name, FSUDSValue(Stored), bFromScript, LineNo);
+		}
+	}
 
 public:
 	USUDSDialogue();
@@ -232,6 +427,7 @@ public:
 	//		UE_LOG(LogTemp, Warning, TEXT("*********** Destroyed Dialogue!"));
 	// }
 	void Initialise(const USUDSScript* Script);
+	virtual void BeginDestroy() override;
 	
 	/// Get the script asset this dialogue is based on
 	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Dialogue")
@@ -282,10 +478,17 @@ public:
 	FText GetText();
 
 	/// Get the DialogueWave associated with the current dialogue node
-	/// Returns null if there is no wave for this line.
+	/// Returns null if there is no wave for this line, or if it hasn't finished streaming in yet. Use LoadCurrentWave
+	/// if you need the wave right away, e.g. for its subtitles as soon as the line starts.
 	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Dialogue")
 	UDialogueWave* GetWave() const;
 
+	/// Get the DialogueWave associated with the current dialogue node, loading it immediately if it hasn't finished
+	/// streaming in yet. This blocks until the wave is loaded, and is counted in the sync loads of
+	/// GetVoiceStreamingStats. Returns null if there is no wave for this line, or it failed to load.
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
+	UDialogueWave* LoadCurrentWave();
+
 	/// Return whether the current dialogue node has a Dialogue Wave associated with it
 	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Dialogue")
 	bool IsCurrentLineVoiced() const;
@@ -501,7 +704,7 @@ public:
 	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
 	void SetVariable(FName Name, FSUDSValue Value)
 	{
-		SetVariableImpl(Name, Value, false, 0);
+		SetVariableImpl(Name, MoveTemp(Value), false, 0);
 	}
 
 	/// Get a variable in dialogue state as a general value type
@@ -510,13 +713,20 @@ public:
 	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
 	FSUDSValue GetVariable(FName Name) const
 	{
-		if (const auto Arg = VariableState.Find(Name))
+		if (const auto Arg = FindVariable(Name))
 		{
 			return *Arg;
 		}
 		return FSUDSValue();
 	}
 
+	/// Find a variable in dialogue state without copying it, returns null if it's not set.
+	/// The pointer is only valid until variables are next changed
+	const FSUDSValue* FindVariable(FName Name) const
+	{
+		return VariableState.Find(Name);
+	}
+
 	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
 	bool IsVariableSet(FName Name) const
 	{
@@ -526,6 +736,98 @@ public:
 	/// Get all variables
 	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
 	const TMap<FName, FSUDSValue>& GetVariables() const { return VariableState; }
+
+	/// Get the number of times a condition was resolved from the cache, because none of the variables it uses changed
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Dialogue")
+	int GetConditionCacheHits() const { return ConditionCacheHits; }
+
+	/// Get the number of times a condition had to be evaluated
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Dialogue")
+	int GetConditionCacheMisses() const { return ConditionCacheMisses; }
+
+	/// Reset the condition cache hit / miss counts
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
+	void ResetConditionCacheStats() { ConditionCacheHits = ConditionCacheMisses = 0; }
+
+	/// Get the number of times parameterised speaker or choice text was returned without formatting it again, because
+	/// none of its parameters, nor the culture, had changed
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Dialogue")
+	int GetTextCacheHits() const { return TextCacheHits; }
+
+	/// Reset the text cache hit count
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
+	void ResetTextCacheStats() { TextCacheHits = 0; }
+
+	/// Get the number of variable requests which weren't raised, because the same variable had already been requested
+	/// earlier in the same step (start, continue / choose, or resolving text) and hadn't changed since
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Dialogue")
+	int GetVariableRequestsSkipped() const { return VariableRequestsSkipped; }
+
+	/// Reset the count of skipped variable requests
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
+	void ResetVariableRequestStats() { VariableRequestsSkipped = 0; }
+
+	/**
+	 * Get the speaker lines which could come after the current one, without running anything. Every path is followed,
+	 * including all branches of selects and all choices, and into & out of gosubs, since which will be taken isn't known
+	 * until they're run. Use this to prefetch things needed to present upcoming lines, e.g. portraits or animations.
+	 * Cheap enough to call whenever the speaker line changes, for small depths.
+	 * @param MaxDepth How many lines ahead to look; 1 means only the lines which could come next
+	 * @param OutLines The lines which could be reached, nearest first
+	 * @param OutSpeakerIDs The speaker of each line in OutLines, at the same index. Speakers with more than one line
+	 *   appear more than once
+	 */
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
+	void GetReachableSpeakerLines(int MaxDepth,
+	                              TArray<USUDSScriptNodeText*>& OutLines,
+	                              TArray<FString>& OutSpeakerIDs) const;
+
+	/**
+	 * Set how voiced lines are streamed. DialogueWaves are only loaded when a line is close to being reached: as the
+	 * dialogue progresses, waves for lines within range are loaded asynchronously, and those which fall out of range are
+	 * released.
+	 * @param LookAheadLines How many speaker lines ahead of the current one to stream waves for, along any path.
+	 *   0 means only the current line.
+	 * @param bLoadCurrentWaveIfNotStreamed If the current line's sound is needed before its wave has finished streaming,
+	 *   whether to load it immediately. If false, no sound is returned / played for the line in that case.
+	 */
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
+	void SetVoiceStreaming(int LookAheadLines = 2, bool bLoadCurrentWaveIfNotStreamed = true);
+
+	/**
+	 * Get statistics for the DialogueWaves this dialogue has loaded
+	 * @param OutResidentWaves Number of waves which are loaded
+	 * @param OutPendingWaves Number of waves which are still being streamed in
+	 * @param OutResidentBytes Estimated memory used by the loaded waves and their sounds
+	 * @param OutSyncLoads Number of times the current line's wave was needed before it had finished streaming
+	 */
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
+	void GetVoiceStreamingStats(int& OutResidentWaves, int& OutPendingWaves, int64& OutResidentBytes, int& OutSyncLoads) const;
+
+	/**
+	 * Register a native provider for a dialogue variable. Whenever the script reads the variable, the provider is
+	 * asked for its value instead of it being looked up in the dialogue's variables. Provided values are only cached
+	 * for the current step, are never written to the dialogue's variables, don't raise change events and aren't saved.
+	 * Providers are called instead of OnVariableRequested listeners for variables they supply.
+	 * Use this for values which are derived from game state rather than owned by the dialogue.
+	 * @param Name The name of the variable
+	 * @param Provider The provider, which can decline by returning false
+	 */
+	void RegisterVariableProvider(FName Name, FSUDSVariableProvider Provider);
+
+	/**
+	 * Register a native provider for all dialogue variables whose names start with a prefix, e.g. "Stats."
+	 * See RegisterVariableProvider.
+	 * @param Prefix The prefix of the variable names (case insensitive)
+	 * @param Provider The provider, which can decline by returning false
+	 */
+	void RegisterVariableProviderPrefix(const FString& Prefix, FSUDSVariableProvider Provider);
+
+	/// Remove a provider added with RegisterVariableProvider
+	void UnregisterVariableProvider(FName Name);
+
+	/// Remove a provider added with RegisterVariableProviderPrefix
+	void UnregisterVariableProviderPrefix(const FString& Prefix);
 	
 	/**
 	 * Set a text dialogue variable
@@ -535,7 +837,7 @@ public:
 	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
 	void SetVariableText(FName Name, FText Value)
 	{
-		SetVariable(Name, Value);
+		SetVariable(Name, FSUDSValue(MoveTemp(Value)));
 	}
 
 	/**
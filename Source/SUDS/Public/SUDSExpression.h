@@ -2,8 +2,11 @@
 // Released under the MIT license https://opensource.org/license/MIT/
 #pragma once
 #include "SUDSValue.h"
+#include "Containers/StringView.h"
 #include "SUDSExpression.generated.h"
 
+class USUDSDialogue;
+
 UENUM(BlueprintType)
 enum class ESUDSExpressionItemType : uint8
 {
@@ -23,9 +26,13 @@ enum class ESUDSExpressionItemType : uint8
 	NotEqual = 35,
 	And = 40,
 	Or = 41,
+	/// Call to a registered native function, takes a variable number of arguments
+	FunctionCall = 50,
 
 	LParens = 100,
 	RParens = 101,
+	/// Separates function arguments
+	Comma = 102,
 
 	// Operands (must be 128+)
 	Operand = 128
@@ -42,10 +49,14 @@ protected:
 	UPROPERTY(BlueprintReadOnly, Category="SUDS|Expression")
 	ESUDSExpressionItemType Type;
 
-	// Value if an operand node
+	// Value if an operand node, or the function name if a function call
 	UPROPERTY(BlueprintReadOnly, Category="SUDS|Expression")
 	FSUDSValue OperandValue;
 
+	/// Number of arguments if a function call
+	UPROPERTY()
+	uint8 NumArgs = 0;
+
 public:
 
 	FSUDSExpressionItem() : Type(ESUDSExpressionItemType::Operand) {}
@@ -57,6 +68,14 @@ public:
 	{
 	}
 
+	static FSUDSExpressionItem MakeFunctionCall(FName FunctionName, int32 InNumArgs)
+	{
+		FSUDSExpressionItem Item(ESUDSExpressionItemType::FunctionCall);
+		Item.OperandValue = FSUDSValue(FunctionName, false);
+		Item.NumArgs = static_cast<uint8>(InNumArgs);
+		return Item;
+	}
+
 	ESUDSExpressionItemType GetType() const { return Type; }
 	// Only valid if optype is operand
 	const FSUDSValue& GetOperandValue() const { return OperandValue; }
@@ -66,11 +85,168 @@ public:
 	bool IsOperand() const { return !IsOperator(); }
 	bool IsBinaryOperator() const
 	{
-		// Only not is unary right now
-		return Type != ESUDSExpressionItemType::Not;
+		return Type != ESUDSExpressionItemType::Not && Type != ESUDSExpressionItemType::FunctionCall;
+	}
+	bool IsFunctionCall() const { return Type == ESUDSExpressionItemType::FunctionCall; }
+	// Only valid if a function call
+	FName GetFunctionName() const { return OperandValue.GetNameValue(); }
+	/// Number of values this operator takes off the stack
+	int32 GetNumArgs() const
+	{
+		if (IsFunctionCall())
+			return NumArgs;
+		return IsBinaryOperator() ? 2 : 1;
 	}
 };
 
+/// The arguments to a native expression function. This is a view onto the evaluation stack rather than a copy, so
+/// the values are only valid for the duration of the call
+class FSUDSExpressionFunctionArgs
+{
+public:
+	FSUDSExpressionFunctionArgs(TArrayView<const FSUDSValue* const> InArgs) : Args(InArgs) {}
+
+	int32 Num() const { return Args.Num(); }
+	const FSUDSValue& operator[](int32 Index) const { return *Args[Index]; }
+
+private:
+	TArrayView<const FSUDSValue* const> Args;
+};
+
+/// Native function which can be called from expressions, e.g. count_items("Sword"). Dialogue is the dialogue the
+/// expression is being evaluated for, so the function can find its participants, world etc; it's null if the
+/// expression is evaluated outside of a dialogue. Args has exactly as many values as the function was registered with.
+typedef FSUDSValue (*FSUDSExpressionFunction)(USUDSDialogue* Dialogue, const FSUDSExpressionFunctionArgs& Args);
+
+/// A native function registered to be called from expressions, see USUDSSubsystem::RegisterExpressionFunction
+struct FSUDSExpressionFunctionInfo
+{
+	FSUDSExpressionFunction Function = nullptr;
+	int32 NumArgs = 0;
+	/// The type the function returns, if always the same. Used to specialise operators
+	ESUDSValueType ReturnType = ESUDSValueType::Variable;
+};
+
+
+/// Instructions in the compiled form of an expression. The RPN queue is kept as the readable form, this is what
+/// actually gets executed
+enum class ESUDSExpressionOpCode : uint8
+{
+	/// Push an entry from the constant pool
+	PushConstant,
+	/// Push the value of a variable, Operand is the index of the resolved variable name
+	PushVariable,
+	Not,
+	Multiply,
+	Divide,
+	Modulo,
+	Add,
+	Subtract,
+	Less,
+	LessEqual,
+	Greater,
+	GreaterEqual,
+	Equal,
+	NotEqual,
+	And,
+	Or,
+	/// Short-circuit for 'and': if the top of the stack is false, replace it with false and skip Operand instructions
+	JumpIfFalse,
+	/// Short-circuit for 'or': if the top of the stack is true, replace it with true and skip Operand instructions
+	JumpIfTrue,
+
+	// Type-specialised versions of the operators above, used when the operand types are known at import time.
+	// Each checks the types at runtime and falls back on the generic operator if they turn out to be different
+	
+	/// Both operands are ints
+	MultiplyInt,
+	DivideInt,
+	ModuloInt,
+	AddInt,
+	SubtractInt,
+	LessInt,
+	LessEqualInt,
+	GreaterInt,
+	GreaterEqualInt,
+	EqualInt,
+	NotEqualInt,
+	/// Both operands are numeric and at least one is a float
+	MultiplyFloat,
+	DivideFloat,
+	ModuloFloat,
+	AddFloat,
+	SubtractFloat,
+	LessFloat,
+	GreaterFloat,
+	/// Both operands are floats
+	LessEqualFloat,
+	GreaterEqualFloat,
+	EqualFloat,
+	NotEqualFloat,
+
+	/// Call a native function, Operand is the index of the function call. Args are replaced with the result
+	CallFunction
+};
+
+/// A single compiled instruction, deliberately kept small
+struct FSUDSExpressionInstruction
+{
+	ESUDSExpressionOpCode OpCode;
+	/// Index into the constant pool or variable list for push instructions, number of instructions to skip for jumps, unused for operators
+	uint16 Operand;
+
+	FSUDSExpressionInstruction(ESUDSExpressionOpCode InOpCode, uint16 InOperand = 0) : OpCode(InOpCode), Operand(InOperand) {}
+};
+
+/// A variable read by a compiled expression
+struct FSUDSExpressionVariable
+{
+	/// Name with global / local scope already resolved
+	FSUDSScopedVariableName Name;
+	/// The operand as parsed, which is the result if the variable isn't set
+	FSUDSValue Unset;
+
+	FSUDSExpressionVariable(const FSUDSValue& VariableOperand)
+		: Name(VariableOperand.GetVariableNameValue()),
+		  Unset(VariableOperand)
+	{
+	}
+};
+
+/// A native function called by a compiled expression
+struct FSUDSExpressionFunctionCall
+{
+	FName Name;
+	int32 NumArgs = 0;
+	/// The function bound when compiled, or null if it wasn't registered. Rebound if the function registry generation
+	/// has changed since, since functions can be unregistered or replaced at any time
+	mutable FSUDSExpressionFunction Function = nullptr;
+	mutable uint32 RegistryGeneration = 0;
+
+	/// Get the function to call, rebinding it first if the registry has changed since it was last bound
+	FSUDSExpressionFunction GetFunction() const;
+	/// Bind the function from the registry as it is now
+	void Bind() const;
+};
+
+/// Interface for being told when an expression reads a variable during evaluation, so that the value can be supplied
+/// on demand. Only variables which are actually read are reported, e.g. the right hand side of 'and' is skipped
+/// if the left hand side is false.
+class SUDS_API ISUDSExpressionVariableHandler
+{
+public:
+	virtual ~ISUDSExpressionVariableHandler() = default;
+
+	/// Called just before the expression looks up a variable. The variable state may be changed in response.
+	virtual void OnExpressionVariableRequested(const FSUDSScopedVariableName& Variable) = 0;
+
+	/// Called first when the expression reads a variable, to supply its value directly instead of it being looked up
+	/// in variable state. If this returns true, OnExpressionVariableRequested isn't called for this read.
+	virtual bool ProvideExpressionVariable(const FSUDSScopedVariableName& Variable, FSUDSValue& OutValue) { return false; }
+
+	/// The dialogue the expression is being evaluated for, which is passed to any functions it calls
+	virtual USUDSDialogue* GetExpressionDialogue() const { return nullptr; }
+};
 
 /// An expression holds an executable expression, whether it's a simple single literal
 /// or a compound expression with variables
@@ -90,20 +266,36 @@ protected:
 
 	UPROPERTY()
 	TArray<FName> VariableNames;
+
+	/// The types we expect variables to have, so that type-specialised operations can be used. Only a hint, since
+	/// variables can be changed to anything at runtime
+	UPROPERTY()
+	TMap<FName, ESUDSValueType> VariableTypeHints;
 	
 
 	/// The original string version of the expression, for reference 
 	UPROPERTY(BlueprintReadOnly, Category="SUDS|Expression")
 	FString SourceString;
 
-	FSUDSExpressionItem EvaluateOperator(ESUDSExpressionItemType Op,
-	                                     const FSUDSExpressionItem& Arg1,
-	                                     const FSUDSExpressionItem& Arg2,
-	                                     const TMap<FName, FSUDSValue>& Variables,
-	                                     const TMap<FName, FSUDSValue>& GlobalVariables) const;
-	FSUDSValue EvaluateOperand(const FSUDSValue& Operand, const TMap<FName, FSUDSValue>& Variables, const TMap<FName, FSUDSValue>& GlobalVariables) const;
+	/// Compiled instructions, built from Queue whenever it changes or is loaded. Not serialised.
+	TArray<FSUDSExpressionInstruction> Program;
+	/// Literals used by Program
+	TArray<FSUDSValue> Constants;
+	/// Variables used by Program
+	TArray<FSUDSExpressionVariable> ProgramVariables;
+	/// Functions called by Program
+	TArray<FSUDSExpressionFunctionCall> ProgramFunctions;
+	/// The deepest the evaluation stack gets when running Program, so it can be allocated up front
+	int32 MaxStackDepth = 0;
+
+	const FSUDSValue& EvaluateVariable(const FSUDSExpressionVariable& Var, const TMap<FName, FSUDSValue>& Variables, const TMap<FName, FSUDSValue>& GlobalVariables) const;
 
 	bool Validate();
+	void UpdateVariableNames();
+	/// The type of an operand if we know it ahead of time, otherwise Variable
+	ESUDSValueType GetOperandTypeHint(const FSUDSValue& Operand) const;
+	/// Build Program, Constants & ProgramVariables from Queue
+	void Compile();
 
 public:
 
@@ -116,6 +308,7 @@ public:
 		if (LiteralOrVariable.IsVariable())
 			VariableNames.Add(LiteralOrVariable.GetVariableNameValue());
 		bIsValid = true;
+		Compile();
 	}
 
 	/**
@@ -129,12 +322,38 @@ public:
 	/// Reset the expression to return true 
 	void Reset();
 
+	/**
+	 * Simplify the expression ahead of time. Sub-expressions which only involve literals are collapsed, and
+	 * operations which can't change the result are removed (e.g. "+ 0", "and true"). Called at import time.
+	 * @param bIsCondition Whether the result will only ever be used as a condition. This allows more 'and' / 'or'
+	 *   simplification, and an always-true condition becomes empty, i.e. unconditional.
+	 * @return Whether the expression was changed
+	 */
+	bool Optimise(bool bIsCondition = false);
 
-	/// Evaluate the expression and return the result, using a given variable state 
-	FSUDSValue Evaluate(const TMap<FName, FSUDSValue>& Variables, const TMap<FName, FSUDSValue>& GlobalVariables) const;
+	/**
+	 * Tell the expression what types variables are expected to have, so that it can use type-specialised operations.
+	 * It's OK if a variable turns out to have a different type at runtime, it'll just be slower.
+	 * @param VariableTypes Map of variable name to type, variables not in this expression are ignored
+	 */
+	void SetVariableTypeHints(const TMap<FName, ESUDSValueType>& VariableTypes);
+
+	/// Get the type of the result of this expression, if it can be determined ahead of time from literals and
+	/// variable type hints. Returns Variable if it can't be known until runtime.
+	ESUDSValueType GetInferredResultType() const;
+
+
+	/// Evaluate the expression and return the result, using a given variable state. If a variable handler is
+	/// supplied, it's told about each variable just before it's read
+	FSUDSValue Evaluate(const TMap<FName, FSUDSValue>& Variables,
+	                    const TMap<FName, FSUDSValue>& GlobalVariables,
+	                    ISUDSExpressionVariableHandler* VariableHandler = nullptr) const;
 
 	/// Evaluate the expression and return the result as a boolean, using a given variable state 
-	bool EvaluateBoolean(const TMap<FName, FSUDSValue>& Variables, const TMap<FName, FSUDSValue>& GlobalVariables, const FString& ErrorContext) const;
+	bool EvaluateBoolean(const TMap<FName, FSUDSValue>& Variables,
+	                     const TMap<FName, FSUDSValue>& GlobalVariables,
+	                     const FString& ErrorContext,
+	                     ISUDSExpressionVariableHandler* VariableHandler = nullptr) const;
 
 	/// Get the original source of the expression as a string
 	const FString& GetSourceString() const { return SourceString; }
@@ -145,8 +364,17 @@ public:
 	/// Whether this expression is blank
 	bool IsEmpty() const { return Queue.IsEmpty(); }
 
+	/// Whether this expression is exactly the same as another, such that one can be used in place of the other
+	bool IsIdenticalTo(const FSUDSExpression& Other) const;
+
+	/// A shared blank expression, for anything which doesn't have an expression of its own
+	static const FSUDSExpression& GetBlank();
+
 	/// Get the list of variables this expression needs
 	const TArray<FName>& GetVariableNames() const { return VariableNames; }
+
+	/// Whether this expression calls any native functions, which means the result can change even if no variables do
+	bool HasFunctionCalls() const { return ProgramFunctions.Num() > 0; }
 	
 	/// Return whether this expression is a generated random condition
 	bool IsRandomCondition() const;
@@ -158,13 +386,28 @@ public:
 	 * @param OutVal The operand value which will be populated if successful
 	 * @return True if successful, false if not
 	 */
-	static bool ParseOperand(const FString& ValueStr, FSUDSValue& OutVal);
+	static bool ParseOperand(FStringView ValueStr, FSUDSValue& OutVal);
 	
 	// Attempt to parse an operator from an incoming string
-	static ESUDSExpressionItemType ParseOperator(const FString& OpStr);
+	static ESUDSExpressionItemType ParseOperator(FStringView OpStr);
+
+	/// Split an expression string into the tokens that ParseFromString works on. Unrecognised characters are skipped.
+	static void Tokenize(FStringView Expression, TArray<FStringView>& OutTokens);
 
 	/// Access the internal RPN execution queue
-	const TArray<FSUDSExpressionItem>& GetQueue() { return Queue; }
+	const TArray<FSUDSExpressionItem>& GetQueue() const { return Queue; }
+
+	/// Access the compiled program which is actually executed
+	const TArray<FSUDSExpressionInstruction>& GetProgram() const { return Program; }
+
+	/// Get the maximum number of values on the stack while evaluating
+	int32 GetMaxStackDepth() const { return MaxStackDepth; }
+
+	/// Rebuild the compiled program after loading
+	void PostSerialize(const FArchive& Ar);
+
+	/// Import properties from text as normal, then rebuild the compiled program, e.g. when pasted in the editor
+	bool ImportTextItem(const TCHAR*& Buffer, int32 PortFlags, UObject* Parent, FOutputDevice* ErrorText);
 
 	/// Return whether this is a single literal
 	bool IsLiteral() const
@@ -196,6 +439,7 @@ public:
 	{
 		check(IsTextLiteral());
 		Queue[0].SetOperandValue(NewLiteral);
+		Compile();
 	}
 
 	/// Helper method to get boolean literal value
@@ -232,3 +476,13 @@ public:
 
 };
 
+template<>
+struct TStructOpsTypeTraits<FSUDSExpression> : public TStructOpsTypeTraitsBase2<FSUDSExpression>
+{
+	enum
+	{
+		WithPostSerialize = true,
+		WithImportTextItem = true
+	};
+};
+
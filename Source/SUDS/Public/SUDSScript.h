@@ -4,6 +4,8 @@
 
 #include "CoreMinimal.h"
 #include "Runtime/Launch/Resources/Version.h"
+#include "SUDSExpression.h"
+#include "SUDSScriptGraph.h"
 #include "Sound/DialogueVoice.h"
 #include "UObject/Object.h"
 #include "SUDSScript.generated.h"
@@ -11,8 +13,25 @@
 class USUDSScriptNode;
 class USUDSScriptNodeText;
 class USUDSScriptNodeGosub;
+
+/// Runtime information about a speaker, derived from the speaker list & voices after import / load
+struct FSUDSSpeakerInfo
+{
+	FString SpeakerID;
+	/// Key of the variable which may hold the display name of this speaker, "SpeakerName.<SpeakerID>"
+	FName DisplayNameKey;
+	/// Voice for this speaker, if using VO
+	UDialogueVoice* Voice = nullptr;
+	/// Index of the speaker assumed to be spoken to, which is the first other speaker in the script
+	int32 DefaultTargetIndex = INDEX_NONE;
+};
+
 /**
  * A single SUDS script asset.
+ * Everything a dialogue needs at runtime is prepared when the script is imported or loaded, after which running
+ * dialogues never modify the script or its nodes. Reading it from other threads is only safe while nothing else
+ * changes it either: SetSpeakerVoice updates the speaker table, reimporting replaces everything, and the expression
+ * functions & global variable providers that expressions use live in unlocked registries on USUDSSubsystem.
  */
 UCLASS(BlueprintType)
 class SUDS_API USUDSScript : public UObject
@@ -44,8 +63,56 @@ protected:
 	UPROPERTY(BlueprintReadOnly, EditDefaultsOnly, Category="SUDS")
 	TMap<FString, TObjectPtr<UDialogueVoice>> SpeakerVoices;
 
-	bool DoesAnyPathAfterLeadToChoice(USUDSScriptNode* FromNode);
-	int RecurseLookForChoice(USUDSScriptNode* CurrNode);
+	/// Pool of all the expressions used by nodes and edges. Identical expressions are only stored once, nodes and
+	/// edges refer to them by index
+	UPROPERTY()
+	TArray<FSUDSExpression> Expressions;
+
+	/// Lookup from expression hash to indexes in Expressions, only used during import to find duplicates
+	TMultiMap<uint32, int32> ExpressionLookup;
+
+	/// Incremented every time this script is (re)imported, which replaces its nodes and expressions
+	uint32 ImportGeneration = 0;
+	/// Incremented every time a speaker voice is changed at runtime
+	uint32 VoiceGeneration = 0;
+
+	/// Point all nodes and edges at their expressions in the pool
+	void BindExpressions();
+
+	/// Move expressions saved inline on nodes & edges by older versions into the pool
+	void UpgradeExpressions();
+
+	/// Prepare text formats & parameters on all nodes and edges
+	void PrepareTextFormats(bool bExtractParameterNames);
+
+	/// Flat runtime form of the node graph, derived from the nodes after import / load
+	FSUDSScriptGraph Graph;
+
+	/// Lookup from text ID to the index of the speaker node in Nodes, built on import
+	UPROPERTY()
+	TMap<FString, int32> TextIDLookup;
+
+	/// Lookup from gosub ID to the index of the gosub node in Nodes, built on import
+	UPROPERTY()
+	TMap<FString, int32> GosubIDLookup;
+
+	/// Build the text & gosub ID lookups from the nodes
+	void BuildIDLookups();
+
+	/// Build the runtime graph from the nodes
+	void BuildGraph();
+
+	/// Speaker information in the same order as Speakers, plus any speakers only referenced by nodes
+	TArray<FSUDSSpeakerInfo> SpeakerTable;
+
+	/// Build the speaker table and point text nodes at their speakers
+	void BuildSpeakerTable();
+
+	/// Whether any speaker line has a DialogueWave, so dialogues know whether to stream them
+	bool bHasVoicedLines = false;
+
+	bool DoesAnyPathAfterLeadToChoice(USUDSScriptNode* FromNode, TArray<int8>& Results);
+	int RecurseLookForChoice(USUDSScriptNode* CurrNode, TArray<int8>& Results, bool& bOutHitCycle);
 	
 public:
 	void StartImport(TArray<TObjectPtr<USUDSScriptNode>>** Nodes,
@@ -55,6 +122,39 @@ public:
 	                 TArray<FString>** SpeakerList);
 	void FinishImport();
 
+	/**
+	 * Add an expression to the pool during import. If an identical expression is already in the pool, that one
+	 * is re-used.
+	 * @param Expression The expression to add
+	 * @return The index of the expression in the pool, or INDEX_NONE if the expression is blank
+	 */
+	int32 AddExpression(const FSUDSExpression& Expression);
+
+	/// Get the pool of all expressions used in this script
+	const TArray<FSUDSExpression>& GetExpressions() const { return Expressions; }
+
+	/// Get how many times this script has been imported since loading. Anything keeping pointers into the
+	/// expression pool or caches keyed on its contents must drop them when this changes
+	uint32 GetImportGeneration() const { return ImportGeneration; }
+
+	/// Get how many times speaker voices have been changed since loading. Anything caching which sounds match
+	/// the speaker voices must drop them when this changes
+	uint32 GetVoiceGeneration() const { return VoiceGeneration; }
+
+	/// Get an expression from the pool by index, or the blank expression if the index is INDEX_NONE
+	const FSUDSExpression& GetExpression(int32 Index) const
+	{
+		return Expressions.IsValidIndex(Index) ? Expressions[Index] : FSUDSExpression::GetBlank();
+	}
+
+	/// Get the flat runtime form of the node graph, which is what dialogues traverse
+	const FSUDSScriptGraph& GetGraph() const { return Graph; }
+
+	// UObject interface
+	virtual void PostLoad() override;
+	virtual void PostDuplicate(bool bDuplicateForPIE) override;
+	// End of UObject interface
+
 	const TArray<USUDSScriptNode*>& GetNodes() const { return ObjectPtrDecay(Nodes); }
 	const TArray<USUDSScriptNode*>& GetHeaderNodes() const { return ObjectPtrDecay(HeaderNodes); }
 	const TMap<FName, int>& GetLabelList() const { return LabelList; }
@@ -88,6 +188,18 @@ public:
 	/// Get the list of speakers
 	const TArray<FString>& GetSpeakers() const { return Speakers; }
 
+	/// Whether any speaker line in this script has a DialogueWave
+	bool HasVoicedLines() const { return bHasVoicedLines; }
+
+	/// Update whether this script has voiced lines, after DialogueWaves have been assigned to lines outside of import
+	void RefreshHasVoicedLines();
+
+	/// Get runtime information about a speaker by index, as referenced by text nodes. Null if the index is invalid
+	const FSUDSSpeakerInfo* GetSpeakerInfo(int32 SpeakerIndex) const
+	{
+		return SpeakerTable.IsValidIndex(SpeakerIndex) ? &SpeakerTable[SpeakerIndex] : nullptr;
+	}
+
 	UFUNCTION(BlueprintCallable, Category="SUDS")
 	UDialogueVoice* GetSpeakerVoice(const FString& SpeakerID) const;
 
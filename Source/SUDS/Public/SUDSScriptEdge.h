@@ -7,6 +7,7 @@
 #include "SUDSScriptEdge.generated.h"
 
 class USUDSScriptNode;
+class USUDSScript;
 
 UENUM(BlueprintType)
 enum class ESUDSEdgeType : uint8
@@ -42,8 +43,19 @@ protected:
 	UPROPERTY(BlueprintReadOnly, Category="SUDS")
 	TWeakObjectPtr<USUDSScriptNode> TargetNode;
 
+	/// Index of the condition in the script's expression pool, or INDEX_NONE if unconditional
 	UPROPERTY(BlueprintReadOnly, Category="SUDS")
-	FSUDSExpression Condition;
+	int32 ConditionIndex = INDEX_NONE;
+
+	/// Condition resolved from the expression pool
+	const FSUDSExpression* Condition = nullptr;
+
+	/// Condition saved inline by older versions, moved into the expression pool on load
+	UPROPERTY()
+	FSUDSExpression Condition_DEPRECATED;
+
+	/// Index of TargetNode in the script's runtime graph, resolved after import / load
+	int32 TargetNodeIndex = INDEX_NONE;
 
 	UPROPERTY(BlueprintReadOnly, Category="SUDS")
 	int SourceLineNo;
@@ -53,11 +65,16 @@ protected:
 	TMap<FName, FSUDSExpression> UserMetadata;
 
 
-	mutable bool bFormatExtracted = false; 
-	mutable TArray<FName> ParameterNames;
-	mutable FTextFormat TextFormat;
-
-	void ExtractFormat() const;
+	/// Names of the parameters in Text, extracted on import
+	UPROPERTY()
+	TArray<FName> ParameterNames;
+	/// Whether ParameterNames has been extracted, false for assets imported before they were saved
+	UPROPERTY()
+	bool bParameterNamesExtracted = false;
+	/// ParameterNames with global / local scope resolved
+	TArray<FSUDSScopedVariableName> ParameterVariables;
+	/// Compiled format of Text, prepared when the script is imported / loaded
+	FTextFormat TextFormat;
 	
 public:
 	FSUDSScriptEdge(): Type(ESUDSEdgeType::Continue), SourceLineNo(0)
@@ -72,17 +89,36 @@ public:
 	FString GetTextID() const;
 	ESUDSEdgeType GetType() const { return Type; }
 	TWeakObjectPtr<USUDSScriptNode> GetTargetNode() const { return TargetNode; }
-	const FSUDSExpression& GetCondition() const { return Condition; }
+	/// Get the index of the target node in the script's runtime graph, or INDEX_NONE if this edge leads to the end
+	int32 GetTargetNodeIndex() const { return TargetNodeIndex; }
+	const FSUDSExpression& GetCondition() const { return Condition ? *Condition : FSUDSExpression::GetBlank(); }
+	int32 GetConditionIndex() const { return ConditionIndex; }
 	int GetSourceLineNo() const { return SourceLineNo; }
 	const TMap<FName, FSUDSExpression>& GetUserMetadata() const { return UserMetadata; }
 
 	void SetText(const FText& Text);
 	void SetType(ESUDSEdgeType InType) { Type = InType; } 
 	void SetTargetNode(const TWeakObjectPtr<USUDSScriptNode>& InTargetNode);
-	void SetCondition(const FSUDSExpression& InCondition) { Condition = InCondition; }
+	void SetConditionIndex(int32 InConditionIndex) { ConditionIndex = InConditionIndex; Condition = nullptr; }
+	/// Resolve the condition from the script's expression pool
+	void BindCondition(const TArray<FSUDSExpression>& Pool)
+	{
+		Condition = Pool.IsValidIndex(ConditionIndex) ? &Pool[ConditionIndex] : nullptr;
+	}
+	/// Move a condition saved inline by an older version into the script's expression pool
+	/// @return Whether there was a condition to move
+	bool UpgradeCondition(USUDSScript& Script);
+	/// Forget the condition resolved from the pool, for copies which may outlive it. The index is kept
+	void UnbindCondition() { Condition = nullptr; }
+	/// Resolve the target node's index in the script's runtime graph; target nodes must already have their index
+	void BindTargetNodeIndex();
 	void SetUserMetadata(const TMap<FName, FSUDSExpression>& Meta) { UserMetadata = Meta; }
 
-	const FTextFormat& GetTextFormat() const;
-	const TArray<FName>& GetParameterNames() const;
-	bool HasParameters() const;
+	/// Prepare the text format and parameters ahead of use, called when the owning script is imported or loaded.
+	/// Parameter names are extracted from the text if requested, or if they weren't saved with the asset
+	void PrepareTextFormat(bool bExtractParameterNames);
+	const FTextFormat& GetTextFormat() const { return TextFormat; }
+	const TArray<FName>& GetParameterNames() const { return ParameterNames; }
+	const TArray<FSUDSScopedVariableName>& GetParameterVariables() const { return ParameterVariables; }
+	bool HasParameters() const { return !ParameterNames.IsEmpty(); }
 };
\ No newline at end of file
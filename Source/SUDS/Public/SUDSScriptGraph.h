@@ -0,0 +1,91 @@
+﻿// Copyright Steve Streeting 2022
+// Released under the MIT license https://opensource.org/license/MIT/
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SUDSScriptNode.h"
+
+/// A node record in the flat runtime graph
+struct FSUDSScriptGraphNode
+{
+	/// Index of this node's first edge in the graph's edge array
+	int32 FirstEdge = 0;
+	/// Number of edges leading from this node
+	int32 NumEdges = 0;
+	/// Type-specific data. Gosub: index of the node at the target label, or INDEX_NONE if the label doesn't exist.
+	/// Select: 1 if this is a [random] select, 0 otherwise.
+	int32 Payload = INDEX_NONE;
+	ESUDSScriptNodeType Type = ESUDSScriptNodeType::Text;
+};
+
+/// An edge record in the flat runtime graph
+struct FSUDSScriptGraphEdge
+{
+	/// Index of the node this edge leads to, or INDEX_NONE if it leads to the end
+	int32 TargetNode = INDEX_NONE;
+	/// Index of the condition in the script's expression pool, or INDEX_NONE if unconditional
+	int32 ConditionIndex = INDEX_NONE;
+	int32 SourceLineNo = 0;
+	ESUDSEdgeType Type = ESUDSEdgeType::Continue;
+};
+
+/**
+ * Flat runtime form of a script's node graph, built from the node objects after import and on load.
+ * Nodes and edges are contiguous records which refer to each other by index; a node's edges are a contiguous run in
+ * a single edge array. Traversing the graph this way doesn't need to resolve weak pointers or touch the node objects,
+ * which remain the Blueprint / editor view of the script and are what the dialogue hands out.
+ * Main nodes come first, in the same order as the script's node list, followed by the header nodes.
+ */
+class SUDS_API FSUDSScriptGraph
+{
+protected:
+	TArray<FSUDSScriptGraphNode> Nodes;
+	TArray<FSUDSScriptGraphEdge> Edges;
+	/// Node objects by graph index, owned by the script
+	TArray<USUDSScriptNode*> NodeObjects;
+
+public:
+	/// Build the graph from node objects. Assigns each node its graph index, and resolves edge target indexes.
+	void Build(const TArray<USUDSScriptNode*>& InNodes,
+	           const TArray<USUDSScriptNode*>& InHeaderNodes,
+	           const TMap<FName, int>& LabelList);
+	void Reset();
+
+	int32 Num() const { return Nodes.Num(); }
+	bool IsValidNode(int32 Index) const { return Nodes.IsValidIndex(Index); }
+	const FSUDSScriptGraphNode& GetNode(int32 Index) const { return Nodes[Index]; }
+
+	/// Get the edges leading from a node, empty if the index is invalid
+	TArrayView<const FSUDSScriptGraphEdge> GetEdges(int32 NodeIndex) const
+	{
+		if (!Nodes.IsValidIndex(NodeIndex))
+			return TArrayView<const FSUDSScriptGraphEdge>();
+
+		const FSUDSScriptGraphNode& Node = Nodes[NodeIndex];
+		return TArrayView<const FSUDSScriptGraphEdge>(Edges.GetData() + Node.FirstEdge, Node.NumEdges);
+	}
+
+	/// Get the node object for a graph index, null if the index is INDEX_NONE
+	USUDSScriptNode* GetNodeObject(int32 Index) const
+	{
+		return NodeObjects.IsValidIndex(Index) ? NodeObjects[Index] : nullptr;
+	}
+
+	/// Get the node a gosub node jumps to, or null if it's not a gosub or the label doesn't exist
+	USUDSScriptNode* GetGosubTarget(int32 NodeIndex) const
+	{
+		if (Nodes.IsValidIndex(NodeIndex) && Nodes[NodeIndex].Type == ESUDSScriptNodeType::Gosub)
+		{
+			return GetNodeObject(Nodes[NodeIndex].Payload);
+		}
+		return nullptr;
+	}
+
+	/// Whether a node is a [random] select
+	bool IsRandomSelect(int32 NodeIndex) const
+	{
+		return Nodes.IsValidIndex(NodeIndex) &&
+			Nodes[NodeIndex].Type == ESUDSScriptNodeType::Select &&
+			Nodes[NodeIndex].Payload == 1;
+	}
+};
@@ -7,6 +7,8 @@
 #include "UObject/Object.h"
 #include "SUDSScriptNode.generated.h"
 
+class USUDSScript;
+
 UENUM(BlueprintType)
 enum class ESUDSScriptNodeType : uint8
 {
@@ -53,6 +55,8 @@ protected:
 	UPROPERTY(BlueprintReadOnly, Category="SUDS")
 	int SourceLineNo;
 
+	/// Index of this node in the script's runtime graph, assigned after import / load
+	int32 GraphIndex = INDEX_NONE;
 
 public:
 	USUDSScriptNode();
@@ -78,4 +82,22 @@ public:
 
 	/// Determine if this node is a Select node that's representing a [random]
 	bool IsRandomSelect() const;
+
+	/// Point this node and its edges at their expressions in the script's expression pool
+	virtual void BindExpressions(const TArray<FSUDSExpression>& Pool);
+
+	/// Move expressions saved inline by older versions into the script's expression pool
+	/// @return Whether anything needed moving
+	virtual bool UpgradeExpressions(USUDSScript& Script);
+
+	/// Prepare text formats for this node and its edges ahead of use, so the node is read-only at runtime
+	/// @param bExtractParameterNames Whether to extract parameter names from the text again, rather than use saved ones
+	virtual void PrepareTextFormats(bool bExtractParameterNames);
+
+	/// Get the index of this node in the script's runtime graph (see FSUDSScriptGraph)
+	int32 GetGraphIndex() const { return GraphIndex; }
+	/// Set the index of this node in the script's runtime graph
+	void SetGraphIndex(int32 InIndex) { GraphIndex = InIndex; }
+	/// Resolve the graph indexes of the nodes our edges lead to. All nodes must have their own index by now
+	void BindEdgeTargets();
 };
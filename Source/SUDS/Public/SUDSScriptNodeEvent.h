@@ -19,15 +19,26 @@ protected:
 	UPROPERTY(BlueprintReadOnly, Category="SUDS")
 	FName EventName;
 	
-	/// Literal arguments
+	/// Indexes of the arguments in the script's expression pool
 	UPROPERTY(BlueprintReadOnly, Category="SUDS")
-	TArray<FSUDSExpression> Args;
+	TArray<int32> ArgIndices;
+
+	/// Arguments resolved from the expression pool
+	TArray<const FSUDSExpression*> Args;
+
+	/// Arguments saved inline by older versions, moved into the expression pool on load
+	UPROPERTY()
+	TArray<FSUDSExpression> Args_DEPRECATED;
 
 public:
 
-	void Init(const FString& EvtName, const TArray<FSUDSExpression>& InArgs, int LineNo);
+	void Init(const FString& EvtName, const TArray<int32>& InArgIndices, int LineNo);
+	virtual void BindExpressions(const TArray<FSUDSExpression>& Pool) override;
+	virtual bool UpgradeExpressions(USUDSScript& Script) override;
 	FName GetEventName() const { return EventName; }
-	const TArray<FSUDSExpression>& GetArgs() const { return Args; }
+	/// Get the arguments, never null once bound
+	const TArray<const FSUDSExpression*>& GetArgs() const { return Args; }
+	const TArray<int32>& GetArgIndices() const { return ArgIndices; }
 	
 	
 };
@@ -20,14 +20,30 @@ protected:
 	UPROPERTY(BlueprintReadOnly, Category="SUDS")
 	FName Identifier;
 	
-	/// Expression to provide value to set
+	/// Index of the expression to provide value to set, in the script's expression pool
 	UPROPERTY(BlueprintReadOnly, Category="SUDS")
-	FSUDSExpression Expression;
+	int32 ExpressionIndex = INDEX_NONE;
+
+	/// Expression resolved from the expression pool
+	const FSUDSExpression* Expression = nullptr;
+
+	/// Expression saved inline by older versions, moved into the expression pool on load
+	UPROPERTY()
+	FSUDSExpression Expression_DEPRECATED;
+
+	/// Identifier with global / local scope resolved
+	FSUDSScopedVariableName ScopedIdentifier;
 
 public:
 
-	void Init(const FString& VarName, const FSUDSExpression& InExpression, int LineNo);
+	virtual void Serialize(FArchive& Ar) override;
+
+	void Init(const FString& VarName, int32 InExpressionIndex, int LineNo);
+	virtual void BindExpressions(const TArray<FSUDSExpression>& Pool) override;
+	virtual bool UpgradeExpressions(USUDSScript& Script) override;
 	const FName& GetIdentifier() const { return Identifier; }
-	const FSUDSExpression& GetExpression() const { return Expression; }
+	const FSUDSScopedVariableName& GetScopedIdentifier() const { return ScopedIdentifier; }
+	const FSUDSExpression& GetExpression() const { return Expression ? *Expression : FSUDSExpression::GetBlank(); }
+	int32 GetExpressionIndex() const { return ExpressionIndex; }
 	
 };
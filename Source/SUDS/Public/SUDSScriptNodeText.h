@@ -24,9 +24,9 @@ protected:
 	/// Note: if you're using voiced dialogue, see the Wave property and its subtitle functionality
 	UPROPERTY(BlueprintReadOnly, VisibleDefaultsOnly, Category="SUDS")
 	FText Text;
-	/// DialogueWave asset link for voiced dialogue
+	/// DialogueWave asset link for voiced dialogue. Soft so that waves are only loaded when a dialogue is near the line
 	UPROPERTY(BlueprintReadOnly, EditDefaultsOnly, Category="SUDS")
-	TObjectPtr<UDialogueWave> Wave;
+	TSoftObjectPtr<UDialogueWave> Wave;
 
 	/// Convenience flag to let you know whether this text node MAY HAVE choices attached
 	/// If false, there's only one way to proceed from here and no text associated with that
@@ -42,26 +42,45 @@ protected:
 	UPROPERTY()
 	TMap<FName, FSUDSExpression> UserMetadata;
 	
-	mutable bool bFormatExtracted = false; 
-	mutable TArray<FName> ParameterNames;
-	mutable FTextFormat TextFormat;
+	/// Names of the parameters in Text, extracted on import
+	UPROPERTY()
+	TArray<FName> ParameterNames;
+	/// Whether ParameterNames has been extracted, false for assets imported before they were saved
+	UPROPERTY()
+	bool bParameterNamesExtracted = false;
+	/// ParameterNames with global / local scope resolved
+	TArray<FSUDSScopedVariableName> ParameterVariables;
+	/// Compiled format of Text, prepared when the script is imported / loaded
+	FTextFormat TextFormat;
 
-	void ExtractFormat() const;
+	/// Index of the speaker in the owning script's speaker table, resolved when the script is imported / loaded
+	int32 SpeakerIndex = INDEX_NONE;
 
 public:
 	const FString& GetSpeakerID() const { return SpeakerID; }
+	/// Get the index of the speaker in the owning script's speaker table, see USUDSScript::GetSpeakerInfo
+	int32 GetSpeakerIndex() const { return SpeakerIndex; }
 	const FText& GetText() const { return Text; }
 	FString GetTextID() const;
-	UDialogueWave* GetWave() const { return Wave; }
+	/// Get the DialogueWave for this line, if it's loaded. Null if there isn't one, or it hasn't been loaded yet
+	UDialogueWave* GetWave() const { return Wave.Get(); }
+	/// Get the soft reference to the DialogueWave for this line, whether it's loaded or not
+	const TSoftObjectPtr<UDialogueWave>& GetSoftWave() const { return Wave; }
+	/// Whether this line has a DialogueWave, whether it's loaded or not
+	bool HasWave() const { return !Wave.IsNull(); }
 	/// Whether on one select path or another a choice was found
 	/// Doesn't help if within a Gosub as call site may be anywhere
 	bool MayHaveChoices() const { return bHasChoices; }
 
 	void Init(const FString& SpeakerID, const FText& Text, int LineNo);
 	void SetWave(UDialogueWave* InWave) { Wave = InWave; }
-	const FTextFormat& GetTextFormat() const;
-	const TArray<FName>& GetParameterNames() const;	
-	bool HasParameters() const;
+	void SetWave(const TSoftObjectPtr<UDialogueWave>& InWave) { Wave = InWave; }
+	void SetSpeakerIndex(int32 InIndex) { SpeakerIndex = InIndex; }
+	virtual void PrepareTextFormats(bool bExtractParameterNames) override;
+	const FTextFormat& GetTextFormat() const { return TextFormat; }
+	const TArray<FName>& GetParameterNames() const { return ParameterNames; }
+	const TArray<FSUDSScopedVariableName>& GetParameterVariables() const { return ParameterVariables; }
+	bool HasParameters() const { return !ParameterNames.IsEmpty(); }
 
 	void NotifyMayHaveChoices() { bHasChoices = true; }
 	
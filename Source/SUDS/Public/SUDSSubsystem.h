@@ -4,6 +4,8 @@
 
 #include "CoreMinimal.h"
 #include "SUDSValue.h"
+#include "SUDSExpression.h"
+#include "SUDSVariableProvider.h"
 #include "Subsystems/GameInstanceSubsystem.h"
 #include "Engine/World.h"
 #include "Engine/GameInstance.h"
@@ -16,6 +18,7 @@ struct FSoundConcurrencySettings;
 DECLARE_LOG_CATEGORY_EXTERN(LogSUDSSubsystem, Log, All);
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FOnGlobalVariableChangedEvent, FName, VariableName, const FSUDSValue&, Value, bool, bFromScript);
+DECLARE_MULTICAST_DELEGATE_ThreeParams(FOnGlobalVariableChangedEventNative, FName /*VariableName*/, const FSUDSValue& /*Value*/, bool /*bFromScript*/);
 
 /// Copy of the global state of the system
 USTRUCT(BlueprintType)
@@ -65,22 +68,41 @@ public:
 	/// Event raised when a global variable is changed. "FromScript" is true if the variable was set by the script, false if set from code
 	UPROPERTY(BlueprintAssignable)
 	FOnGlobalVariableChangedEvent OnGlobalVariableChanged;
+	/// Native version of OnGlobalVariableChanged for C++ listeners, raised just before it
+	FOnGlobalVariableChangedEventNative OnGlobalVariableChangedNative;
 
 protected:
 	UPROPERTY()
 	TObjectPtr<USoundConcurrency> VoiceConcurrency;
 	
+	/// Native functions which can be called from expressions
+	static TMap<FName, FSUDSExpressionFunctionInfo> ExpressionFunctions;
+	/// Incremented whenever ExpressionFunctions changes, so compiled expressions know to rebind their calls
+	static uint32 ExpressionFunctionGeneration;
+
+	/// Native providers of global variable values
+	static FSUDSVariableProviderRegistry GlobalVariableProviders;
+
 	/// Global variable state
 	TMap<FName, FSUDSValue> GlobalVariableState;
+	/// Versions of global variables, so dialogues can tell when cached results which used them are out of date
+	FSUDSVariableVersions GlobalVariableVersions;
 	
 	void SetGlobalVariableImpl(FName Name, const FSUDSValue& Value, bool bFromScript, int LineNo)
 	{
-		const FSUDSValue OldValue = GetGlobalVariable(Name);
-		if (!IsGlobalVariableSet(Name) ||
-			(OldValue != Value).GetBooleanValue())
+		FSUDSValue* Existing = GlobalVariableState.Find(Name);
+		if (!Existing || !Existing->EqualTo(Value))
 		{
-			GlobalVariableState.Add(Name, Value);
-			OnGlobalVariableChanged.Broadcast(Name, Value, bFromScript);
+			// Assign in place if we can, no need to rehash
+			if (Existing)
+				*Existing = Value;
+			else
+				GlobalVariableState.Add(Name, Value);
+			GlobalVariableVersions.Bump(Name);
+			// Broadcast the caller's value, listeners may set other variables & reallocate the map
+			OnGlobalVariableChangedNative.Broadcast(Name, Value, bFromScript);
+			if (OnGlobalVariableChanged.IsBound())
+				OnGlobalVariableChanged.Broadcast(Name, Value, bFromScript);
 		}
 	}	
 
@@ -144,13 +166,20 @@ public:
 	UFUNCTION(BlueprintCallable, Category="SUDS|Global Variables")
 	FSUDSValue GetGlobalVariable(FName Name) const
 	{
-		if (const auto Arg = GlobalVariableState.Find(Name))
+		if (const auto Arg = FindGlobalVariable(Name))
 		{
 			return *Arg;
 		}
 		return FSUDSValue();
 	}
 
+	/// Find a global variable without copying it, returns null if it's not set.
+	/// The pointer is only valid until global variables are next changed
+	const FSUDSValue* FindGlobalVariable(FName Name) const
+	{
+		return GlobalVariableState.Find(Name);
+	}
+
 	UFUNCTION(BlueprintCallable, Category="SUDS|Global Variables")
 	bool IsGlobalVariableSet(FName Name) const
 	{
@@ -160,6 +189,9 @@ public:
 	/// Get all variables
 	UFUNCTION(BlueprintCallable, Category="SUDS|Global Variables")
 	const TMap<FName, FSUDSValue>& GetGlobalVariables() const { return GlobalVariableState; }
+
+	/// Get the versions of global variables, which change whenever the variable does
+	const FSUDSVariableVersions& GetGlobalVariableVersions() const { return GlobalVariableVersions; }
 	
 	/**
 	 * Set a text global variable
@@ -169,7 +201,7 @@ public:
 	UFUNCTION(BlueprintCallable, Category="SUDS|Global Variables")
 	void SetGlobalVariableText(FName Name, FText Value)
 	{
-		SetGlobalVariable(Name, Value);
+		SetGlobalVariable(Name, FSUDSValue(MoveTemp(Value)));
 	}
 
 	/**
@@ -270,6 +302,58 @@ public:
 	UFUNCTION(BlueprintCallable, Category="SUDS|Global Variables")
 	void UnSetGlobalVariable(FName Name);
 
+	/**
+	 * Register a native function which can be called from expressions in scripts, e.g. count_items("Sword").
+	 * Functions must be registered before scripts using them are imported, and are best registered before scripts are
+	 * loaded, e.g. in your module's StartupModule, so that expressions can be optimised for the return type and bind
+	 * the function when compiled. Functions can still be unregistered or replaced later, compiled expressions rebind
+	 * on their next call when the registry has changed. Functions are shared by all game
+	 * instances, and are given the dialogue the expression is evaluated for so they can act on the right one.
+	 * The function registry isn't locked, so only change it on the game thread, while no dialogue is running elsewhere.
+	 * @param Name The name of the function as used in scripts
+	 * @param NumArgs The number of arguments the function takes, checked when scripts are imported
+	 * @param Function The function to call
+	 * @param ReturnType The type the function always returns, if known, so that expressions can be optimised for it
+	 */
+	static void RegisterExpressionFunction(FName Name, int32 NumArgs, FSUDSExpressionFunction Function, ESUDSValueType ReturnType = ESUDSValueType::Variable);
+
+	/// Remove a native function previously registered with RegisterExpressionFunction
+	static void UnregisterExpressionFunction(FName Name);
+
+	/// Find a native function which can be called from expressions, or null if not registered
+	static const FSUDSExpressionFunctionInfo* FindExpressionFunction(FName Name);
+
+	/// Incremented every time an expression function is registered or unregistered
+	static uint32 GetExpressionFunctionGeneration() { return ExpressionFunctionGeneration; }
+
+	/**
+	 * Register a native provider for a global variable. Whenever a script reads the variable (as global.Name), the
+	 * provider is asked for its value instead of it being looked up in the global variables. Provided values are only
+	 * cached for the current dialogue step, are never written to the global variables, don't raise change events and
+	 * aren't saved. Providers are shared by all game instances, and are passed the dialogue which wants the value.
+	 * The provider registry isn't locked, so only change it on the game thread, while no dialogue is running elsewhere.
+	 * @param Name The name of the variable, without the "global." prefix
+	 * @param Provider The provider, which can decline by returning false
+	 */
+	static void RegisterGlobalVariableProvider(FName Name, FSUDSVariableProvider Provider);
+
+	/**
+	 * Register a native provider for all global variables whose names start with a prefix.
+	 * See RegisterGlobalVariableProvider.
+	 * @param Prefix The prefix of the variable names, without the "global." prefix (case insensitive)
+	 * @param Provider The provider, which can decline by returning false
+	 */
+	static void RegisterGlobalVariableProviderPrefix(const FString& Prefix, FSUDSVariableProvider Provider);
+
+	/// Remove a provider added with RegisterGlobalVariableProvider
+	static void UnregisterGlobalVariableProvider(FName Name);
+
+	/// Remove a provider added with RegisterGlobalVariableProviderPrefix
+	static void UnregisterGlobalVariableProviderPrefix(const FString& Prefix);
+
+	/// Get the providers of global variables
+	static const FSUDSVariableProviderRegistry& GetGlobalVariableProviders() { return GlobalVariableProviders; }
+
 #if WITH_EDITORONLY_DATA
 	/// Only for use by tests / editor tools when real subsystem isn't running
 	static TMap<FName, FSUDSValue> Test_DummyGlobalVariables;
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "SUDSCommon.h"
+#include "HAL/ThreadSafeCounter.h"
 #include "SUDSValue.generated.h"
 
 
@@ -20,6 +21,18 @@ enum class ESUDSValueType : uint8
 
 	Empty = 99
 };
+
+/// Ref-counted holder for the text of a text value, so that FSUDSValue only needs a pointer for it and copies don't
+/// have to touch the FText's own shared reference
+struct FSUDSValueTextHolder
+{
+	FText Text;
+	FThreadSafeCounter RefCount;
+
+	explicit FSUDSValueTextHolder(const FText& InText) : Text(InText), RefCount(1) {}
+	explicit FSUDSValueTextHolder(FText&& InText) : Text(MoveTemp(InText)), RefCount(1) {}
+};
+
 /// Struct which can hold any of the value types that SUDS needs to use, in a Blueprint friendly manner
 /// For getting / setting these values from blueprints, see blueprint library functions SetSUDSValue<Type>() / GetSUDSValue<Type>()
 /// For convenience these are wrapped in USUDSDialogue but in e.g. event callbacks they're not
@@ -29,17 +42,113 @@ struct SUDS_API FSUDSValue
 	GENERATED_BODY()
 protected:
 	ESUDSValueType Type;
+	// Tagged by Type, only one of these is ever live
 	union
 	{
 		int32 IntValue;
 		float FloatValue;
+		// Used for variables and name values
+		FName NameValue;
+		// Used for text values, shared between copies. May be null, which means empty text
+		FSUDSValueTextHolder* TextHolder;
 	};
-	TOptional<FText> TextValue;
-	// Used for variables and name values
-	TOptional<FName> Name;
+
+	FORCEINLINE bool HasNumericPayload() const
+	{
+		return Type != ESUDSValueType::Text && Type != ESUDSValueType::Name && Type != ESUDSValueType::Variable;
+	}
+
+	FORCEINLINE const FText& GetTextValueUnchecked() const
+	{
+		return (Type == ESUDSValueType::Text && TextHolder) ? TextHolder->Text : FText::GetEmpty();
+	}
+
+	FORCEINLINE FName GetNameValueUnchecked() const
+	{
+		return (Type == ESUDSValueType::Name || Type == ESUDSValueType::Variable) ? NameValue : NAME_None;
+	}
+
+	/// Copy the type & live union member, without adding a text reference
+	FORCEINLINE void CopyPayloadBits(const FSUDSValue& Other)
+	{
+		Type = Other.Type;
+		switch (Type)
+		{
+		case ESUDSValueType::Text:
+			TextHolder = Other.TextHolder;
+			break;
+		case ESUDSValueType::Name:
+		case ESUDSValueType::Variable:
+			NameValue = Other.NameValue;
+			break;
+		default:
+			IntValue = Other.IntValue;
+			break;
+		}
+	}
+
+	FORCEINLINE void CopyPayload(const FSUDSValue& Other)
+	{
+		CopyPayloadBits(Other);
+		if (Type == ESUDSValueType::Text && TextHolder)
+			TextHolder->RefCount.Increment();
+	}
+
+	FORCEINLINE void MovePayload(FSUDSValue& Other)
+	{
+		// Steal the text reference rather than adding one
+		CopyPayloadBits(Other);
+		Other.Type = ESUDSValueType::Empty;
+		Other.IntValue = 0;
+	}
+
+	FORCEINLINE void ReleasePayload()
+	{
+		if (Type == ESUDSValueType::Text && TextHolder && TextHolder->RefCount.Decrement() == 0)
+		{
+			delete TextHolder;
+		}
+	}
+	
 public:
 
-	FSUDSValue() : Type(ESUDSValueType::Empty), IntValue(0), TextValue(FText::GetEmpty()) {}
+	FSUDSValue() : Type(ESUDSValueType::Empty), IntValue(0) {}
+
+	FSUDSValue(const FSUDSValue& Other) : Type(ESUDSValueType::Empty), IntValue(0)
+	{
+		CopyPayload(Other);
+	}
+
+	FSUDSValue(FSUDSValue&& Other) : Type(ESUDSValueType::Empty), IntValue(0)
+	{
+		MovePayload(Other);
+	}
+
+	~FSUDSValue()
+	{
+		ReleasePayload();
+	}
+
+	FSUDSValue& operator=(const FSUDSValue& Other)
+	{
+		if (this != &Other)
+		{
+			// If we share a holder with Other its count is at least 2, so releasing first is safe
+			ReleasePayload();
+			CopyPayload(Other);
+		}
+		return *this;
+	}
+
+	FSUDSValue& operator=(FSUDSValue&& Other)
+	{
+		if (this != &Other)
+		{
+			ReleasePayload();
+			MovePayload(Other);
+		}
+		return *this;
+	}
 
 	FSUDSValue(const int32 Value)
 		: Type(ESUDSValueType::Int) { IntValue = Value; }
@@ -49,13 +158,12 @@ public:
 
 	FSUDSValue(const FText& Value)
 		: Type(ESUDSValueType::Text),
-		  IntValue(0),
-		  TextValue(Value)
+		  TextHolder(new FSUDSValueTextHolder(Value))
 	{
 	}
 
 	FSUDSValue(FText&& Value)
-		: Type(ESUDSValueType::Text), IntValue(0), TextValue(MoveTemp(Value))
+		: Type(ESUDSValueType::Text), TextHolder(new FSUDSValueTextHolder(MoveTemp(Value)))
 	{
 	}
 
@@ -73,8 +181,7 @@ public:
 
 	FSUDSValue(const FName& ReferencedName, bool bIsVariable)
 	: Type(bIsVariable ? ESUDSValueType::Variable : ESUDSValueType::Name),
-	  IntValue(0),
-	  Name(ReferencedName)
+	  NameValue(ReferencedName)
 	{
 	}
 
@@ -82,6 +189,10 @@ public:
 	explicit FSUDSValue(ESUDSValueType ValType)
 		: Type(ValType), IntValue(0)
 	{
+		if (ValType == ESUDSValueType::Text)
+			TextHolder = nullptr;
+		else if (ValType == ESUDSValueType::Name || ValType == ESUDSValueType::Variable)
+			NameValue = NAME_None;
 	}
 
 	/// Whether this value is empty, i.e. hasn't been set to anything
@@ -101,7 +212,7 @@ public:
 		if (!IsEmpty() && Type != ESUDSValueType::Int && Type != ESUDSValueType::Variable)
 			UE_LOG(LogSUDS, Warning, TEXT("Getting value as int but was type %s"), *StaticEnum<ESUDSValueType>()->GetValueAsString(Type))
 		
-		return IntValue;
+		return HasNumericPayload() ? IntValue : 0;
 	}
 
 	FORCEINLINE float GetFloatValue() const
@@ -115,7 +226,7 @@ public:
 			// Allow int widening to float
 			return GetIntValue();
 		}
-		return FloatValue;
+		return HasNumericPayload() ? FloatValue : 0.0f;
 	}
 
 	FORCEINLINE const FText& GetTextValue() const
@@ -124,10 +235,7 @@ public:
 		if (!IsEmpty() && Type != ESUDSValueType::Text && Type != ESUDSValueType::Variable)
 			UE_LOG(LogSUDS, Warning, TEXT("Getting value as text but was type %s"), *StaticEnum<ESUDSValueType>()->GetValueAsString(Type))
 
-		if (TextValue.IsSet())
-			return TextValue.GetValue();
-
-		return FText::GetEmpty();
+		return GetTextValueUnchecked();
 	}
 
 	FORCEINLINE ETextGender GetGenderValue() const
@@ -136,7 +244,7 @@ public:
 		if (!IsEmpty() && Type != ESUDSValueType::Gender && Type != ESUDSValueType::Variable)
 			UE_LOG(LogSUDS, Warning, TEXT("Getting value as float but was type %s"), *StaticEnum<ESUDSValueType>()->GetValueAsString(Type))
 		
-		return static_cast<ETextGender>(IntValue);
+		return static_cast<ETextGender>(HasNumericPayload() ? IntValue : 0);
 	}
 
 	FORCEINLINE bool GetBooleanValue() const
@@ -145,7 +253,7 @@ public:
 		if (!IsEmpty() && Type != ESUDSValueType::Boolean && Type != ESUDSValueType::Variable)
 			UE_LOG(LogSUDS, Warning, TEXT("Getting value as boolean but was type %s"), *StaticEnum<ESUDSValueType>()->GetValueAsString(Type))
 
-		return IntValue != 0;
+		return HasNumericPayload() && IntValue != 0;
 	}
 
 	FORCEINLINE FName GetNameValue() const
@@ -154,10 +262,7 @@ public:
 		if (!IsEmpty() && Type != ESUDSValueType::Name && Type != ESUDSValueType::Variable)
 			UE_LOG(LogSUDS, Warning, TEXT("Getting value as Name but was type %s"), *StaticEnum<ESUDSValueType>()->GetValueAsString(Type))
 
-		if (Name.IsSet())
-			return Name.GetValue();
-
-		return NAME_None;
+		return GetNameValueUnchecked();
 	}
 
 	FORCEINLINE FName GetVariableNameValue() const
@@ -165,12 +270,24 @@ public:
 		if (!IsEmpty() && Type != ESUDSValueType::Variable)
 			UE_LOG(LogSUDS, Warning, TEXT("Getting value as variable name but was type %s"), *StaticEnum<ESUDSValueType>()->GetValueAsString(Type))
 
-		if (Name.IsSet())
-			return Name.GetValue();
+		return GetNameValueUnchecked();
+	}
+
+	/// Get the int value without any type checking, only for callers which have already checked the type
+	FORCEINLINE int32 GetIntValueUnchecked() const
+	{
+		return IntValue;
+	}
 
-		return NAME_None;
+	/// Get an int or float as a float without any type checking, only for callers which have already checked the type
+	FORCEINLINE float GetNumericValueAsFloatUnchecked() const
+	{
+		return Type == ESUDSValueType::Float ? FloatValue : static_cast<float>(IntValue);
 	}
 
+	/// Whether this is exactly the same value as another, including the type. Unlike ==, which compares in script terms
+	bool IsIdenticalTo(const FSUDSValue& Other) const;
+
 	FORCEINLINE bool IsVariable() const
 	{
 		return Type == ESUDSValueType::Variable;
@@ -187,7 +304,7 @@ public:
 		{
 		default:
 		case ESUDSValueType::Text:
-			return FFormatArgumentValue(TextValue.GetValue());
+			return FFormatArgumentValue(GetTextValueUnchecked());
 		case ESUDSValueType::Int:
 			return FFormatArgumentValue(GetIntValue());
 		case ESUDSValueType::Boolean:
@@ -210,6 +327,11 @@ public:
 		*this = RValue;
 	}
 
+	void SetValue(FSUDSValue&& RValue)
+	{
+		*this = MoveTemp(RValue);
+	}
+
 	/// Not operation, technically only valid on booleans, but not enforced so as to allow unset vars & conversions
 	FSUDSValue operator!() const
 	{
@@ -286,31 +408,31 @@ public:
 			-
 			(Rhs.GetType() == ESUDSValueType::Float ? Rhs.GetFloatValue() : Rhs.GetIntValue()));
 	}
-	FSUDSValue operator<(const FSUDSValue& Rhs) const
+	/// Script "less than" comparison as a plain bool, for native callers that don't need a value back
+	bool LessThan(const FSUDSValue& Rhs) const
 	{
 		// Don't check types here. We'll fall back on int comparisons which is important for cases where
 		// a variable hasn't been set
-		// result is boolean so no need to protect types
-		return FSUDSValue(
-			(Type == ESUDSValueType::Float ? GetFloatValue() : GetIntValue())
+		return (Type == ESUDSValueType::Float ? GetFloatValue() : GetIntValue())
 			<
-			(Rhs.GetType() == ESUDSValueType::Float ? Rhs.GetFloatValue() : Rhs.GetIntValue()));
-		
+			(Rhs.GetType() == ESUDSValueType::Float ? Rhs.GetFloatValue() : Rhs.GetIntValue());
 	}
-	FSUDSValue operator==(const FSUDSValue& Rhs) const
+
+	/// Script equality comparison as a plain bool, for native callers that don't need a value back
+	bool EqualTo(const FSUDSValue& Rhs) const
 	{
 		if (IsNumeric() || Rhs.IsNumeric())
 		{
 			if (GetType() == ESUDSValueType::Float || Rhs.GetType() == ESUDSValueType::Float)
 			{
 				// For floats, use tolerance
-				return FSUDSValue(FMath::IsNearlyEqual(
+				return FMath::IsNearlyEqual(
 					GetType() == ESUDSValueType::Int ? (float)GetIntValue() : GetFloatValue(),
-					Rhs.GetType() == ESUDSValueType::Int ? (float)Rhs.GetIntValue() : Rhs.GetFloatValue()));
+					Rhs.GetType() == ESUDSValueType::Int ? (float)Rhs.GetIntValue() : Rhs.GetFloatValue());
 			}
 			else
 			{
-				return FSUDSValue(GetIntValue() == Rhs.GetIntValue());
+				return GetIntValue() == Rhs.GetIntValue();
 			}
 		}
 		else 
@@ -327,46 +449,57 @@ public:
 			switch (UseType)
 			{
 			case ESUDSValueType::Text:
-				return FSUDSValue(GetTextValue().EqualTo(Rhs.GetTextValue()));
+				// Copies of the same text share a holder, no need to compare strings
+				if (Type == Rhs.Type && TextHolder == Rhs.TextHolder)
+					return true;
+				return GetTextValue().EqualTo(Rhs.GetTextValue());
 			case ESUDSValueType::Boolean:
-				return FSUDSValue(GetBooleanValue() == Rhs.GetBooleanValue());
+				return GetBooleanValue() == Rhs.GetBooleanValue();
 			case ESUDSValueType::Gender:
-				return FSUDSValue(GetGenderValue() == Rhs.GetGenderValue());
+				return GetGenderValue() == Rhs.GetGenderValue();
 			case ESUDSValueType::Variable:
-				return FSUDSValue(GetVariableNameValue() == Rhs.GetVariableNameValue());
+				return GetVariableNameValue() == Rhs.GetVariableNameValue();
 			case ESUDSValueType::Name:
-				return FSUDSValue(GetNameValue() == Rhs.GetNameValue());
+				return GetNameValue() == Rhs.GetNameValue();
 				// deal with int/float again here, this mops up cases where one side is an unset variable
 			case ESUDSValueType::Int:
-				return FSUDSValue(GetIntValue() == Rhs.GetIntValue());
+				return GetIntValue() == Rhs.GetIntValue();
 			case ESUDSValueType::Float:
-				return FSUDSValue(GetFloatValue() == Rhs.GetFloatValue());
+				return GetFloatValue() == Rhs.GetFloatValue();
 			default:
 				break;
 			};
 		}
-		return FSUDSValue(false);
+		return false;
+	}
+
+	FSUDSValue operator<(const FSUDSValue& Rhs) const
+	{
+		// result is boolean so no need to protect types
+		return FSUDSValue(LessThan(Rhs));
+	}
+	FSUDSValue operator==(const FSUDSValue& Rhs) const
+	{
+		return FSUDSValue(EqualTo(Rhs));
 	}
 	FSUDSValue operator<=(const FSUDSValue& Rhs) const
 	{
-		if ((*this < Rhs).GetBooleanValue())
-			return FSUDSValue(true);
-		return (*this == Rhs);
+		return FSUDSValue(LessThan(Rhs) || EqualTo(Rhs));
 	}
 
 	FSUDSValue operator>(const FSUDSValue& Rhs) const
 	{
-		return Rhs < *this;
+		return FSUDSValue(Rhs.LessThan(*this));
 	}
 
 	FSUDSValue operator>=(const FSUDSValue& Rhs) const
 	{
-		return Rhs <= *this;
+		return FSUDSValue(Rhs.LessThan(*this) || Rhs.EqualTo(*this));
 	}
 
 	FSUDSValue operator!=(const FSUDSValue& Rhs) const
 	{
-		return !(*this == Rhs);
+		return FSUDSValue(!EqualTo(Rhs));
 	}
 
 	FSUDSValue operator&&(const FSUDSValue& Rhs) const
@@ -0,0 +1,45 @@
+﻿// Copyright Steve Streeting 2022
+// Released under the MIT license https://opensource.org/license/MIT/
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SUDSValue.h"
+
+class USUDSDialogue;
+
+/// Supplies the value of a variable on demand, instead of it being stored in variable state. Called with the dialogue
+/// which wants the value and the variable name (without any "global." prefix). Return false to decline, in which case
+/// the variable is looked up as normal. A provider should be consistent about which names it provides.
+DECLARE_DELEGATE_RetVal_ThreeParams(bool, FSUDSVariableProvider, USUDSDialogue* /*Dialogue*/, FName /*VariableName*/, FSUDSValue& /*OutValue*/);
+
+/// A set of variable providers, registered either for an exact variable name or for a name prefix
+struct SUDS_API FSUDSVariableProviderRegistry
+{
+protected:
+	TMap<FName, FSUDSVariableProvider> Providers;
+	TArray<TPair<FString, FSUDSVariableProvider>> PrefixProviders;
+	/// Changes whenever providers are added or removed, so that results which relied on the old set can be discarded
+	uint32 Generation = 0;
+
+public:
+	/// Provide the variable with this exact name, replacing any existing provider for it
+	void Register(FName Name, FSUDSVariableProvider Provider);
+	/// Provide all variables whose names start with Prefix (case insensitive), replacing any existing provider for it
+	void RegisterPrefix(const FString& Prefix, FSUDSVariableProvider Provider);
+	void Unregister(FName Name);
+	void UnregisterPrefix(const FString& Prefix);
+	void Reset();
+
+	bool IsEmpty() const { return Providers.IsEmpty() && PrefixProviders.IsEmpty(); }
+	uint32 GetGeneration() const { return Generation; }
+
+	/**
+	 * Try to get a value for a variable from the registered providers. Exact names are tried first, then prefixes in
+	 * the order they were registered. Providers mustn't be registered or removed from inside this call.
+	 * @param Dialogue The dialogue asking for the value
+	 * @param Name The variable name, without any "global." prefix
+	 * @param OutValue The value, if provided
+	 * @return Whether a provider supplied the value
+	 */
+	bool Provide(USUDSDialogue* Dialogue, FName Name, FSUDSValue& OutValue) const;
+};
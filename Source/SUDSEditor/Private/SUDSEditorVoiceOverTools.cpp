@@ -333,6 +333,7 @@ void FSUDSEditorVoiceOverTools::GenerateWaveAssets(USUDSScript* Script, EObjectF
 			}
 		}
 	}
+	Script->RefreshHasVoicedLines();
 }
 
 FString FSUDSEditorVoiceOverTools::GetVoiceOutputDir(USUDSScript* Script)
@@ -2506,12 +2506,41 @@ void FSUDSScriptImporter::PopulateAsset(USUDSScript* Asset, UStringTable* String
 
 	pOutSpeakers->Append(ReferencedSpeakers);
 
-	PopulateAssetFromTree(Asset, HeaderTree, pOutHeaderNodes, pOutHeaderLabels, StringTable);
-	PopulateAssetFromTree(Asset, BodyTree, pOutNodes, pOutLabels, StringTable);
+	// Variables initialised in the header usually keep the same type, use this to specialise expressions
+	TMap<FName, ESUDSValueType> VariableTypeHints;
+	GetHeaderVariableTypes(VariableTypeHints);
+
+	PopulateAssetFromTree(Asset, HeaderTree, pOutHeaderNodes, pOutHeaderLabels, StringTable, VariableTypeHints);
+	PopulateAssetFromTree(Asset, BodyTree, pOutNodes, pOutLabels, StringTable, VariableTypeHints);
 
 	Asset->FinishImport();
 }
 
+void FSUDSScriptImporter::GetHeaderVariableTypes(TMap<FName, ESUDSValueType>& OutTypes)
+{
+	for (const auto& InNode : HeaderTree.Nodes)
+	{
+		if (InNode.NodeType == ESUDSParsedNodeType::SetVariable && InNode.Expression.IsValid())
+		{
+			// Header sets are run in order so earlier ones can inform later ones
+			FSUDSExpression Expr = InNode.Expression;
+			Expr.SetVariableTypeHints(OutTypes);
+			const ESUDSValueType Type = Expr.GetInferredResultType();
+			const FName Name(InNode.Identifier);
+			const ESUDSValueType* Existing = OutTypes.Find(Name);
+			if (Existing && *Existing != Type)
+			{
+				// Set to different types, so no reliable hint
+				OutTypes.Add(Name, ESUDSValueType::Variable);
+			}
+			else
+			{
+				OutTypes.Add(Name, Type);
+			}
+		}
+	}
+}
+
 FMD5Hash FSUDSScriptImporter::CalculateHash(const TCHAR* Buffer, int32 Len)
 {
 	FMD5Hash Hash;
@@ -2528,7 +2557,8 @@ void FSUDSScriptImporter::PopulateAssetFromTree(USUDSScript* Asset,
                                                 const FSUDSScriptImporter::ParsedTree& Tree,
                                                 TArray<TObjectPtr<USUDSScriptNode>>* pOutNodes,
                                                 TMap<FName, int>* pOutLabels,
-                                                UStringTable* StringTable)
+                                                UStringTable* StringTable,
+                                                const TMap<FName, ESUDSValueType>& VariableTypeHints)
 {
 	if (pOutNodes && pOutLabels)
 	{
@@ -2593,6 +2623,8 @@ void FSUDSScriptImporter::PopulateAssetFromTree(USUDSScript* Asset,
 						auto SetNode = NewObject<USUDSScriptNodeSet>(Asset);
 						// For text literals, re-point to string table
 						FSUDSExpression Expr = InNode.Expression;
+						Expr.Optimise();
+						Expr.SetVariableTypeHints(VariableTypeHints);
 						if (Expr.IsTextLiteral())
 						{
 #if ENGINE_MAJOR_VERSION ==5 && ENGINE_MINOR_VERSION >= 8
@@ -2602,14 +2634,21 @@ void FSUDSScriptImporter::PopulateAssetFromTree(USUDSScript* Asset,
 #endif
 							Expr.SetTextLiteralValue(FText::FromStringTable (StringTable->GetStringTableId(), InNode.TextID));
 						}
-						SetNode->Init(InNode.Identifier, Expr, InNode.SourceLineNo);
+						SetNode->Init(InNode.Identifier, Asset->AddExpression(Expr), InNode.SourceLineNo);
 						Node = SetNode;
 						break;
 					}
 				case ESUDSParsedNodeType::Event:
 					{
 						auto EvtNode = NewObject<USUDSScriptNodeEvent>(Asset);
-						EvtNode->Init(InNode.Identifier, InNode.EventArgs, InNode.SourceLineNo);
+						TArray<int32> ArgIndices;
+						for (FSUDSExpression Arg : InNode.EventArgs)
+						{
+							Arg.Optimise();
+							Arg.SetVariableTypeHints(VariableTypeHints);
+							ArgIndices.Add(Asset->AddExpression(Arg));
+						}
+						EvtNode->Init(InNode.Identifier, ArgIndices, InNode.SourceLineNo);
 						Node = EvtNode;
 						break;
 					}
@@ -2721,8 +2760,23 @@ void FSUDSScriptImporter::PopulateAssetFromTree(USUDSScript* Asset,
 
 						}
 
+						FSUDSExpression Condition = InEdge.ConditionExpression;
+						if (NewEdgeType == ESUDSEdgeType::Condition)
+						{
+							// Conditions which are always true become unconditional, and ones which are always false
+							// can never be taken so don't need to exist
+							Condition.Optimise(true);
+							if (Condition.IsLiteral() &&
+								Condition.GetLiteralValue().GetType() == ESUDSValueType::Boolean &&
+								!Condition.GetBooleanLiteralValue())
+							{
+								continue;
+							}
+						}
+
+						Condition.SetVariableTypeHints(VariableTypeHints);
 						FSUDSScriptEdge NewEdge(TargetNode, NewEdgeType, InEdge.SourceLineNo);
-						NewEdge.SetCondition(InEdge.ConditionExpression);
+						NewEdge.SetConditionIndex(Asset->AddExpression(Condition));
 						NewEdge.SetTargetNode(TargetNode);
 
 						if (!InEdge.TextID.IsEmpty() && !InEdge.Text.IsEmpty())
@@ -60,14 +60,15 @@ EReimportResult::Type USUDSScriptReimportFactory::Reimport(UObject* Obj)
 	// we need to copy those out now.
 	TMap<FString, UDialogueVoice*> PrevSpeakerVoices = Script->GetSpeakerVoices();
 	// Store the TextID -> DialogueWave, but also store the line text as well so we can detect whether it matches & warn if not
-	TMap<FString, TPair<FString, UDialogueWave*> > PrevWaves;
+	// Waves are soft references so they don't need to be loaded to do this
+	TMap<FString, TPair<FString, TSoftObjectPtr<UDialogueWave>> > PrevWaves;
 	for (auto Node : Script->GetNodes())
 	{
 		if (auto TN = Cast<USUDSScriptNodeText>(Node))
 		{
-			if (auto W = TN->GetWave())
+			if (TN->HasWave())
 			{
-				PrevWaves.Add(TN->GetTextID(), TPair<FString, UDialogueWave*>(TN->GetText().ToString(), W));
+				PrevWaves.Add(TN->GetTextID(), TPair<FString, TSoftObjectPtr<UDialogueWave>>(TN->GetText().ToString(), TN->GetSoftWave()));
 			}
 		}
 	}
@@ -106,12 +107,13 @@ EReimportResult::Type USUDSScriptReimportFactory::Reimport(UObject* Obj)
 						            TEXT(
 							            "TextID %s is linked to Dialogue Wave %s, but text has changed. Check whether this line is linked to the correct wave, and consider Writing String Keys back to script before making more script changes in future."),
 							            *TN->GetTextID(),
-							            *pWavePair->Value->GetName());
+							            *pWavePair->Value.GetAssetName());
 					}
 
 				}
 			}
 		}
+		Script->RefreshHasVoicedLines();
 		
 		Script->AssetImportData->Update(Filename);
 		
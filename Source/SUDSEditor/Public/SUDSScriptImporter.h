@@ -504,11 +504,13 @@ protected:
 	FString GenerateTextID();
 	const FSUDSParsedNode* GetNode(const ParsedTree& Tree, int Index = 0);
 	int GetGotoTargetNodeIndex(const ParsedTree& Tree, const FString& InLabel);
+	void GetHeaderVariableTypes(TMap<FName, ESUDSValueType>& OutTypes);
 	void PopulateAssetFromTree(USUDSScript* Asset,
 	                           const ParsedTree& Tree,
 	                           TArray<TObjectPtr<class USUDSScriptNode>>* pOutNodes,
 	                           TMap<FName, int>* pOutLabels,
-	                           UStringTable* StringTable);
+	                           UStringTable* StringTable,
+	                           const TMap<FName, ESUDSValueType>& VariableTypeHints);
 
 public:
 	const FSUDSParsedNode* GetNode(int Index = 0);
@@ -2,6 +2,7 @@
 #include "SUDSMessageLogger.h"
 #include "SUDSScript.h"
 #include "SUDSScriptImporter.h"
+#include "SUDSScriptNodeSet.h"
 #include "TestUtils.h"
 
 UE_DISABLE_OPTIMIZATION
@@ -183,6 +184,74 @@ NPC: Bye
 )RAWSUD";
 
 
+const FString ConstantConditionalInput = R"RAWSUD(
+NPC: Hello
+[if 1 > 2]
+    NPC: Never
+[elseif {x} > 0 and false]
+    NPC: Also never
+[elseif true and {x}]
+    NPC: When x
+[elseif 2 * 3 == 6 or {y}]
+    NPC: Always
+[else]
+    NPC: Unreachable else
+[endif]
+NPC: OK
+)RAWSUD";
+
+const FString TypeHintedConditionalInput = R"RAWSUD(
+===
+[set Gold 10]
+[set Speed 1.5]
+[set Bonus {Gold} * 2]
+[set Changeable 1]
+[set Changeable "one"]
+===
+NPC: Hello
+[if {Gold} > 5 and {Speed} < 2.0 and {Bonus} == 20 and {Changeable} == 1]
+    NPC: Rich
+[endif]
+NPC: OK
+)RAWSUD";
+
+const FString RepeatedConditionalInput = R"RAWSUD(
+NPC: Hello
+[if {HasMetBefore}]
+    NPC: Welcome back
+[endif]
+[if {Gold} >= 10]
+    NPC: Rich
+    [set Gold {Gold} - 10]
+[endif]
+[if {HasMetBefore}]
+    NPC: Again
+[endif]
+[if {Gold} >= 10]
+    NPC: Still rich
+    [set Gold {Gold} - 10]
+[endif]
+NPC: OK
+)RAWSUD";
+
+const FString HubConditionalInput = R"RAWSUD(
+NPC: Hello
+:start
+NPC: What now?
+[if {HasMetBefore}]
+    * Catch up
+        NPC: Good to see you again
+        [goto start]
+[endif]
+[if {Gold} >= 10]
+    * Buy
+        [set Gold {Gold} - 10]
+        [goto start]
+[endif]
+    * Leave
+        NPC: Bye
+)RAWSUD";
+
 IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestBasicConditionals,
 								 "SUDSTest.TestBasicConditionals",
 								 EAutomationTestFlags::EditorContext |
@@ -1042,4 +1111,352 @@ bool FTestMultipleOptionalChoicesWithLinesBetweenTextAndChoice::RunTest(const FS
 }
 
 
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestConstantConditionals,
+                                 "SUDSTest.TestConstantConditionals",
+                                 EAutomationTestFlags::EditorContext |
+                                 EAutomationTestFlags::ClientContext |
+                                 EAutomationTestFlags::ProductFilter)
+
+
+bool FTestConstantConditionals::RunTest(const FString& Parameters)
+{
+    FSUDSScriptImporter Importer;
+    FSUDSMessageLogger Logger(false);
+    TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(ConstantConditionalInput), ConstantConditionalInput.Len(), "ConstantConditionalInput", &Logger, true));
+
+    auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+    const ScopedStringTableHolder StringTableHolder;
+    Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+    // Always-false edges are removed, always-true edges become unconditional
+    USUDSScriptNode* NextNode = Script->GetFirstNode();
+    TestTextNode(this, "First node", NextNode, "NPC", "Hello");
+    TestEdge(this, "First edge", NextNode, 0, &NextNode);
+    if (TestSelectNode(this, "Select node", NextNode, 3))
+    {
+        auto SelectNode = NextNode;
+        USUDSScriptNode* TargetNode;
+        TestSelectEdge(this, "Select edge 0", SelectNode, 0, "true and {x}", &TargetNode);
+        TestTextNode(this, "Select edge 0 target", TargetNode, "NPC", "When x");
+        TestFalse("Select edge 0 simplified", SelectNode->GetEdge(0)->GetCondition().IsEmpty());
+        TestEqual("Select edge 0 simplified", SelectNode->GetEdge(0)->GetCondition().GetVariableNames().Num(), 1);
+        TestSelectEdge(this, "Select edge 1", SelectNode, 1, "2 * 3 == 6 or {y}", &TargetNode);
+        TestTextNode(this, "Select edge 1 target", TargetNode, "NPC", "Always");
+        TestTrue("Select edge 1 unconditional", SelectNode->GetEdge(1)->GetCondition().IsEmpty());
+    }
+
+    auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+    Dlg->Start();
+    TestDialogueText(this, "First node", Dlg, "NPC", "Hello");
+    TestTrue("Continue", Dlg->Continue());
+    TestDialogueText(this, "Text", Dlg, "NPC", "Always");
+    TestTrue("Continue", Dlg->Continue());
+    TestDialogueText(this, "Text", Dlg, "NPC", "OK");
+
+    Dlg->Restart(true);
+    Dlg->SetVariableBoolean("x", true);
+    TestDialogueText(this, "First node", Dlg, "NPC", "Hello");
+    TestTrue("Continue", Dlg->Continue());
+    TestDialogueText(this, "Text", Dlg, "NPC", "When x");
+
+    Script->MarkAsGarbage();
+    return true;
+}
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestTypeHintedConditionals,
+                                 "SUDSTest.TestTypeHintedConditionals",
+                                 EAutomationTestFlags::EditorContext |
+                                 EAutomationTestFlags::ClientContext |
+                                 EAutomationTestFlags::ProductFilter)
+
+
+bool FTestTypeHintedConditionals::RunTest(const FString& Parameters)
+{
+    FSUDSScriptImporter Importer;
+    FSUDSMessageLogger Logger(false);
+    TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(TypeHintedConditionalInput), TypeHintedConditionalInput.Len(), "TypeHintedConditionalInput", &Logger, true));
+
+    auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+    const ScopedStringTableHolder StringTableHolder;
+    Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+    // Header variable types are used to specialise the condition
+    USUDSScriptNode* NextNode = Script->GetFirstNode();
+    TestEdge(this, "First edge", NextNode, 0, &NextNode);
+    if (TestSelectNode(this, "Select node", NextNode, 2))
+    {
+        TArray<ESUDSExpressionOpCode> OpCodes;
+        for (const auto& Instr : NextNode->GetEdge(0)->GetCondition().GetProgram())
+        {
+            OpCodes.Add(Instr.OpCode);
+        }
+        TestTrue("Int compare", OpCodes.Contains(ESUDSExpressionOpCode::GreaterInt));
+        TestTrue("Float compare", OpCodes.Contains(ESUDSExpressionOpCode::LessFloat));
+        TestTrue("Inferred from expression", OpCodes.Contains(ESUDSExpressionOpCode::EqualInt));
+        // Changeable was set to different types so isn't specialised
+        TestTrue("Unknown compare", OpCodes.Contains(ESUDSExpressionOpCode::Equal));
+    }
+
+    auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+    Dlg->Start();
+    TestDialogueText(this, "First node", Dlg, "NPC", "Hello");
+    TestTrue("Continue", Dlg->Continue());
+    TestDialogueText(this, "Text", Dlg, "NPC", "OK");
+
+    Dlg->Restart(true);
+    Dlg->SetVariableInt("Changeable", 1);
+    TestTrue("Continue", Dlg->Continue());
+    TestDialogueText(this, "Text", Dlg, "NPC", "Rich");
+
+    // Types changed from what the header said still work
+    Dlg->Restart(true);
+    Dlg->SetVariableInt("Changeable", 1);
+    Dlg->SetVariableFloat("Gold", 5.5f);
+    TestTrue("Continue", Dlg->Continue());
+    TestDialogueText(this, "Text", Dlg, "NPC", "Rich");
+
+    Script->MarkAsGarbage();
+    return true;
+}
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestSharedConditionals,
+                                 "SUDSTest.TestSharedConditionals",
+                                 EAutomationTestFlags::EditorContext |
+                                 EAutomationTestFlags::ClientContext |
+                                 EAutomationTestFlags::ProductFilter)
+
+
+bool FTestSharedConditionals::RunTest(const FString& Parameters)
+{
+    FSUDSScriptImporter Importer;
+    FSUDSMessageLogger Logger(false);
+    TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(RepeatedConditionalInput), RepeatedConditionalInput.Len(), "RepeatedConditionalInput", &Logger, true));
+
+    auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+    const ScopedStringTableHolder StringTableHolder;
+    Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+    // Identical expressions should all point at the same pooled expression
+    auto CheckShared = [this](USUDSScript* S, const FString& Context)
+    {
+        TMap<FString, const FSUDSExpression*> Seen;
+        int NumUses = 0;
+        auto CheckExpr = [&](const FSUDSExpression& Expr)
+        {
+            if (const FSUDSExpression** pPrev = Seen.Find(Expr.GetSourceString()))
+            {
+                TestTrue(Context + TEXT(" shared ") + Expr.GetSourceString(), *pPrev == &Expr);
+            }
+            else
+            {
+                Seen.Add(Expr.GetSourceString(), &Expr);
+            }
+            TestTrue(Context + TEXT(" points into pool"), S->GetExpressions().Num() > 0 && &Expr >= &S->GetExpressions()[0] && &Expr <= &S->GetExpressions().Last());
+            ++NumUses;
+        };
+        for (auto Node : S->GetNodes())
+        {
+            for (auto& Edge : Node->GetEdges())
+            {
+                if (Edge.GetConditionIndex() != INDEX_NONE)
+                {
+                    CheckExpr(Edge.GetCondition());
+                }
+            }
+            if (auto SetNode = Cast<USUDSScriptNodeSet>(Node))
+            {
+                CheckExpr(SetNode->GetExpression());
+            }
+        }
+        TestEqual(Context + TEXT(" uses"), NumUses, 6);
+        TestEqual(Context + TEXT(" pool size"), S->GetExpressions().Num(), Seen.Num());
+    };
+    CheckShared(Script, "Imported");
+
+    // Duplicates must point into their own pool
+    auto DupScript = DuplicateObject<USUDSScript>(Script, GetTransientPackage());
+    CheckShared(DupScript, "Duplicated");
+
+    auto Dlg = USUDSLibrary::CreateDialogue(DupScript, DupScript);
+    Dlg->SetVariableBoolean("HasMetBefore", true);
+    Dlg->SetVariableInt("Gold", 15);
+    Dlg->Start();
+    TestDialogueText(this, "First node", Dlg, "NPC", "Hello");
+    TestTrue("Continue", Dlg->Continue());
+    TestDialogueText(this, "Text", Dlg, "NPC", "Welcome back");
+    TestTrue("Continue", Dlg->Continue());
+    TestDialogueText(this, "Text", Dlg, "NPC", "Rich");
+    TestTrue("Continue", Dlg->Continue());
+    TestDialogueText(this, "Text", Dlg, "NPC", "Again");
+    TestTrue("Continue", Dlg->Continue());
+    TestDialogueText(this, "Text", Dlg, "NPC", "OK");
+    TestEqual("Gold", Dlg->GetVariableInt("Gold"), 5);
+
+    DupScript->MarkAsGarbage();
+    Script->MarkAsGarbage();
+    return true;
+}
+
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestCachedConditionals,
+                                 "SUDSTest.TestCachedConditionals",
+                                 EAutomationTestFlags::EditorContext |
+                                 EAutomationTestFlags::ClientContext |
+                                 EAutomationTestFlags::ProductFilter)
+
+
+bool FTestCachedConditionals::RunTest(const FString& Parameters)
+{
+    FSUDSScriptImporter Importer;
+    FSUDSMessageLogger Logger(false);
+    TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(HubConditionalInput), HubConditionalInput.Len(), "HubConditionalInput", &Logger, true));
+
+    auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+    const ScopedStringTableHolder StringTableHolder;
+    Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+    auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+    Dlg->SetVariableBoolean("HasMetBefore", true);
+    Dlg->SetVariableInt("Gold", 10);
+    Dlg->Start();
+    TestDialogueText(this, "First node", Dlg, "NPC", "Hello");
+    TestTrue("Continue", Dlg->Continue());
+    TestDialogueText(this, "Hub", Dlg, "NPC", "What now?");
+    TestEqual("Num choices", Dlg->GetNumberOfChoices(), 3);
+
+    // Coming back round the hub with nothing changed shouldn't need to evaluate anything
+    Dlg->ResetConditionCacheStats();
+    TestTrue("Choose", Dlg->Choose(0));
+    TestDialogueText(this, "Catch up", Dlg, "NPC", "Good to see you again");
+    TestTrue("Continue", Dlg->Continue());
+    TestDialogueText(this, "Hub", Dlg, "NPC", "What now?");
+    if (TestEqual("Num choices", Dlg->GetNumberOfChoices(), 3))
+    {
+        TestEqual("Choice text", Dlg->GetChoiceText(1).ToString(), "Buy");
+    }
+    TestEqual("Cache misses", Dlg->GetConditionCacheMisses(), 0);
+    TestTrue("Cache hits", Dlg->GetConditionCacheHits() > 0);
+
+    // Changing a variable in the script means conditions using it are evaluated again
+    Dlg->ResetConditionCacheStats();
+    TestTrue("Choose", Dlg->Choose(1));
+    TestDialogueText(this, "Hub", Dlg, "NPC", "What now?");
+    if (TestEqual("Num choices", Dlg->GetNumberOfChoices(), 2))
+    {
+        TestEqual("Choice text", Dlg->GetChoiceText(0).ToString(), "Catch up");
+        TestEqual("Choice text", Dlg->GetChoiceText(1).ToString(), "Leave");
+    }
+    TestTrue("Cache misses", Dlg->GetConditionCacheMisses() > 0);
+
+    // Changing a variable from outside too
+    Dlg->SetVariableBoolean("HasMetBefore", false);
+    TestTrue("Choose", Dlg->Choose(0));
+    TestDialogueText(this, "Catch up", Dlg, "NPC", "Good to see you again");
+    TestTrue("Continue", Dlg->Continue());
+    if (TestEqual("Num choices", Dlg->GetNumberOfChoices(), 1))
+    {
+        TestEqual("Choice text", Dlg->GetChoiceText(0).ToString(), "Leave");
+    }
+
+    // Unset & restart must not use stale results
+    Dlg->Restart(true);
+    Dlg->SetVariableBoolean("HasMetBefore", true);
+    TestTrue("Continue", Dlg->Continue());
+    TestEqual("Num choices after restart", Dlg->GetNumberOfChoices(), 2);
+
+    // Reimporting replaces the expression pool, so nothing cached from the old one can be used
+    Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+    Dlg->ResetConditionCacheStats();
+    Dlg->Restart();
+    TestTrue("Continue", Dlg->Continue());
+    TestEqual("Num choices after reimport", Dlg->GetNumberOfChoices(), 2);
+    TestTrue("Cache misses after reimport", Dlg->GetConditionCacheMisses() > 0);
+    TestEqual("Cache hits after reimport", Dlg->GetConditionCacheHits(), 0);
+
+    Script->MarkAsGarbage();
+    return true;
+}
+
+const FString RepeatedRequestInput = R"RAWSUD(
+NPC: Hello
+:hub
+NPC: What do you want?
+[if {Reputation} > 0]
+    * Ask about the weather
+        NPC: Nice enough
+        [goto hub]
+[endif]
+[if {Reputation} > 1]
+    * Ask about the town
+        [set Reputation = {Reputation} + 1]
+        [goto hub]
+[endif]
+[if {Reputation} > 2]
+    * Ask about the king
+        NPC: Long may he reign
+        [goto hub]
+[endif]
+[if {Reputation} > 3]
+    * Ask for a discount
+        NPC: Not a chance
+        [goto hub]
+[endif]
+    * Leave
+        NPC: Bye
+)RAWSUD";
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestCoalescedVariableRequests,
+                                 "SUDSTest.TestCoalescedVariableRequests",
+                                 EAutomationTestFlags::EditorContext |
+                                 EAutomationTestFlags::ClientContext |
+                                 EAutomationTestFlags::ProductFilter)
+
+
+bool FTestCoalescedVariableRequests::RunTest(const FString& Parameters)
+{
+    FSUDSScriptImporter Importer;
+    FSUDSMessageLogger Logger(false);
+    TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(RepeatedRequestInput), RepeatedRequestInput.Len(), "RepeatedRequestInput", &Logger, true));
+
+    auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+    const ScopedStringTableHolder StringTableHolder;
+    Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+    auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+    int NumRequests = 0;
+    Dlg->OnVariableRequestedNative.AddLambda([&](USUDSDialogue* D, FName Name)
+    {
+        if (Name == "Reputation")
+            ++NumRequests;
+    });
+    Dlg->SetVariableInt("Reputation", 2);
+    Dlg->Start();
+    TestDialogueText(this, "First node", Dlg, "NPC", "Hello");
+
+    // All the choice conditions in the hub read Reputation, but it should only be requested once
+    NumRequests = 0;
+    TestTrue("Continue", Dlg->Continue());
+    TestDialogueText(this, "Hub", Dlg, "NPC", "What do you want?");
+    TestEqual("Num choices", Dlg->GetNumberOfChoices(), 3);
+    TestEqual("Requests", NumRequests, 1);
+    TestTrue("Skipped requests", Dlg->GetVariableRequestsSkipped() >= 3);
+
+    // New step, so requested again; then changed by the script, so requested again for the conditions
+    NumRequests = 0;
+    Dlg->ResetVariableRequestStats();
+    TestTrue("Choose", Dlg->Choose(1));
+    TestDialogueText(this, "Hub", Dlg, "NPC", "What do you want?");
+    TestEqual("Reputation", Dlg->GetVariableInt("Reputation"), 3);
+    TestEqual("Num choices", Dlg->GetNumberOfChoices(), 4);
+    TestEqual("Requests", NumRequests, 2);
+    TestTrue("Skipped requests", Dlg->GetVariableRequestsSkipped() >= 3);
+
+    Script->MarkAsGarbage();
+    return true;
+}
+
+
 UE_ENABLE_OPTIMIZATION
\ No newline at end of file
@@ -6,6 +6,10 @@
 #include "TestEventSub.h"
 #include "TestParticipant.h"
 #include "TestUtils.h"
+#include "Engine/Blueprint.h"
+#include "Engine/BlueprintGeneratedClass.h"
+#include "Kismet2/BlueprintEditorUtils.h"
+#include "Kismet2/KismetEditorUtilities.h"
 
 UE_DISABLE_OPTIMIZATION
 
@@ -275,4 +279,223 @@ bool FTestEvents::RunTest(const FString& Parameters)
 	return true;
 }
 
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestNativeEvents,
+								 "SUDSTest.TestNativeEvents",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+bool FTestNativeEvents::RunTest(const FString& Parameters)
+{
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(EventParsingInput), EventParsingInput.Len(), "EventParsingInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+	auto EvtSub = NewObject<UTestEventSub>();
+	EvtSub->Init(Dlg);
+	auto Participant = NewObject<UTestParticipant>();
+	Dlg->AddParticipant(Participant);
+
+	// Native listeners should be called after participants, but before dynamic listeners
+	TArray<FName> NativeEvents;
+	int NativeSetVars = 0;
+	FSUDSValue LastNativeSetValue;
+	int SpeakerLines = 0;
+	Dlg->OnEventNative.AddLambda([&](USUDSDialogue* D, FName EventName, const TArray<FSUDSValue>& Args)
+	{
+		TestEqual("Participant should already have event", Participant->EventRecords.Num(), NativeEvents.Num() + 1);
+		TestEqual("Dynamic listener should not have event yet", EvtSub->EventRecords.Num(), NativeEvents.Num());
+		NativeEvents.Add(EventName);
+	});
+	Dlg->OnVariableChangedNative.AddLambda([&](USUDSDialogue* D, FName VarName, const FSUDSValue& Value, bool bFromScript)
+	{
+		TestEqual("Dynamic listener should not have variable yet", EvtSub->SetVarRecords.Num(), NativeSetVars);
+		++NativeSetVars;
+		LastNativeSetValue = Value;
+	});
+	Dlg->OnSpeakerLineNative.AddLambda([&](USUDSDialogue* D)
+	{
+		++SpeakerLines;
+	});
+
+	Dlg->Start();
+	TestEqual("Speaker lines", SpeakerLines, 1);
+	TestTrue("Continue", Dlg->Continue());
+	TestEqual("Speaker lines", SpeakerLines, 2);
+	if (TestEqual("Native event count", NativeEvents.Num(), 1))
+	{
+		TestEqual("Native event name", NativeEvents[0].ToString(), "SummatHappened");
+	}
+	TestEqual("Native set var count", NativeSetVars, EvtSub->SetVarRecords.Num());
+
+	// Values set from code are moved into the dialogue, listeners must still get what was set
+	Dlg->SetVariableText("Greeting", FText::FromString("Hi"));
+	TestEqual("Native set value", LastNativeSetValue.GetTextValue().ToString(), TEXT("Hi"));
+	TestEqual("Stored value", Dlg->GetVariableText("Greeting").ToString(), TEXT("Hi"));
+
+	Script->MarkAsGarbage();
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestSetVariableOverloads,
+								 "SUDSTest.TestSetVariableOverloads",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+bool FTestSetVariableOverloads::RunTest(const FString& Parameters)
+{
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(EventParsingInput), EventParsingInput.Len(), "EventParsingInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+	int NumChanges = 0;
+	FSUDSValue LastValue;
+	Dlg->OnVariableChangedNative.AddLambda([&](USUDSDialogue* D, FName VarName, const FSUDSValue& Value, bool bFromScript)
+	{
+		++NumChanges;
+		LastValue = Value;
+	});
+
+	TestNull("Unset variable shouldn't be found", Dlg->FindVariable("Name"));
+
+	// Moved in
+	FSUDSValue Moved(FText::FromString("Bob"));
+	Dlg->SetVariable("Name", MoveTemp(Moved));
+	TestEqual("Change raised for moved value", NumChanges, 1);
+	TestEqual("Listener gets moved value", LastValue.GetTextValue().ToString(), TEXT("Bob"));
+	const FSUDSValue* Found = Dlg->FindVariable("Name");
+	if (TestNotNull("Moved value should be found", Found))
+	{
+		TestEqual("Moved value stored", Found->GetTextValue().ToString(), TEXT("Bob"));
+	}
+
+	// Copied in, the caller's value is untouched and an equal value isn't a change
+	const FSUDSValue Copied(FText::FromString("Bob"));
+	Dlg->SetVariable("Name", Copied);
+	TestEqual("Equal value shouldn't raise a change", NumChanges, 1);
+	TestEqual("Copied value untouched", Copied.GetTextValue().ToString(), TEXT("Bob"));
+
+	// Typed accessors move their argument in too, existing variables are updated in place
+	Dlg->SetVariableText("Name", FText::FromString("Alice"));
+	TestEqual("Change raised for typed accessor", NumChanges, 2);
+	TestEqual("Listener gets typed value", LastValue.GetTextValue().ToString(), TEXT("Alice"));
+	TestTrue("Existing variable updated in place", Dlg->FindVariable("Name") == Found);
+	TestEqual("Typed accessor value", Dlg->GetVariableText("Name").ToString(), TEXT("Alice"));
+	Dlg->SetVariableInt("Count", 3);
+	TestEqual("Int accessor", Dlg->GetVariableInt("Count"), 3);
+	TestEqual("Change raised for int accessor", NumChanges, 3);
+
+	// Value level overloads
+	FSUDSValue Value;
+	const FSUDSValue Three(3);
+	Value.SetValue(Three);
+	TestTrue("Copy set", Value.EqualTo(Three));
+	Value.SetValue(FSUDSValue(5));
+	TestTrue("Move set", Value.EqualTo(FSUDSValue(5)));
+	TestTrue("Less than", Three.LessThan(Value));
+	TestFalse("Not less than", Value.LessThan(Three));
+
+	Script->MarkAsGarbage();
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestParticipantDispatch,
+								 "SUDSTest.TestParticipantDispatch",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+bool FTestParticipantDispatch::RunTest(const FString& Parameters)
+{
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(EventParsingInput), EventParsingInput.Len(), "EventParsingInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+
+	// A Blueprint participant which overrides OnDialogueEvent with an empty event, so the native implementation is
+	// only reached if dispatch skips the script override
+	UBlueprint* BP = FKismetEditorUtilities::CreateBlueprint(UTestParticipant::StaticClass(),
+	                                                         GetTransientPackage(),
+	                                                         "TestScriptParticipant",
+	                                                         BPTYPE_Normal,
+	                                                         UBlueprint::StaticClass(),
+	                                                         UBlueprintGeneratedClass::StaticClass());
+	int32 NodePosY = 0;
+	FKismetEditorUtilities::AddDefaultEventNode(BP,
+	                                            FBlueprintEditorUtils::FindEventGraph(BP),
+	                                            GET_FUNCTION_NAME_CHECKED(ISUDSParticipant, OnDialogueEvent),
+	                                            USUDSParticipant::StaticClass(),
+	                                            NodePosY);
+	FKismetEditorUtilities::CompileBlueprint(BP);
+	auto ScriptParticipant = NewObject<UTestParticipant>(GetTransientPackage(), BP->GeneratedClass);
+
+	TArray<UObject*> EventOrder;
+	auto Low = NewObject<UTestParticipant>();
+	Low->TestNumber = 0;
+	Low->EventOrder = &EventOrder;
+	auto High = NewObject<UTestParticipant>();
+	High->TestNumber = 1;
+	High->EventOrder = &EventOrder;
+	ScriptParticipant->EventOrder = &EventOrder;
+	Dlg->SetParticipants({ High, Low, ScriptParticipant });
+	auto Destroyed = NewObject<UTestParticipant>();
+	Destroyed->EventOrder = &EventOrder;
+	Dlg->AddParticipant(Destroyed);
+	if (TestEqual("Participants", Dlg->GetParticipants().Num(), 4))
+	{
+		TestEqual("Lowest priority first", Dlg->GetParticipants()[0], static_cast<UObject*>(Low));
+		TestEqual("Highest priority last", Dlg->GetParticipants()[3], static_cast<UObject*>(High));
+	}
+
+	// Priority is cached when participants are sorted, so changing it has no effect until they're set again
+	High->TestNumber = 2;
+	// Participants destroyed while still in the dialogue are skipped
+	Destroyed->MarkAsGarbage();
+
+	Dlg->Start();
+	TestTrue("Continue", Dlg->Continue());
+	if (TestEqual("Event order", EventOrder.Num(), 2))
+	{
+		TestEqual("Event order 0", EventOrder[0], static_cast<UObject*>(Low));
+		TestEqual("Event order 1", EventOrder[1], static_cast<UObject*>(High));
+	}
+	TestEqual("Destroyed participant not called", Destroyed->EventRecords.Num(), 0);
+	TestEqual("Script override called instead of native", ScriptParticipant->EventRecords.Num(), 0);
+	TestTrue("Native handlers still called on script participant", ScriptParticipant->SetVarRecords.Num() > 0);
+
+	// Setting participants again picks up the new priority
+	Dlg->SetParticipants({ High, Low });
+	EventOrder.Reset();
+	Dlg->Restart();
+	TestTrue("Continue", Dlg->Continue());
+	if (TestEqual("Event order", EventOrder.Num(), 2))
+	{
+		TestEqual("Event order 0", EventOrder[0], static_cast<UObject*>(High));
+		TestEqual("Event order 1", EventOrder[1], static_cast<UObject*>(Low));
+	}
+
+	BP->MarkAsGarbage();
+	Script->MarkAsGarbage();
+	return true;
+}
+
 UE_ENABLE_OPTIMIZATION
\ No newline at end of file
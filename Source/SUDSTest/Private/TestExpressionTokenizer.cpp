@@ -0,0 +1,188 @@
+﻿#include "SUDSExpression.h"
+#include "Internationalization/Regex.h"
+#include "Misc/AutomationTest.h"
+
+UE_DISABLE_OPTIMIZATION
+
+namespace
+{
+	// The regex which used to be used to tokenize expressions, kept as the reference for parity
+	const TCHAR* ReferenceTokenRegex = TEXT("(\\{[\\w\\.]+\\}|-?\\d+(?:\\.\\d*)?|[-+*\\/%\\(\\)]|and|&&|\\|\\||or|not|\\<\\>|!=|!|\\<=?|\\>=?|==?|[mM]asculine|[fF]eminine|[nN]euter|[tT]rue|[fF]alse|\"(?:[^\"\\\\]|\\\\.)*\"|`([^`]*)`)");
+
+	void ReferenceTokenize(const FString& Expression, TArray<FString>& OutTokens)
+	{
+		const FRegexPattern Pattern(ReferenceTokenRegex);
+		FRegexMatcher Regex(Pattern, Expression);
+		while (Regex.FindNext())
+		{
+			OutTokens.Add(Regex.GetCaptureGroup(1));
+		}
+	}
+
+	// Expressions used in TestExpressions, plus some awkward cases
+	const TArray<FString> TokenizerCorpus = {
+		TEXT("3 + 4 * {Six} + 1"),
+		TEXT("-6.7 * 2 + (21.3 - 8) * 5"),
+		TEXT("11 % 5"),
+		TEXT("7.25 % 3.0"),
+		TEXT("{IsATest}"),
+		TEXT("!{SomethingFalse} && {SomethingTrue}"),
+		TEXT("{SomethingFalse} || {SomethingTrue}"),
+		TEXT("{SomethingFalse} or {SomethingTrue}"),
+		TEXT("!{SomethingFalse} && {SomethingElseFalse} && {SomethingTrue}"),
+		TEXT("!({SomethingFalse} && {SomethingElseFalse}) && {SomethingTrue}"),
+		TEXT("not {SomethingFalse} and {SomethingElseFalse} and {SomethingTrue}"),
+		TEXT("not ({SomethingFalse} and {SomethingElseFalse}) and {SomethingTrue}"),
+		TEXT("{Six} == 6"),
+		TEXT("{Six} = 6"),
+		TEXT("{Six} >= 6"),
+		TEXT("{Six} > 6"),
+		TEXT("{Six} < 6"),
+		TEXT("{Six} <= 6"),
+		TEXT("{Six} < {Seven}"),
+		TEXT("{Seven} != {Six}"),
+		TEXT("{Seven} <> {Six}"),
+		TEXT("{EightFloat} == 8.1000005"),
+		TEXT("{SomeText} == \"Hello\""),
+		TEXT("{Male} == masculine"),
+		TEXT("{Male} == Feminine"),
+		TEXT("{Neuter} == Neuter"),
+		TEXT("{global.GlobalLocalTestInt} == 3"),
+		TEXT(" + 1"),
+		TEXT("1 * "),
+		TEXT("(3 + 1"),
+		TEXT("3 + 1)"),
+		TEXT("something + 1"),
+		TEXT("3-4"),
+		TEXT("5. + .5"),
+		TEXT("True or FALSE"),
+		TEXT("`SomeName` == {Name}"),
+		TEXT("\"Escaped \\\"quotes\\\" here\""),
+		TEXT("\"Unterminated and true"),
+		TEXT("`Unterminated or {x}"),
+		TEXT("{} + {Unclosed"),
+		TEXT("word andor notneuter"),
+		TEXT("a&b|c"),
+		TEXT(""),
+	};
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestExpressionTokenizerParity,
+								 "SUDSTest.TestExpressionTokenizerParity",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestExpressionTokenizerParity::RunTest(const FString& Parameters)
+{
+	for (const FString& Expression : TokenizerCorpus)
+	{
+		TArray<FString> Expected;
+		ReferenceTokenize(Expression, Expected);
+		TArray<FStringView> Actual;
+		FSUDSExpression::Tokenize(Expression, Actual);
+
+		if (TestEqual(FString::Printf(TEXT("Token count for '%s'"), *Expression), Actual.Num(), Expected.Num()))
+		{
+			for (int i = 0; i < Expected.Num(); ++i)
+			{
+				TestEqual(FString::Printf(TEXT("Token %d for '%s'"), i, *Expression), FString(Actual[i]), Expected[i]);
+			}
+		}
+	}
+
+	// Operands should parse the same way as before
+	FSUDSValue Val;
+	TestTrue("Quoted text", FSUDSExpression::ParseOperand(TEXT("\"Say \\\"hi\\\"\""), Val));
+	TestEqual("Quoted text", Val.GetTextValue().ToString(), TEXT("Say \"hi\""));
+	TestTrue("Name", FSUDSExpression::ParseOperand(TEXT("`Some Name`"), Val));
+	TestEqual("Name", Val.GetNameValue(), FName("Some Name"));
+	TestTrue("Variable", FSUDSExpression::ParseOperand(TEXT("{global.Thing}"), Val));
+	TestEqual("Variable", Val.GetVariableNameValue(), FName("global.Thing"));
+	TestTrue("Int", FSUDSExpression::ParseOperand(TEXT("-42"), Val));
+	TestEqual("Int", Val.GetType(), ESUDSValueType::Int);
+	TestEqual("Int", Val.GetIntValue(), -42);
+	TestTrue("Long int", FSUDSExpression::ParseOperand(TEXT("1234567890"), Val));
+	TestEqual("Long int", Val.GetIntValue(), 1234567890);
+	TestTrue("Float", FSUDSExpression::ParseOperand(TEXT("5."), Val));
+	TestEqual("Float", Val.GetType(), ESUDSValueType::Float);
+	TestEqual("Float", Val.GetFloatValue(), 5.0f);
+	TestTrue("Float", FSUDSExpression::ParseOperand(TEXT("-0.25"), Val));
+	TestEqual("Float", Val.GetFloatValue(), -0.25f);
+	TestFalse("Garbage", FSUDSExpression::ParseOperand(TEXT("something"), Val));
+	TestFalse("Bad quotes", FSUDSExpression::ParseOperand(TEXT("\"a\"b\""), Val));
+
+	// Error messages
+	FSUDSExpression Expr;
+	FString ParseError;
+	TestFalse("Missing parenthesis", Expr.ParseFromString("(3 + 1", &ParseError));
+	TestEqual("Correct error", ParseError, TEXT("Mismatched parentheses"));
+	TestFalse("Invalid symbol", Expr.ParseFromString("something + 1", &ParseError));
+	TestEqual("Correct error", ParseError, TEXT("Bad expression 'something + 1'"));
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestExpressionTokenizerThroughput,
+								 "SUDSTest.Perf.TestExpressionTokenizerThroughput",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::PerfFilter)
+
+
+
+bool FTestExpressionTokenizerThroughput::RunTest(const FString& Parameters)
+{
+	constexpr int Iterations = 200;
+	int NumTokens = 0;
+
+	const double RegexStart = FPlatformTime::Seconds();
+	for (int i = 0; i < Iterations; ++i)
+	{
+		for (const FString& Expression : TokenizerCorpus)
+		{
+			TArray<FString> Tokens;
+			ReferenceTokenize(Expression, Tokens);
+			NumTokens += Tokens.Num();
+		}
+	}
+	const double RegexTime = FPlatformTime::Seconds() - RegexStart;
+
+	const double LexerStart = FPlatformTime::Seconds();
+	for (int i = 0; i < Iterations; ++i)
+	{
+		for (const FString& Expression : TokenizerCorpus)
+		{
+			TArray<FStringView> Tokens;
+			FSUDSExpression::Tokenize(Expression, Tokens);
+			NumTokens += Tokens.Num();
+		}
+	}
+	const double LexerTime = FPlatformTime::Seconds() - LexerStart;
+
+	const double ParseStart = FPlatformTime::Seconds();
+	FSUDSExpression Expr;
+	for (int i = 0; i < Iterations; ++i)
+	{
+		for (const FString& Expression : TokenizerCorpus)
+		{
+			Expr.ParseFromString(Expression, nullptr);
+		}
+	}
+	const double ParseTime = FPlatformTime::Seconds() - ParseStart;
+
+	const int NumExpressions = Iterations * TokenizerCorpus.Num();
+	AddInfo(FString::Printf(TEXT("Tokenized %d expressions (%d tokens): regex %.2fms, lexer %.2fms (%.1fx)"),
+	                        NumExpressions, NumTokens / 2, RegexTime * 1000.0, LexerTime * 1000.0,
+	                        LexerTime > 0 ? RegexTime / LexerTime : 0.0));
+	AddInfo(FString::Printf(TEXT("Full ParseFromString: %.2fms, %.0f expressions/sec"),
+	                        ParseTime * 1000.0, ParseTime > 0 ? NumExpressions / ParseTime : 0.0));
+
+	TestTrue("Lexer is faster than regex", LexerTime < RegexTime);
+
+	return true;
+}
+
+UE_ENABLE_OPTIMIZATION
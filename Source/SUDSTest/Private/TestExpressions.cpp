@@ -1,5 +1,11 @@
 ﻿#include "SUDSExpression.h"
+#include "SUDSDialogue.h"
+#include "SUDSSubsystem.h"
+#include "HAL/MemoryBase.h"
 #include "Misc/AutomationTest.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/NameAsStringProxyArchive.h"
 
 UE_DISABLE_OPTIMIZATION
 
@@ -169,6 +175,20 @@ bool FTestExpressions::RunTest(const FString& Parameters)
 	TestTrue("Eval", Expr.Evaluate(Variables, GlobalVariables).GetBooleanValue());
 	TestTrue("GlobalTest", Expr.ParseFromString("{global.GlobalLocalTestInt} == 3", nullptr));
 	TestTrue("Eval", Expr.Evaluate(Variables, GlobalVariables).GetBooleanValue());
+	TestTrue("GlobalTest", Expr.ParseFromString("{Global.GlobalLocalTestInt} + {GlobalLocalTestInt} == 23", nullptr));
+	TestTrue("Eval", Expr.Evaluate(Variables, GlobalVariables).GetBooleanValue());
+	// Unset globals fall back on a local with the full name, as they always have
+	Variables.Add("global.LocalWithPrefix", 5);
+	TestTrue("GlobalTest", Expr.ParseFromString("{global.LocalWithPrefix} == 5", nullptr));
+	TestTrue("Eval", Expr.Evaluate(Variables, GlobalVariables).GetBooleanValue());
+
+	const FSUDSScopedVariableName GlobalName(FName("GLOBAL.Something"));
+	TestTrue("Scoped name", GlobalName.bIsGlobal);
+	TestEqual("Scoped name", GlobalName.ScopedName.ToString(), "Something");
+	TestEqual("Scoped name", GlobalName.Name.ToString(), "GLOBAL.Something");
+	const FSUDSScopedVariableName LocalName(FName("Something"));
+	TestFalse("Scoped name", LocalName.bIsGlobal);
+	TestEqual("Scoped name", LocalName.ScopedName.ToString(), "Something");
 	
 
 	
@@ -204,6 +224,550 @@ bool FTestBadExpressions::RunTest(const FString& Parameters)
 	return true;
 }
 
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestCompiledExpressions,
+								 "SUDSTest.TestCompiledExpressions",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestCompiledExpressions::RunTest(const FString& Parameters)
+{
+	FSUDSExpression Expr;
+	TMap<FName, FSUDSValue> Variables;
+	TMap<FName, FSUDSValue> GlobalVariables;
+	Variables.Add("Gold", 25);
+	Variables.Add("HasMet", FSUDSValue(true));
+
+	TestTrue("Parse", Expr.ParseFromString("{Gold} >= 10 and {HasMet}", nullptr));
+	auto& Program = Expr.GetProgram();
+	if (TestEqual("Program len", Program.Num(), 6))
+	{
+		TestEqual("Program 0", Program[0].OpCode, ESUDSExpressionOpCode::PushVariable);
+		TestEqual("Program 1", Program[1].OpCode, ESUDSExpressionOpCode::PushConstant);
+		TestEqual("Program 2", Program[2].OpCode, ESUDSExpressionOpCode::GreaterEqual);
+		TestEqual("Program 3", Program[3].OpCode, ESUDSExpressionOpCode::JumpIfFalse);
+		TestEqual("Program 3 jump", (int)Program[3].Operand, 2);
+		TestEqual("Program 4", Program[4].OpCode, ESUDSExpressionOpCode::PushVariable);
+		TestEqual("Program 5", Program[5].OpCode, ESUDSExpressionOpCode::And);
+	}
+	TestEqual("Stack depth", Expr.GetMaxStackDepth(), 2);
+	TestTrue("Eval", Expr.EvaluateBoolean(Variables, GlobalVariables, ""));
+
+	// Program isn't serialised, make sure it's rebuilt on load
+	TArray<uint8> Bytes;
+	{
+		FMemoryWriter Writer(Bytes);
+		FNameAsStringProxyArchive Ar(Writer);
+		FSUDSExpression::StaticStruct()->SerializeItem(Ar, &Expr, nullptr);
+	}
+	FSUDSExpression Loaded;
+	{
+		FMemoryReader Reader(Bytes);
+		FNameAsStringProxyArchive Ar(Reader);
+		FSUDSExpression::StaticStruct()->SerializeItem(Ar, &Loaded, nullptr);
+	}
+	TestEqual("Loaded program len", Loaded.GetProgram().Num(), 6);
+	TestEqual("Loaded stack depth", Loaded.GetMaxStackDepth(), 2);
+	TestTrue("Loaded eval", Loaded.EvaluateBoolean(Variables, GlobalVariables, ""));
+	Variables.Add("Gold", 5);
+	TestFalse("Loaded eval changed", Loaded.EvaluateBoolean(Variables, GlobalVariables, ""));
+
+	// Text import (e.g. copy & paste) compiles too, expressions are never compiled when evaluated
+	FString ExprText;
+	FSUDSExpression::StaticStruct()->ExportText(ExprText, &Expr, nullptr, nullptr, PPF_None, nullptr);
+	FSUDSExpression Imported;
+	FSUDSExpression::StaticStruct()->ImportText(*ExprText, &Imported, nullptr, PPF_None, GLog, TEXT("FSUDSExpression"));
+	TestEqual("Imported program len", Imported.GetProgram().Num(), 6);
+	TestFalse("Imported eval", Imported.EvaluateBoolean(Variables, GlobalVariables, ""));
+
+	// Single value constructor
+	FSUDSExpression Literal(FSUDSValue(12));
+	TestEqual("Literal program len", Literal.GetProgram().Num(), 1);
+	TestEqual("Literal eval", Literal.Evaluate(Variables, GlobalVariables).GetIntValue(), 12);
+
+	// Blank is always true
+	Expr.Reset();
+	TestEqual("Reset program len", Expr.GetProgram().Num(), 0);
+	TestTrue("Blank eval", Expr.EvaluateBoolean(Variables, GlobalVariables, ""));
+	
+	return true;
+}
+
+
+
+/// Wraps GMalloc while in scope to count allocations made on this thread
+class FTestScopedAllocationCounter : public FMalloc
+{
+public:
+	int32 NumAllocations = 0;
+
+	FTestScopedAllocationCounter() : Inner(GMalloc), ThreadId(FPlatformTLS::GetCurrentThreadId())
+	{
+		GMalloc = this;
+	}
+
+	~FTestScopedAllocationCounter()
+	{
+		GMalloc = Inner;
+	}
+
+	virtual void* Malloc(SIZE_T Count, uint32 Alignment) override
+	{
+		RecordAllocation();
+		return Inner->Malloc(Count, Alignment);
+	}
+
+	virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override
+	{
+		RecordAllocation();
+		return Inner->Realloc(Original, Count, Alignment);
+	}
+
+	virtual void Free(void* Original) override { Inner->Free(Original); }
+	virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return Inner->GetAllocationSize(Original, SizeOut); }
+	virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override { return Inner->QuantizeSize(Count, Alignment); }
+	virtual bool IsInternallyThreadSafe() const override { return Inner->IsInternallyThreadSafe(); }
+	virtual const TCHAR* GetDescriptiveName() override { return TEXT("SUDSTestAllocationCounter"); }
+
+private:
+	FMalloc* Inner;
+	uint32 ThreadId;
+
+	void RecordAllocation()
+	{
+		// Other threads carry on allocating while we're installed, ignore them
+		if (FPlatformTLS::GetCurrentThreadId() == ThreadId)
+		{
+			++NumAllocations;
+		}
+	}
+};
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestExpressionAllocations,
+								 "SUDSTest.TestExpressionAllocations",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestExpressionAllocations::RunTest(const FString& Parameters)
+{
+	TMap<FName, FSUDSValue> Variables;
+	TMap<FName, FSUDSValue> GlobalVariables;
+	Variables.Add("Gold", 25);
+	Variables.Add("HasMet", FSUDSValue(true));
+	Variables.Add("Six", 6);
+	GlobalVariables.Add("Chapter", 2);
+
+	FSUDSExpression Condition;
+	TestTrue("Parse", Condition.ParseFromString("{Gold} >= 10 and {HasMet} and {global.Chapter} > 1", nullptr));
+	// Deeper than any small inline buffer would cope with
+	FSUDSExpression Deep;
+	TestTrue("Parse", Deep.ParseFromString("1 + (2 * (3 + (4 * (5 + (6 * (7 + (8 * (9 + (10 * {Six}))))))))) > 0 or not {HasMet}", nullptr));
+	TestEqual("Deep stack depth", Deep.GetMaxStackDepth(), 11);
+
+	const FString ErrorContext("TestExpressionAllocations");
+	bool bResult = true;
+	int32 NumAllocations;
+	{
+		FTestScopedAllocationCounter Counter;
+		for (int i = 0; i < 100; ++i)
+		{
+			bResult = bResult && Condition.EvaluateBoolean(Variables, GlobalVariables, ErrorContext);
+			bResult = bResult && Deep.EvaluateBoolean(Variables, GlobalVariables, ErrorContext);
+		}
+		NumAllocations = Counter.NumAllocations;
+	}
+	TestTrue("Results", bResult);
+	TestEqual("Heap allocations during evaluation", NumAllocations, 0);
+
+	return true;
+}
+
+
+
+class FTestVariableRequestRecorder : public ISUDSExpressionVariableHandler
+{
+public:
+	TArray<FName> Requested;
+	TMap<FName, FSUDSValue>& Variables;
+
+	FTestVariableRequestRecorder(TMap<FName, FSUDSValue>& InVariables) : Variables(InVariables) {}
+
+	virtual void OnExpressionVariableRequested(const FSUDSScopedVariableName& Variable) override
+	{
+		Requested.Add(Variable.Name);
+		// Supply on demand
+		if (Variable.Name == "OnDemand")
+		{
+			Variables.Add(Variable.Name, 42);
+		}
+	}
+};
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestShortCircuitExpressions,
+								 "SUDSTest.TestShortCircuitExpressions",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
 
+bool FTestShortCircuitExpressions::RunTest(const FString& Parameters)
+{
+	FSUDSExpression Expr;
+	TMap<FName, FSUDSValue> Variables;
+	TMap<FName, FSUDSValue> GlobalVariables;
+	Variables.Add("SomethingFalse", FSUDSValue(false));
+	Variables.Add("SomethingTrue", FSUDSValue(true));
+
+	FTestVariableRequestRecorder Recorder(Variables);
+	TestTrue("Parse", Expr.ParseFromString("{SomethingFalse} and {Expensive}", nullptr));
+	TestFalse("Eval", Expr.EvaluateBoolean(Variables, GlobalVariables, "", &Recorder));
+	if (TestEqual("Requested count", Recorder.Requested.Num(), 1))
+	{
+		TestEqual("Requested name", Recorder.Requested[0].ToString(), "SomethingFalse");
+	}
+	TestEqual("Result type", Expr.Evaluate(Variables, GlobalVariables).GetType(), ESUDSValueType::Boolean);
+
+	Recorder.Requested.Empty();
+	TestTrue("Parse", Expr.ParseFromString("{SomethingTrue} or {Expensive}", nullptr));
+	TestTrue("Eval", Expr.EvaluateBoolean(Variables, GlobalVariables, "", &Recorder));
+	if (TestEqual("Requested count", Recorder.Requested.Num(), 1))
+	{
+		TestEqual("Requested name", Recorder.Requested[0].ToString(), "SomethingTrue");
+	}
+
+	// Nested, the outer or should skip the whole parenthesised and
+	Recorder.Requested.Empty();
+	TestTrue("Parse", Expr.ParseFromString("{SomethingTrue} or ({Expensive} and {AlsoExpensive})", nullptr));
+	TestTrue("Eval", Expr.EvaluateBoolean(Variables, GlobalVariables, "", &Recorder));
+	TestEqual("Requested count", Recorder.Requested.Num(), 1);
+
+	// RHS still evaluated when needed
+	Recorder.Requested.Empty();
+	TestTrue("Parse", Expr.ParseFromString("{SomethingTrue} and {OnDemand} == 42", nullptr));
+	TestTrue("Eval", Expr.EvaluateBoolean(Variables, GlobalVariables, "", &Recorder));
+	if (TestEqual("Requested count", Recorder.Requested.Num(), 2))
+	{
+		TestEqual("Requested name", Recorder.Requested[1].ToString(), "OnDemand");
+	}
+
+	Recorder.Requested.Empty();
+	TestTrue("Parse", Expr.ParseFromString("{SomethingFalse} or not {SomethingTrue}", nullptr));
+	TestFalse("Eval", Expr.EvaluateBoolean(Variables, GlobalVariables, "", &Recorder));
+	TestEqual("Requested count", Recorder.Requested.Num(), 2);
+	
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestOptimiseExpressions,
+								 "SUDSTest.TestOptimiseExpressions",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestOptimiseExpressions::RunTest(const FString& Parameters)
+{
+	FSUDSExpression Expr;
+	TMap<FName, FSUDSValue> Variables;
+	TMap<FName, FSUDSValue> GlobalVariables;
+	Variables.Add("Six", 6);
+	Variables.Add("SixFloat", 6.0f);
+	Variables.Add("SomethingTrue", true);
+
+	// Literal sub-expressions collapse
+	TestTrue("Parse", Expr.ParseFromString("3 + 4 * 2", nullptr));
+	TestTrue("Optimised", Expr.Optimise());
+	TestTrue("Literal", Expr.IsLiteral());
+	TestEqual("Value", Expr.GetIntLiteralValue(), 11);
+	TestEqual("Program", Expr.GetProgram().Num(), 1);
+
+	TestTrue("Parse", Expr.ParseFromString("{Six} + 4 * 2", nullptr));
+	TestTrue("Optimised", Expr.Optimise());
+	TestEqual("Queue", Expr.GetQueue().Num(), 3);
+	TestEqual("Eval", Expr.Evaluate(Variables, GlobalVariables).GetIntValue(), 14);
+	TestEqual("Source string unchanged", Expr.GetSourceString(), "{Six} + 4 * 2");
+
+	TestTrue("Parse", Expr.ParseFromString("not (2 > 1)", nullptr));
+	TestTrue("Optimised", Expr.Optimise());
+	TestTrue("Literal", Expr.IsLiteral());
+	TestFalse("Value", Expr.GetBooleanLiteralValue());
+
+	// Integer division by zero is left alone
+	TestTrue("Parse", Expr.ParseFromString("3 / 0", nullptr));
+	TestFalse("Not optimised", Expr.Optimise());
+	TestFalse("Literal", Expr.IsLiteral());
+
+	// Identities are only removed when we know the type doesn't change
+	TestTrue("Parse", Expr.ParseFromString("{Six} * 1.5 + 0", nullptr));
+	TestTrue("Optimised", Expr.Optimise());
+	TestEqual("Queue", Expr.GetQueue().Num(), 3);
+	TestEqual("Eval", Expr.Evaluate(Variables, GlobalVariables).GetFloatValue(), 9.0f);
+	TestTrue("Parse", Expr.ParseFromString("({Six} + 1) * 1", nullptr));
+	TestFalse("Not optimised", Expr.Optimise());
+	TestTrue("Parse", Expr.ParseFromString("{SixFloat} - 0", nullptr));
+	TestFalse("Not optimised", Expr.Optimise());
+	TestTrue("Parse", Expr.ParseFromString("{Six} + 0.0", nullptr));
+	TestFalse("Not optimised", Expr.Optimise());
+	TestEqual("Eval", Expr.Evaluate(Variables, GlobalVariables).GetType(), ESUDSValueType::Float);
+
+	// Boolean simplification
+	TestTrue("Parse", Expr.ParseFromString("{Six} > 1 and false", nullptr));
+	TestTrue("Optimised", Expr.Optimise());
+	TestTrue("Literal", Expr.IsLiteral());
+	TestFalse("Value", Expr.GetBooleanLiteralValue());
+	TestEqual("Variables", Expr.GetVariableNames().Num(), 0);
+
+	TestTrue("Parse", Expr.ParseFromString("true or {SomethingTrue}", nullptr));
+	TestTrue("Optimised", Expr.Optimise());
+	TestTrue("Value", Expr.GetBooleanLiteralValue());
+
+	TestTrue("Parse", Expr.ParseFromString("{Six} > 1 and true", nullptr));
+	TestTrue("Optimised", Expr.Optimise());
+	TestEqual("Queue", Expr.GetQueue().Num(), 3);
+
+	// Can't tell whether a variable is a boolean, unless only used as a condition
+	TestTrue("Parse", Expr.ParseFromString("true and {SomethingTrue}", nullptr));
+	TestFalse("Not optimised", Expr.Optimise());
+	TestTrue("Optimised", Expr.Optimise(true));
+	TestEqual("Queue", Expr.GetQueue().Num(), 1);
+	TestTrue("Eval", Expr.EvaluateBoolean(Variables, GlobalVariables, ""));
+
+	// Always true conditions become unconditional
+	TestTrue("Parse", Expr.ParseFromString("1 < 2 or {SomethingTrue}", nullptr));
+	TestTrue("Optimised", Expr.Optimise(true));
+	TestTrue("Empty", Expr.IsEmpty());
+	TestTrue("Valid", Expr.IsValid());
+	TestTrue("Eval", Expr.EvaluateBoolean(Variables, GlobalVariables, ""));
+
+	// Nothing to do
+	TestTrue("Parse", Expr.ParseFromString("{Six} == 6 and {SomethingTrue}", nullptr));
+	TestFalse("Not optimised", Expr.Optimise(true));
+	TestEqual("Queue", Expr.GetQueue().Num(), 5);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestTypeSpecialisedExpressions,
+								 "SUDSTest.TestTypeSpecialisedExpressions",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestTypeSpecialisedExpressions::RunTest(const FString& Parameters)
+{
+	FSUDSExpression Expr;
+	TMap<FName, FSUDSValue> Variables;
+	TMap<FName, FSUDSValue> GlobalVariables;
+	TMap<FName, ESUDSValueType> TypeHints;
+	TypeHints.Add("Gold", ESUDSValueType::Int);
+	TypeHints.Add("Speed", ESUDSValueType::Float);
+	Variables.Add("Gold", 25);
+	Variables.Add("Speed", 1.5f);
+
+	// Literals are enough on their own
+	TestTrue("Parse", Expr.ParseFromString("3 + 4 * 2.0", nullptr));
+	TestEqual("Inferred", Expr.GetInferredResultType(), ESUDSValueType::Float);
+	TestEqual("Op", Expr.GetProgram()[3].OpCode, ESUDSExpressionOpCode::MultiplyFloat);
+	TestEqual("Op", Expr.GetProgram()[4].OpCode, ESUDSExpressionOpCode::AddFloat);
+	TestEqual("Eval", Expr.Evaluate(Variables, GlobalVariables).GetFloatValue(), 11.0f);
+
+	// Unknown variables stay generic
+	TestTrue("Parse", Expr.ParseFromString("{Gold} + 1 > 20", nullptr));
+	TestEqual("Inferred", Expr.GetInferredResultType(), ESUDSValueType::Boolean);
+	TestEqual("Op", Expr.GetProgram()[2].OpCode, ESUDSExpressionOpCode::Add);
+	TestEqual("Op", Expr.GetProgram()[4].OpCode, ESUDSExpressionOpCode::Greater);
+
+	Expr.SetVariableTypeHints(TypeHints);
+	TestEqual("Op", Expr.GetProgram()[2].OpCode, ESUDSExpressionOpCode::AddInt);
+	TestEqual("Op", Expr.GetProgram()[4].OpCode, ESUDSExpressionOpCode::GreaterInt);
+	TestTrue("Eval", Expr.EvaluateBoolean(Variables, GlobalVariables, ""));
+
+	TestTrue("Parse", Expr.ParseFromString("{Gold} * {Speed}", nullptr));
+	Expr.SetVariableTypeHints(TypeHints);
+	TestEqual("Inferred", Expr.GetInferredResultType(), ESUDSValueType::Float);
+	TestEqual("Op", Expr.GetProgram()[2].OpCode, ESUDSExpressionOpCode::MultiplyFloat);
+	TestEqual("Eval", Expr.Evaluate(Variables, GlobalVariables).GetFloatValue(), 37.5f);
+
+	// Mixed int / float equality is false in the generic operators, so isn't specialised
+	TestTrue("Parse", Expr.ParseFromString("{Speed} <= 1.5 and {Gold} >= 25.0", nullptr));
+	Expr.SetVariableTypeHints(TypeHints);
+	TestEqual("Op", Expr.GetProgram()[2].OpCode, ESUDSExpressionOpCode::LessEqualFloat);
+	TestEqual("Op", Expr.GetProgram()[6].OpCode, ESUDSExpressionOpCode::GreaterEqual);
+	TestFalse("Eval", Expr.EvaluateBoolean(Variables, GlobalVariables, ""));
+
+	// Hints only apply to variables in the expression, and survive a round trip
+	TestTrue("Parse", Expr.ParseFromString("{Gold} % 7 == 4", nullptr));
+	Expr.SetVariableTypeHints(TypeHints);
+	TArray<uint8> Bytes;
+	{
+		FMemoryWriter Writer(Bytes);
+		FNameAsStringProxyArchive Ar(Writer);
+		FSUDSExpression::StaticStruct()->SerializeItem(Ar, &Expr, nullptr);
+	}
+	FSUDSExpression Loaded;
+	{
+		FMemoryReader Reader(Bytes);
+		FNameAsStringProxyArchive Ar(Reader);
+		FSUDSExpression::StaticStruct()->SerializeItem(Ar, &Loaded, nullptr);
+	}
+	TestEqual("Loaded op", Loaded.GetProgram()[2].OpCode, ESUDSExpressionOpCode::ModuloInt);
+	TestEqual("Loaded op", Loaded.GetProgram()[4].OpCode, ESUDSExpressionOpCode::EqualInt);
+	TestTrue("Loaded eval", Loaded.EvaluateBoolean(Variables, GlobalVariables, ""));
+
+	// Wrong hints fall back on the generic behaviour
+	Variables.Add("Gold", 25.5f);
+	TestFalse("Fallback eval", Loaded.EvaluateBoolean(Variables, GlobalVariables, ""));
+	TestTrue("Parse", Expr.ParseFromString("{Gold} + 1", nullptr));
+	Expr.SetVariableTypeHints(TypeHints);
+	TestEqual("Fallback type", Expr.Evaluate(Variables, GlobalVariables).GetType(), ESUDSValueType::Float);
+	TestEqual("Fallback eval", Expr.Evaluate(Variables, GlobalVariables).GetFloatValue(), 26.5f);
+	Variables.Remove("Gold");
+	// Same as generic, unset variables are widened along with the other side
+	TestEqual("Unset eval", Expr.Evaluate(Variables, GlobalVariables).GetFloatValue(), 1.0f);
+
+	return true;
+}
+
+namespace
+{
+	int TestRollCount = 0;
+
+	FSUDSValue TestCountItems(USUDSDialogue* Dialogue, const FSUDSExpressionFunctionArgs& Args)
+	{
+		return Args[0].GetTextValue().ToString() == TEXT("Sword") ? 2 : 0;
+	}
+
+	FSUDSValue TestMax(USUDSDialogue* Dialogue, const FSUDSExpressionFunctionArgs& Args)
+	{
+		return (Args[0] > Args[1]).GetBooleanValue() ? Args[0] : Args[1];
+	}
+
+	FSUDSValue TestRoll(USUDSDialogue* Dialogue, const FSUDSExpressionFunctionArgs& Args)
+	{
+		return ++TestRollCount;
+	}
+
+	FSUDSValue TestRollTen(USUDSDialogue* Dialogue, const FSUDSExpressionFunctionArgs& Args)
+	{
+		return 10;
+	}
+
+	FSUDSValue TestHasDialogue(USUDSDialogue* Dialogue, const FSUDSExpressionFunctionArgs& Args)
+	{
+		return Dialogue != nullptr;
+	}
+
+	/// Supplies a dialogue to functions, without tracking variables
+	struct FTestFunctionContext : public ISUDSExpressionVariableHandler
+	{
+		USUDSDialogue* Dialogue = nullptr;
+		virtual void OnExpressionVariableRequested(const FSUDSScopedVariableName& Variable) override {}
+		virtual USUDSDialogue* GetExpressionDialogue() const override { return Dialogue; }
+	};
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestExpressionFunctions,
+								 "SUDSTest.TestExpressionFunctions",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestExpressionFunctions::RunTest(const FString& Parameters)
+{
+	USUDSSubsystem::RegisterExpressionFunction("count_items", 1, &TestCountItems, ESUDSValueType::Int);
+	USUDSSubsystem::RegisterExpressionFunction("max", 2, &TestMax);
+	USUDSSubsystem::RegisterExpressionFunction("roll", 0, &TestRoll, ESUDSValueType::Int);
+	TestRollCount = 0;
+
+	FSUDSExpression Expr;
+	TMap<FName, FSUDSValue> Variables;
+	TMap<FName, FSUDSValue> GlobalVariables;
+	Variables.Add("x", 3);
+
+	TestTrue("Parse", Expr.ParseFromString("count_items(\"Sword\") > 1", nullptr));
+	auto& RPN = Expr.GetQueue();
+	if (TestEqual("Queue len", RPN.Num(), 4))
+	{
+		TestEqual("Queue 0", RPN[0].GetOperandValue().GetTextValue().ToString(), TEXT("Sword"));
+		TestTrue("Queue 1", RPN[1].IsFunctionCall());
+		TestEqual("Queue 1", RPN[1].GetFunctionName(), FName("count_items"));
+		TestEqual("Queue 1", RPN[1].GetNumArgs(), 1);
+		TestEqual("Queue 3", RPN[3].GetType(), ESUDSExpressionItemType::Greater);
+	}
+	TestTrue("Has calls", Expr.HasFunctionCalls());
+	// Return type was registered
+	TestEqual("Specialised", Expr.GetProgram()[1].OpCode, ESUDSExpressionOpCode::CallFunction);
+	TestEqual("Specialised", Expr.GetProgram()[3].OpCode, ESUDSExpressionOpCode::GreaterInt);
+	TestTrue("Eval", Expr.EvaluateBoolean(Variables, GlobalVariables, ""));
+
+	TestTrue("Parse", Expr.ParseFromString("max(1, {x} + 2) * 2", nullptr));
+	TestEqual("Eval", Expr.Evaluate(Variables, GlobalVariables).GetIntValue(), 10);
+	TestTrue("Parse", Expr.ParseFromString("max(max(1, 7), {x}) - max (2,1)", nullptr));
+	TestEqual("Eval", Expr.Evaluate(Variables, GlobalVariables).GetIntValue(), 5);
+	TestTrue("Parse", Expr.ParseFromString("not (roll() == 0) and true", nullptr));
+	TestTrue("Eval", Expr.EvaluateBoolean(Variables, GlobalVariables, ""));
+	TestTrue("Parse", Expr.ParseFromString("{x} + 1", nullptr));
+	TestFalse("No calls", Expr.HasFunctionCalls());
+
+	// Calls are never folded even if all the args are literals
+	TestTrue("Parse", Expr.ParseFromString("roll() * (2 - 1) + max(2, 3)", nullptr));
+	Expr.Optimise();
+	TestEqual("Optimised queue len", Expr.GetQueue().Num(), 5);
+	const int First = Expr.Evaluate(Variables, GlobalVariables).GetIntValue();
+	const int Second = Expr.Evaluate(Variables, GlobalVariables).GetIntValue();
+	TestEqual("Called each time", Second, First + 1);
+	// Or when the result can't change the outcome
+	TestTrue("Parse", Expr.ParseFromString("roll() > 0 and false", nullptr));
+	Expr.Optimise(true);
+	TestTrue("Call kept", Expr.HasFunctionCalls());
+	const int Before = TestRollCount;
+	TestFalse("Eval", Expr.EvaluateBoolean(Variables, GlobalVariables, ""));
+	TestEqual("Called when absorbed", TestRollCount, Before + 1);
+
+	FString ParseError;
+	TestFalse("Unknown function", Expr.ParseFromString("nope(1)", &ParseError));
+	TestEqual("Correct error", ParseError, TEXT("Unknown function 'nope'"));
+	TestFalse("Wrong args", Expr.ParseFromString("max(1)", &ParseError));
+	TestEqual("Correct error", ParseError, TEXT("Function 'max' takes 2 arguments, not 1"));
+	TestFalse("Wrong args", Expr.ParseFromString("roll(1)", &ParseError));
+	TestFalse("Stray comma", Expr.ParseFromString("1, 2", &ParseError));
+	TestEqual("Correct error", ParseError, TEXT("Unexpected ',' outside of function call"));
+	TestFalse("Missing arg", Expr.ParseFromString("max(1,)", &ParseError));
+	TestFalse("Unclosed", Expr.ParseFromString("max(1, 2", &ParseError));
+
+	// Functions are found when called, so replacing one after compiling is picked up
+	TestTrue("Parse", Expr.ParseFromString("roll()", nullptr));
+	USUDSSubsystem::UnregisterExpressionFunction("roll");
+	USUDSSubsystem::RegisterExpressionFunction("roll", 0, &TestRollTen, ESUDSValueType::Int);
+	TestEqual("Replaced function", Expr.Evaluate(Variables, GlobalVariables).GetIntValue(), 10);
+	Expr.Reset();
+	TestFalse("Reset clears calls", Expr.HasFunctionCalls());
+
+	// The dialogue evaluating the expression is passed to functions
+	USUDSSubsystem::RegisterExpressionFunction("has_dialogue", 0, &TestHasDialogue, ESUDSValueType::Boolean);
+	TestTrue("Parse", Expr.ParseFromString("has_dialogue()", nullptr));
+	TestFalse("No dialogue", Expr.EvaluateBoolean(Variables, GlobalVariables, ""));
+	FTestFunctionContext Context;
+	Context.Dialogue = NewObject<USUDSDialogue>();
+	TestTrue("Has dialogue", Expr.Evaluate(Variables, GlobalVariables, &Context).GetBooleanValue());
+
+	USUDSSubsystem::UnregisterExpressionFunction("count_items");
+	USUDSSubsystem::UnregisterExpressionFunction("max");
+	USUDSSubsystem::UnregisterExpressionFunction("roll");
+	USUDSSubsystem::UnregisterExpressionFunction("has_dialogue");
+
+	return true;
+}
 
 UE_ENABLE_OPTIMIZATION
\ No newline at end of file
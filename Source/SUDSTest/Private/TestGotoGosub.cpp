@@ -3,6 +3,7 @@
 #include "SUDSMessageLogger.h"
 #include "SUDSScript.h"
 #include "SUDSScriptImporter.h"
+#include "SUDSScriptNodeGosub.h"
 #include "TestUtils.h"
 #include "Misc/AutomationTest.h"
 
@@ -413,5 +414,178 @@ bool FTestGosubBetweenSpeakerAndChoice2::RunTest(const FString& Parameters)
 	return true;
 }
 
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestScriptGraph,
+								 "SUDSTest.TestScriptGraph",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+bool FTestScriptGraph::RunTest(const FString& Parameters)
+{
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(GotoGosubInput), GotoGosubInput.Len(), "GotoGosubInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	// The flat graph must mirror the node objects exactly
+	const FSUDSScriptGraph& Graph = Script->GetGraph();
+	TestEqual("Graph node count", Graph.Num(), Script->GetNodes().Num() + Script->GetHeaderNodes().Num());
+	for (int32 i = 0; i < Script->GetNodes().Num(); ++i)
+	{
+		const USUDSScriptNode* Node = Script->GetNodes()[i];
+		TestEqual("Graph index", Node->GetGraphIndex(), i);
+		TestEqual("Node type", Graph.GetNode(i).Type, Node->GetNodeType());
+		const auto Edges = Graph.GetEdges(i);
+		if (TestEqual("Edge count", Edges.Num(), Node->GetEdgeCount()))
+		{
+			for (int32 e = 0; e < Edges.Num(); ++e)
+			{
+				const FSUDSScriptEdge& EdgeObj = Node->GetEdges()[e];
+				TestTrue("Edge target", Graph.GetNodeObject(Edges[e].TargetNode) == EdgeObj.GetTargetNode().Get());
+				TestEqual("Edge target index", Edges[e].TargetNode, EdgeObj.GetTargetNodeIndex());
+				TestEqual("Edge condition", Edges[e].ConditionIndex, EdgeObj.GetConditionIndex());
+				TestEqual("Edge type", Edges[e].Type, EdgeObj.GetType());
+			}
+		}
+		if (auto GosubNode = Cast<USUDSScriptNodeGosub>(Node))
+		{
+			TestTrue("Gosub target", Graph.GetGosubTarget(i) == Script->GetNodeByLabel(GosubNode->GetLabelName()));
+		}
+	}
+
+	// Duplicates need their own graph pointing at their own nodes
+	auto Dupe = DuplicateObject<USUDSScript>(Script, GetTransientPackage());
+	TestEqual("Duplicate graph node count", Dupe->GetGraph().Num(), Graph.Num());
+	if (Dupe->GetNodes().Num() > 0)
+	{
+		TestTrue("Duplicate graph nodes", Dupe->GetGraph().GetNodeObject(0) == Dupe->GetNodes()[0]);
+	}
+	
+	Dupe->MarkAsGarbage();
+	Script->MarkAsGarbage();
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestChoiceSearchManyPaths,
+								 "SUDSTest.TestChoiceSearchManyPaths",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+bool FTestChoiceSearchManyPaths::RunTest(const FString& Parameters)
+{
+	// Lots of conditional blocks between a speaker line and its choices, all converging on a shared gosub, plus a
+	// loop with no text in it. Searching every path for a choice would be exponential here, and the loop would
+	// never terminate
+	const int NumBlocks = 40;
+	FString Input = TEXT("NPC: Start\n");
+	for (int i = 0; i < NumBlocks; ++i)
+	{
+		Input += FString::Printf(TEXT("[if {Flag%d}]\n    [if {Nested%d}]\n        [gosub sub]\n    [else]\n        [set Count = 1]\n    [endif]\n[else]\n    [gosub sub]\n[endif]\n"), i, i);
+	}
+	Input += TEXT(":loop\n[if {Looping}]\n    [set Count = 2]\n    [goto loop]\n[endif]\n");
+	Input += TEXT("* Choice A\n    NPC: A\n    [goto end]\n* Choice B\n    NPC: B\n    [goto end]\n");
+	Input += TEXT(":sub\n[set Visited = true]\n[return]\n");
+
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(Input), Input.Len(), "ChoiceSearchManyPaths", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	const double StartTime = FPlatformTime::Seconds();
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+	AddInfo(FString::Printf(TEXT("Populated %d nodes in %.2fms"), Script->GetNodes().Num(), (FPlatformTime::Seconds() - StartTime) * 1000.0));
+
+	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+	Dlg->Start();
+
+	TestDialogueText(this, "Start node", Dlg, "NPC", "Start");
+	TestFalse("Should not be simple continue", Dlg->IsSimpleContinue());
+	if (TestEqual("Choice Count", Dlg->GetNumberOfChoices(), 2))
+	{
+		TestEqual("Choice 1", Dlg->GetChoiceText(0).ToString(), "Choice A");
+		TestEqual("Choice 2", Dlg->GetChoiceText(1).ToString(), "Choice B");
+	}
+	TestTrue("Sub should have run", Dlg->GetVariableBoolean("Visited"));
+
+	Script->MarkAsGarbage();
+	return true;
+}
+
+
+const FString ReachableLinesInput = R"RAWSUD(
+Player: Start
+[gosub Greet]
+[if {Rich}]
+    NPC: Rich line
+[else]
+    NPC: Poor line
+[endif]
+Player: After
+[goto end]
+
+:Greet
+Guard: Halt
+[return]
+)RAWSUD";
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestReachableSpeakerLines,
+								 "SUDSTest.TestReachableSpeakerLines",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+bool FTestReachableSpeakerLines::RunTest(const FString& Parameters)
+{
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(ReachableLinesInput), ReachableLinesInput.Len(), "ReachableLinesInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+	Dlg->Start();
+	TestDialogueText(this, "Start", Dlg, "Player", "Start");
+
+	TArray<USUDSScriptNodeText*> Lines;
+	TArray<FString> Speakers;
+	Dlg->GetReachableSpeakerLines(1, Lines, Speakers);
+	if (TestEqual("Only the gosub line should be next", Lines.Num(), 1))
+	{
+		TestEqual("Next line", Lines[0]->GetText().ToString(), "Halt");
+	}
+	TestEqual("Next speakers", Speakers, TArray<FString> { "Guard" });
+
+	// Both branches after the return, but nothing further
+	Dlg->GetReachableSpeakerLines(2, Lines, Speakers);
+	if (TestEqual("Both branches after the gosub should be reachable", Lines.Num(), 3))
+	{
+		TestEqual("Nearest line first", Lines[0]->GetText().ToString(), "Halt");
+	}
+	TestEqual("One speaker per line", Speakers, TArray<FString> { "Guard", "NPC", "NPC" });
+	TestDialogueText(this, "Nothing should have been run", Dlg, "Player", "Start");
+
+	// Inside the gosub, returns go back through the dialogue's gosub stack
+	TestTrue("Continue", Dlg->Continue());
+	TestDialogueText(this, "Halt", Dlg, "Guard", "Halt");
+	Dlg->GetReachableSpeakerLines(1, Lines, Speakers);
+	TestEqual("Both branches after the return should be next", Lines.Num(), 2);
+	TestEqual("Speakers after return", Speakers, TArray<FString> { "NPC", "NPC" });
+	Dlg->GetReachableSpeakerLines(3, Lines, Speakers);
+	if (TestEqual("Lines after return", Lines.Num(), 3))
+	{
+		TestEqual("Furthest line last", Lines[2]->GetText().ToString(), "After");
+	}
+
+	Script->MarkAsGarbage();
+	return true;
+}
 
 UE_ENABLE_OPTIMIZATION
\ No newline at end of file
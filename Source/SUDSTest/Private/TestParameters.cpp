@@ -3,6 +3,7 @@
 #include "SUDSMessageLogger.h"
 #include "SUDSScript.h"
 #include "SUDSScriptImporter.h"
+#include "SUDSSubsystem.h"
 #include "TestParticipant.h"
 #include "TestUtils.h"
 #include "Internationalization/Internationalization.h"
@@ -81,6 +82,89 @@ bool FTestParameters::RunTest(const FString& Parameters)
 	return true;
 }
 
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestLegacyParameterNames,
+								 "SUDSTest.TestLegacyParameterNames",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestLegacyParameterNames::RunTest(const FString& Parameters)
+{
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(ParamsInput), ParamsInput.Len(), "ParamsInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	// Parameter names of every node & edge with text, in graph order
+	auto CollectParameterNames = [Script]()
+	{
+		auto Join = [](const TArray<FName>& Names)
+		{
+			return FString::JoinBy(Names, TEXT(","), [](const FName& Name) { return Name.ToString(); });
+		};
+		TArray<FString> Result;
+		for (auto Node : Script->GetNodes())
+		{
+			if (auto TextNode = Cast<USUDSScriptNodeText>(Node))
+			{
+				Result.Add(Join(TextNode->GetParameterNames()));
+			}
+			for (const auto& Edge : Node->GetEdges())
+			{
+				Result.Add(Join(Edge.GetParameterNames()));
+			}
+		}
+		return Result;
+	};
+	const TArray<FString> ImportedNames = CollectParameterNames();
+	TestTrue("Parameter names extracted on import", ImportedNames.Contains(TEXT("SpeakerName.Player")));
+
+	// Make the script look like one saved before parameter names were, which has none saved
+	FBoolProperty* NodeExtractedProp = FindFProperty<FBoolProperty>(USUDSScriptNodeText::StaticClass(), "bParameterNamesExtracted");
+	FArrayProperty* NodeNamesProp = FindFProperty<FArrayProperty>(USUDSScriptNodeText::StaticClass(), "ParameterNames");
+	FBoolProperty* EdgeExtractedProp = FindFProperty<FBoolProperty>(FSUDSScriptEdge::StaticStruct(), "bParameterNamesExtracted");
+	FArrayProperty* EdgeNamesProp = FindFProperty<FArrayProperty>(FSUDSScriptEdge::StaticStruct(), "ParameterNames");
+	if (!TestNotNull("Node flag", NodeExtractedProp) || !TestNotNull("Node names", NodeNamesProp) ||
+		!TestNotNull("Edge flag", EdgeExtractedProp) || !TestNotNull("Edge names", EdgeNamesProp))
+	{
+		return false;
+	}
+	for (auto Node : Script->GetNodes())
+	{
+		if (auto TextNode = Cast<USUDSScriptNodeText>(Node))
+		{
+			NodeExtractedProp->SetPropertyValue_InContainer(TextNode, false);
+			NodeNamesProp->ClearValue_InContainer(TextNode);
+		}
+		for (const auto& Edge : Node->GetEdges())
+		{
+			void* EdgePtr = const_cast<FSUDSScriptEdge*>(&Edge);
+			EdgeExtractedProp->SetPropertyValue_InContainer(EdgePtr, false);
+			EdgeNamesProp->ClearValue_InContainer(EdgePtr);
+		}
+	}
+	TestFalse("Legacy script has no parameter names", CollectParameterNames().Contains(TEXT("SpeakerName.Player")));
+
+	// Loading extracts them again, the same as on import
+	Script->PostLoad();
+	TestEqual("Parameter names after load", CollectParameterNames(), ImportedNames);
+
+	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+	auto Participant = NewObject<UTestParticipant>();
+	Participant->TestNumber = 0;
+	Dlg->AddParticipant(Participant);
+	Dlg->Start();
+	TestDialogueText(this, "Line 1", Dlg, "Player", "Hello, I'm Protagonist");
+
+	Script->MarkAsGarbage();
+	return true;
+}
+
 IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestParametersPriority,
 								 "SUDSTest.TestParametersPriority",
 								 EAutomationTestFlags::EditorContext |
@@ -144,4 +228,156 @@ bool FTestParametersPriority::RunTest(const FString& Parameters)
 	return true;	
 }
 
+const FString TextCacheInput = R"RAWSUD(
+NPC: You have {Gold} gold
+	* Spend {Gold} gold
+		NPC: Spent
+	* Leave
+)RAWSUD";
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestTextCache,
+								 "SUDSTest.TestTextCache",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+bool FTestTextCache::RunTest(const FString& Parameters)
+{
+	FInternationalization::FCultureStateSnapshot CultureStateSnapshot;
+	FInternationalization::Get().BackupCultureState(CultureStateSnapshot);
+	FInternationalization::Get().SetCurrentCulture(TEXT("en-US"));
+	ON_SCOPE_EXIT
+	{
+		FInternationalization::Get().RestoreCultureState(CultureStateSnapshot);
+	};
+
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(TextCacheInput), TextCacheInput.Len(), "TextCacheInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+	Dlg->SetVariableInt("Gold", 10);
+	Dlg->Start();
+
+	TestDialogueText(this, "Line 1", Dlg, "NPC", "You have 10 gold");
+	Dlg->ResetTextCacheStats();
+	TestEqual("Text", Dlg->GetText().ToString(), "You have 10 gold");
+	TestEqual("Text", Dlg->GetText().ToString(), "You have 10 gold");
+	TestEqual("Hits", Dlg->GetTextCacheHits(), 2);
+	TestEqual("Choice", Dlg->GetChoiceText(0).ToString(), "Spend 10 gold");
+	TestEqual("Choice", Dlg->GetChoiceText(0).ToString(), "Spend 10 gold");
+	TestEqual("Hits", Dlg->GetTextCacheHits(), 3);
+
+	// Changing a parameter must re-format
+	Dlg->SetVariableInt("Gold", 1000);
+	TestEqual("Text", Dlg->GetText().ToString(), "You have 1,000 gold");
+	TestEqual("Choice", Dlg->GetChoiceText(0).ToString(), "Spend 1,000 gold");
+	TestEqual("Hits", Dlg->GetTextCacheHits(), 3);
+
+	// So must changing culture, since number formatting depends on it
+	FInternationalization::Get().SetCurrentCulture(TEXT("de-DE"));
+	Dlg->GetText();
+	TestEqual("Hits", Dlg->GetTextCacheHits(), 3);
+	FInternationalization::Get().SetCurrentCulture(TEXT("en-US"));
+	TestEqual("Text", Dlg->GetText().ToString(), "You have 1,000 gold");
+	TestEqual("Hits", Dlg->GetTextCacheHits(), 3);
+
+	Script->MarkAsGarbage();
+	return true;
+}
+
+const FString ProviderInput = R"RAWSUD(
+NPC: You have {Gold} gold and {Stats.Strength} strength
+[if {Gold} > 10 and {global.Fame} > 1]
+	NPC: Rich and famous
+[else]
+	NPC: Not yet
+[endif]
+NPC: Bye
+)RAWSUD";
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestVariableProviders,
+								 "SUDSTest.TestVariableProviders",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+bool FTestVariableProviders::RunTest(const FString& Parameters)
+{
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(ProviderInput), ProviderInput.Len(), "ProviderInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+	int Gold = 20;
+	int GoldCalls = 0;
+	Dlg->RegisterVariableProvider("Gold", FSUDSVariableProvider::CreateLambda([&](USUDSDialogue* D, FName Name, FSUDSValue& OutValue)
+	{
+		++GoldCalls;
+		OutValue = FSUDSValue(Gold);
+		return true;
+	}));
+	Dlg->RegisterVariableProviderPrefix("Stats.", FSUDSVariableProvider::CreateLambda([](USUDSDialogue* D, FName Name, FSUDSValue& OutValue)
+	{
+		if (Name == "Stats.Strength")
+		{
+			OutValue = FSUDSValue(7);
+			return true;
+		}
+		return false;
+	}));
+	USUDSSubsystem::RegisterGlobalVariableProvider("Fame", FSUDSVariableProvider::CreateLambda([](USUDSDialogue* D, FName Name, FSUDSValue& OutValue)
+	{
+		OutValue = FSUDSValue(5);
+		return true;
+	}));
+	ON_SCOPE_EXIT
+	{
+		USUDSSubsystem::UnregisterGlobalVariableProvider("Fame");
+	};
+	int NumChanges = 0;
+	Dlg->OnVariableChangedNative.AddLambda([&](USUDSDialogue* D, FName Name, const FSUDSValue& Value, bool bFromScript)
+	{
+		++NumChanges;
+	});
+
+	Dlg->Start();
+	TestDialogueText(this, "Line 1", Dlg, "NPC", "You have 20 gold and 7 strength");
+	GoldCalls = 0;
+	TestTrue("Continue", Dlg->Continue());
+	TestDialogueText(this, "Line 2", Dlg, "NPC", "Rich and famous");
+	TestEqual("Gold should be provided once per step", GoldCalls, 1);
+
+	// Provided values are never stored
+	TestFalse("Gold should not be set", Dlg->IsVariableSet("Gold"));
+	TestFalse("Stat should not be set", Dlg->IsVariableSet("Stats.Strength"));
+	TestEqual("No variable changes", NumChanges, 0);
+
+	// Results mustn't be reused by later steps
+	Gold = 5;
+	Dlg->Restart();
+	TestDialogueText(this, "Line 1", Dlg, "NPC", "You have 5 gold and 7 strength");
+	TestTrue("Continue", Dlg->Continue());
+	TestDialogueText(this, "Line 2", Dlg, "NPC", "Not yet");
+
+	// Once removed, the variable comes from state again
+	Dlg->UnregisterVariableProvider("Gold");
+	Dlg->SetVariableInt("Gold", 50);
+	Dlg->Restart();
+	TestDialogueText(this, "Line 1", Dlg, "NPC", "You have 50 gold and 7 strength");
+	TestTrue("Continue", Dlg->Continue());
+	TestDialogueText(this, "Line 2", Dlg, "NPC", "Rich and famous");
+
+	Script->MarkAsGarbage();
+	return true;
+}
+
 UE_ENABLE_OPTIMIZATION
\ No newline at end of file
@@ -56,6 +56,10 @@ void UTestParticipant::OnDialogueEvent_Implementation(USUDSDialogue* Dialogue,
 	const TArray<FSUDSValue>& Arguments)
 {
 	EventRecords.Add(FEventRecord { EventName, Arguments });
+	if (EventOrder)
+	{
+		EventOrder->Add(this);
+	}
 }
 
 void UTestParticipant::OnDialogueVariableChanged_Implementation(USUDSDialogue* Dialogue,
@@ -31,6 +31,8 @@ public:
 
 	TArray<FEventRecord> EventRecords;
 	TArray<FSetVarRecord> SetVarRecords;
+	/// If set, participants add themselves here when they receive an event, to check the order they're called in
+	TArray<UObject*>* EventOrder = nullptr;
 
 	
 	virtual void OnDialogueStarting_Implementation(USUDSDialogue* Dialogue, FName AtLabel) override;
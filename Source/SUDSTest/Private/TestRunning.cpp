@@ -6,6 +6,7 @@
 #include "SUDSSubsystem.h"
 #include "TestUtils.h"
 #include "Internationalization/Internationalization.h"
+#include "Sound/DialogueWave.h"
 #include "Misc/AutomationTest.h"
 
 UE_DISABLE_OPTIMIZATION
@@ -385,6 +386,32 @@ bool FTestSpeakerNames::RunTest(const FString& Parameters)
 	TestDialogueText(this, "Text 4", Dlg, "NPC", "Aha!");
 	TestEqual("NPC speaker name should have changed", Dlg->GetSpeakerDisplayName().ToString(), "Actually A Villain");
 
+	// Speaker table
+	USUDSScriptNodeText* NPCNode = nullptr;
+	for (auto N : Script->GetNodes())
+	{
+		auto TN = Cast<USUDSScriptNodeText>(N);
+		if (TN && TN->GetSpeakerID() == "NPC")
+		{
+			NPCNode = TN;
+			break;
+		}
+	}
+	if (TestNotNull("Should have found NPC node", NPCNode))
+	{
+		auto Info = Script->GetSpeakerInfo(NPCNode->GetSpeakerIndex());
+		if (TestNotNull("Speaker info should exist", Info))
+		{
+			TestEqual("Speaker info ID", Info->SpeakerID, "NPC");
+			TestEqual("Speaker info display name key", Info->DisplayNameKey, FName("SpeakerName.NPC"));
+			auto Target = Script->GetSpeakerInfo(Info->DefaultTargetIndex);
+			if (TestNotNull("Default target should exist", Target))
+			{
+				TestEqual("Default target should be first other speaker", Target->SpeakerID, "Player");
+			}
+		}
+	}
+
 
 	Script->MarkAsGarbage();
 	return true;
@@ -489,4 +516,140 @@ bool FTestLinesBetweenTextAndChoice::RunTest(const FString& Parameters)
 	return true;
 }
 
+const FString VoiceStreamingInput = R"RAWSUD(
+:start
+Player: Line 1
+NPC: Line 2
+Player: Line 3
+NPC: Line 4
+)RAWSUD";
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestVoiceStreaming,
+								 "SUDSTest.TestVoiceStreaming",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+bool FTestVoiceStreaming::RunTest(const FString& Parameters)
+{
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(VoiceStreamingInput), VoiceStreamingInput.Len(), "VoiceStreamingInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	// Give every line a wave, as the VO tools would
+	for (auto N : Script->GetNodes())
+	{
+		if (auto TN = Cast<USUDSScriptNodeText>(N))
+		{
+			TN->SetWave(NewObject<UDialogueWave>(GetTransientPackage()));
+		}
+	}
+	Script->RefreshHasVoicedLines();
+
+	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+	Dlg->SetVoiceStreaming(1);
+	Dlg->Start();
+
+	int Resident, Pending, SyncLoads;
+	int64 Bytes;
+	TestDialogueText(this, "Line 1", Dlg, "Player", "Line 1");
+	TestTrue("Line should be voiced", Dlg->IsCurrentLineVoiced());
+	Dlg->GetVoiceStreamingStats(Resident, Pending, Bytes, SyncLoads);
+	TestEqual("Current and next line should be streamed", Resident + Pending, 2);
+
+	TestTrue("Continue", Dlg->Continue());
+	TestDialogueText(this, "Line 2", Dlg, "NPC", "Line 2");
+	Dlg->GetVoiceStreamingStats(Resident, Pending, Bytes, SyncLoads);
+	TestEqual("Previous line should have been released", Resident + Pending, 2);
+	TestNotNull("Current wave should be available", Dlg->GetWave());
+	TestEqual("Loading an available wave returns it", Dlg->LoadCurrentWave(), Dlg->GetWave());
+	Dlg->GetVoiceStreamingStats(Resident, Pending, Bytes, SyncLoads);
+	TestEqual("Wave was already available, so shouldn't have been loaded", SyncLoads, 0);
+
+	Dlg->SetVoiceStreaming(0);
+	Dlg->GetVoiceStreamingStats(Resident, Pending, Bytes, SyncLoads);
+	TestEqual("Only the current line should be streamed", Resident + Pending, 1);
+
+	// Waves have no contexts, so no sound, but it shouldn't fail
+	TestNull("No sound without contexts", Dlg->GetVoicedLineSound());
+
+	TestTrue("Continue", Dlg->Continue());
+	TestTrue("Continue", Dlg->Continue());
+	TestFalse("Continue", Dlg->Continue());
+	TestTrue("Should be ended", Dlg->IsEnded());
+	Dlg->GetVoiceStreamingStats(Resident, Pending, Bytes, SyncLoads);
+	TestEqual("Everything should be released at the end", Resident + Pending, 0);
+
+	Script->MarkAsGarbage();
+	return true;
+}
+
+const FString SelectInGosubBeforeChoiceInput = R"RAWSUD(
+NPC: Pick one
+[gosub Prepare]
+  * I'm {Mood}
+	NPC: Count is {Count}
+  * Never mind
+	NPC: Fine
+[goto end]
+
+:Prepare
+[set Count {Count} + 1]
+[if {Rich}]
+	[set Mood "happy"]
+	[set Count {Count} + 10]
+[else]
+	[set Mood "sad"]
+[endif]
+[return]
+)RAWSUD";
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestSelectInGosubBeforeChoice,
+								 "SUDSTest.TestSelectInGosubBeforeChoice",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+bool FTestSelectInGosubBeforeChoice::RunTest(const FString& Parameters)
+{
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(SelectInGosubBeforeChoiceInput), SelectInGosubBeforeChoiceInput.Len(), "SelectInGosubBeforeChoiceInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	// The nodes between the line and the choices are run exactly once, taking the branch the select chooses, then
+	// the choices are found after the return; the same results as finding the choices first and then running up to them
+	for (const bool bRich : { true, false })
+	{
+		auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+		Dlg->SetVariableInt("Count", 0);
+		Dlg->SetVariableBoolean("Rich", bRich);
+		Dlg->Start();
+
+		TestDialogueText(this, "Line before gosub", Dlg, "NPC", "Pick one");
+		TestEqual("Gosub should have been run once", Dlg->GetVariableInt("Count"), bRich ? 11 : 1);
+		if (TestEqual("Choices after gosub", Dlg->GetNumberOfChoices(), 2))
+		{
+			TestEqual("Choice text uses variables set in gosub", Dlg->GetChoiceText(0).ToString(), bRich ? TEXT("I'm happy") : TEXT("I'm sad"));
+			TestEqual("Choice text", Dlg->GetChoiceText(1).ToString(), TEXT("Never mind"));
+		}
+
+		TestTrue("Choose", Dlg->Choose(0));
+		TestDialogueText(this, "Chosen line", Dlg, "NPC", bRich ? TEXT("Count is 11") : TEXT("Count is 1"));
+		TestFalse("Continue", Dlg->Continue());
+		TestTrue("Should be ended", Dlg->IsEnded());
+		TestEqual("Gosub shouldn't be run again", Dlg->GetVariableInt("Count"), bRich ? 11 : 1);
+	}
+
+	Script->MarkAsGarbage();
+	return true;
+}
+
 UE_ENABLE_OPTIMIZATION
\ No newline at end of file
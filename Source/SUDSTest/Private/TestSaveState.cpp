@@ -5,6 +5,8 @@
 #include "SUDSScriptImporter.h"
 #include "TestUtils.h"
 #include "Misc/AutomationTest.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
 
 UE_DISABLE_OPTIMIZATION
 
@@ -143,4 +145,132 @@ bool FTestSaveState::RunTest(const FString& Parameters)
 	return true;
 }
 
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestRestoreLargeScript,
+								 "SUDSTest.TestRestoreLargeScript",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+bool FTestRestoreLargeScript::RunTest(const FString& Parameters)
+{
+	// Big script so that finding the saved text & gosub nodes would be expensive if it scaled with node count
+	const int32 NumLines = 5000;
+	FString Input = TEXT("NPC: Start\n[gosub sub] @GS1@\n");
+	for (int32 i = 0; i < NumLines; ++i)
+	{
+		Input.Appendf(TEXT("NPC: Line %d\n"), i);
+	}
+	Input.Append(TEXT("[goto end]\n:sub\nNPC: In sub\n[return]\n"));
+	
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(Input), Input.Len(), "RestoreLargeScriptInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+	Dlg->Start();
+	TestDialogueText(this, "Text node", Dlg, "NPC", "Start");
+	TestTrue("Continue", Dlg->Continue());
+	TestDialogueText(this, "Text node", Dlg, "NPC", "In sub");
+	const auto SaveState = Dlg->GetSavedState();
+	TestEqual("Return stack saved", SaveState.GetReturnStack().Num(), 1);
+
+	// Restore repeatedly, as if loading lots of NPCs
+	const int32 NumRestores = 1000;
+	auto Dlg2 = USUDSLibrary::CreateDialogue(Script, Script);
+	const double StartTime = FPlatformTime::Seconds();
+	for (int32 i = 0; i < NumRestores; ++i)
+	{
+		Dlg2->RestoreSavedState(SaveState);
+	}
+	const double Elapsed = FPlatformTime::Seconds() - StartTime;
+	AddInfo(FString::Printf(TEXT("%d restores on a %d node script took %.2fms"), NumRestores, Script->GetNodes().Num(), Elapsed * 1000.0));
+
+	// Must have come back inside the gosub, and return to the right place
+	TestDialogueText(this, "Restored node", Dlg2, "NPC", "In sub");
+	TestTrue("Continue", Dlg2->Continue());
+	TestDialogueText(this, "Returned from gosub", Dlg2, "NPC", "Line 0");
+
+	Script->MarkAsGarbage();
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestValueSerialisation,
+								 "SUDSTest.TestValueSerialisation",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+bool FTestValueSerialisation::RunTest(const FString& Parameters)
+{
+	// Write values in the format used before FSUDSValue was a tagged union: type, int bits, then text or name
+	TArray<uint8> Legacy;
+	{
+		FMemoryWriter Writer(Legacy);
+		int32 ZeroBits = 0;
+		uint8 Type = (uint8)ESUDSValueType::Text;
+		FText Text = INVTEXT("Hello");
+		Writer << Type << ZeroBits << Text;
+		Type = (uint8)ESUDSValueType::Name;
+		FString NameStr = "SomeName";
+		Writer << Type << ZeroBits << NameStr;
+		Type = (uint8)ESUDSValueType::Float;
+		float FloatVal = 2.5f;
+		Writer << Type << FloatVal;
+		Type = (uint8)ESUDSValueType::Variable;
+		NameStr = "SomeVar";
+		Writer << Type << ZeroBits << NameStr;
+	}
+
+	FSUDSValue TextVal, NameVal, FloatVal, VarVal;
+	{
+		FMemoryReader Reader(Legacy);
+		Reader << TextVal << NameVal << FloatVal << VarVal;
+	}
+	TestEqual("Text type", TextVal.GetType(), ESUDSValueType::Text);
+	TestEqual("Text value", TextVal.GetTextValue().ToString(), "Hello");
+	TestEqual("Name type", NameVal.GetType(), ESUDSValueType::Name);
+	TestEqual("Name value", NameVal.GetNameValue().ToString(), "SomeName");
+	TestEqual("Float type", FloatVal.GetType(), ESUDSValueType::Float);
+	TestEqual("Float value", FloatVal.GetFloatValue(), 2.5f);
+	TestEqual("Variable type", VarVal.GetType(), ESUDSValueType::Variable);
+	TestEqual("Variable name", VarVal.GetVariableNameValue().ToString(), "SomeVar");
+	// Unset variables must still degrade to defaults even though the name shares storage with the number
+	TestEqual("Variable as int", VarVal.GetIntValue(), 0);
+	TestFalse("Variable as bool", VarVal.GetBooleanValue());
+	TestTrue("Variable as text", VarVal.GetTextValue().IsEmpty());
+
+	// Round trip should write exactly what we read
+	TArray<uint8> Written;
+	{
+		FMemoryWriter Writer(Written);
+		Writer << TextVal << NameVal << FloatVal << VarVal;
+	}
+	TestEqual("Round trip size", Written.Num(), Legacy.Num());
+
+	// Copies share the text, assignment over a different type releases it
+	FSUDSValue Copy = TextVal;
+	TestTrue("Copy identical", Copy.IsIdenticalTo(TextVal));
+	Copy = FSUDSValue(3);
+	TestEqual("Reassigned", Copy.GetIntValue(), 3);
+	TestEqual("Original text intact", TextVal.GetTextValue().ToString(), "Hello");
+
+	// Report the footprint of a large variable state
+	TMap<FName, FSUDSValue> State;
+	for (int32 i = 0; i < 10000; ++i)
+	{
+		State.Add(FName(TEXT("Var"), i), FSUDSValue(i));
+	}
+	AddInfo(FString::Printf(TEXT("sizeof(FSUDSValue) = %d, 10000 int variables = %d bytes"),
+	                        (int32)sizeof(FSUDSValue),
+	                        (int32)State.GetAllocatedSize()));
+	
+	return true;
+}
+
 UE_ENABLE_OPTIMIZATION
\ No newline at end of file
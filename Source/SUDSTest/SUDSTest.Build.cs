@@ -15,7 +15,8 @@ public class SUDSTest : ModuleRules
                 "CoreUObject",
                 "Engine",
                 "SUDS",
-                "SUDSEditor"
+                "SUDSEditor",
+                "UnrealEd"
             }
         );
         